@@ -4,6 +4,14 @@
 *	Revision history	:
 *		19/10/2018		- Initial release
 *       19/03/2019      - Implementation with new DMA PLIB driver.
+*       17/10/2026      - Deferred mode: LOG(...) pushes a record in a queue
+*                         formatted and transmitted later by log_deamon().
+*                       - Two transmit buffers chained by the DMA Block Transfer
+*                         Done interrupt. Deferred LOG(...) callable from ISR.
+*                       - Each LOG(...) call has its own format descriptor, the
+*                         format string is parsed only once.
+*                       - A record which does not fit in a transmit buffer is
+*                         dropped and counted (see log_get_too_long_count()).
 * 
 *********************************************************************/
 
@@ -12,21 +20,153 @@
 static UART_MODULE m_uart_id = UART_NUMBER_OF_MODULES;
 static DMA_MODULE m_dma_id = DMA_NUMBER_OF_MODULES;
 static dma_channel_transfer_t dma_tx = {0};
+static LOG_MODE_t m_mode = LOG_MODE_BLOCKING;
+
+// Ping-pong transmit buffers: one is formatted while the other one is sent.
+// They are filled and sent alternately (0, 1, 0, 1...) which keeps the order.
+static char m_buffer[2][LOG_BUFFER_SIZE / 2] = {0};
+static volatile uint16_t m_buffer_size[2] = {0};            // Number of bytes to send (0: buffer free)
+static volatile uint8_t m_buffer_in_flight = LOG_NO_BUFFER; // Buffer being sent by the DMA
+static volatile uint8_t m_buffer_next_tx = 0;               // Next buffer to send
+static uint8_t m_buffer_fill = 0;                           // Next buffer to format
+
+// Records queue: the head is reserved with the interrupts disabled so that
+// LOG(...) can be called from any context. The consumer (log_deamon) stops at
+// the first record not yet completed by its producer.
+static log_record_t m_queue[LOG_QUEUE_SIZE];
+static volatile uint16_t m_queue_head = 0;
+static volatile uint16_t m_queue_tail = 0;
+static volatile uint32_t m_overflow_count = 0;
+static uint32_t m_too_long_count = 0;                       // Records dropped because larger than a transmit buffer
+
+// Must be called with the interrupts disabled (or from the DMA interrupt).
+static void _start_next_transfer(void)
+{
+    if ((m_buffer_in_flight == LOG_NO_BUFFER) && (m_buffer_size[m_buffer_next_tx] > 0))
+    {
+        dma_tx.src_start_addr = m_buffer[m_buffer_next_tx];
+        dma_tx.dst_start_addr = (void *)uart_get_tx_reg(m_uart_id);
+        dma_tx.src_size = m_buffer_size[m_buffer_next_tx];
+        dma_tx.dst_size = 1;
+        dma_tx.cell_size = 1;
+        dma_tx.pattern_data = 0x0000,
+
+        dma_set_transfer_params(m_dma_id, &dma_tx);  
+        dma_channel_enable(m_dma_id, ON, true);     // Do not take care of the 'force_transfer' boolean value because the DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).
+        
+        m_buffer_in_flight = m_buffer_next_tx;
+        m_buffer_next_tx ^= 1;
+    }
+}
+
+// Must be called with the interrupts disabled (or from the DMA interrupt). 
+// Releases the buffer sent by the DMA (if the transfer is over) and chains the next one.
+static void _transfer_done(void)
+{
+    if ((m_buffer_in_flight != LOG_NO_BUFFER) && !dma_channel_is_enable(m_dma_id))
+    {
+        dma_clear_flags(m_dma_id, DMA_FLAG_BLOCK_TRANSFER_DONE);
+        m_buffer_size[m_buffer_in_flight] = 0;
+        m_buffer_in_flight = LOG_NO_BUFFER;
+        _start_next_transfer();
+    }
+}
+
+static void _log_dma_event_handler(uint8_t id, DMA_CHANNEL_FLAGS flags)
+{
+    dma_clear_flags(id, flags);
+    if ((flags & DMA_FLAG_BLOCK_TRANSFER_DONE) > 0)
+    {
+        _transfer_done();
+    }
+}
+
+// Gives the formatted buffer to the DMA (started now if the DMA is idle, otherwise
+// by the Block Transfer Done interrupt of the current transfer).
+static void _queue_buffer(uint16_t size)
+{
+    uint32_t int_status = __builtin_disable_interrupts();
+    
+    m_buffer_size[m_buffer_fill] = size;
+    m_buffer_fill ^= 1;
+    _transfer_done();       // In case the interrupt is not mapped on the DMA vector.
+    _start_next_transfer();
+    
+    if (int_status & 0x00000001)
+    {
+        __builtin_enable_interrupts();
+    }
+}
+
+static bool _is_buffer_free(void)
+{
+    uint32_t int_status;
+    
+    if (m_buffer_size[m_buffer_fill] == 0)
+    {
+        return true;
+    }
+    
+    int_status = __builtin_disable_interrupts();
+    _transfer_done();
+    if (int_status & 0x00000001)
+    {
+        __builtin_enable_interrupts();
+    }
+    return (m_buffer_size[m_buffer_fill] == 0);
+}
 
 void log_init(UART_MODULE id_uart, uint32_t data_rate)
 {
+    uint8_t i;
+    
     m_uart_id = id_uart;
     m_dma_id = dma_get_free_channel();
     
     uart_init(  id_uart, NULL, IRQ_NONE, data_rate, UART_STD_PARAMS);
     
     dma_init(   m_dma_id, 
-                NULL, 
+                _log_dma_event_handler, 
                 DMA_CONT_PRIO_2, 
-                DMA_INT_NONE, 
+                DMA_INT_BLOCK_TRANSFER_DONE, 
                 DMA_EVT_START_TRANSFER_ON_IRQ, 
                 uart_get_tx_irq(id_uart), 
                 0xff);
+    
+    m_mode = LOG_MODE_BLOCKING;
+    m_buffer_size[0] = 0;
+    m_buffer_size[1] = 0;
+    m_buffer_in_flight = LOG_NO_BUFFER;
+    m_buffer_next_tx = 0;
+    m_buffer_fill = 0;
+    for (i = 0 ; i < LOG_QUEUE_SIZE ; i++)
+    {
+        m_queue[i].is_ready = false;
+    }
+    m_queue_head = 0;
+    m_queue_tail = 0;
+    m_overflow_count = 0;
+    m_too_long_count = 0;
+}
+
+/*******************************************************************************
+ * Function: 
+ *      void log_set_mode(LOG_MODE_t mode)
+ * 
+ * Description:
+ *      LOG_MODE_BLOCKING (default): each LOG(...) waits for the end of the 
+ *      previous transmission then formats and sends its message.
+ *      LOG_MODE_DEFERRED: each LOG(...) only pushes a record (format, timestamp
+ *      and raw arguments) in a queue. log_deamon() must be called in the main 
+ *      loop to format and send the records. If the queue is full, the record
+ *      is dropped and counted (see log_get_overflow_count()).
+ *      The strings passed with p_string(...) are read when the record is 
+ *      formatted so they must not be modified in between.
+ *      Only the LOG_MODE_DEFERRED can be used from an interrupt routine.
+ ******************************************************************************/
+void log_set_mode(LOG_MODE_t mode)
+{
+    m_mode = mode;
 }
 
 static uint16_t _transform_integer_to_string(char *p_buffer, uint16_t index_p_buffer, uint32_t value, STR_BASE_t _base, uint8_t number_of_char)
@@ -74,10 +214,8 @@ static uint16_t _transform_integer_to_string(char *p_buffer, uint16_t index_p_bu
     return index_p_buffer;
 }
 
-static uint16_t _get_header_to_string(char *p_buffer, uint16_t index_buffer, LOG_LEVEL_t level)
+static uint16_t _get_header_to_string(char *p_buffer, uint16_t index_buffer, LOG_LEVEL_t level, uint64_t time)
 {
-    uint8_t i = 0;
-    uint64_t time           = mGetTick();
     uint64_t time_us        = (time / TICK_1US);
     uint64_t time_ms        = (time / TICK_1MS);
     uint64_t time_s         = ((time / TICK_1S) % 60);
@@ -113,140 +251,317 @@ static uint16_t _get_header_to_string(char *p_buffer, uint16_t index_buffer, LOG
     return index_buffer;
 }
 
-void log_frontend(const char *p_message, LOG_LEVEL_t level, const uint32_t *p_args, uint8_t nargs)
+// Splits the format string in literal segments and conversions (type, width and base).
+// Done once per LOG(...) call site, the descriptor is then reused by every call.
+static void _parse_format(log_format_t *p_format)
 {
-    if (m_uart_id != UART_NUMBER_OF_MODULES)
-    {        
-        static char buffer[16000] = {0};
-        char *p_str = (char *) p_message;        
-        uint16_t index_buffer = 0;
-        uint8_t index_args = 0;
-        uint8_t _number_of_char_to_print = 0;
-        
-        // Wait while channel is enable (Block Transfer not yet done). 
-        // When a transmission is finished (Block Transfer Done), the channel is automatically disable (not set in DMA_CONT_AUTO_ENABLE).
-        while (dma_channel_is_enable(m_dma_id));
-        dma_clear_flags(m_dma_id, DMA_FLAG_BLOCK_TRANSFER_DONE);            
+    const char *p_str = p_format->p_str;
+    log_conversion_t *p_conversion;
+    uint8_t width;
+
+    p_format->number_of_conversions = 0;
+    p_format->literal_index = 0;
+    p_format->literal_length = 0;
 
-        if (level != LEVEL_2)
+    while ((*p_str != '\0') && (p_format->number_of_conversions < p_format->maximum_conversions) && (p_format->number_of_conversions < LOG_MAX_ARGS))
+    {
+        if (*p_str != '%')
         {
-            index_buffer = _get_header_to_string(buffer, index_buffer, level);
+            p_format->literal_length++;
+            p_str++;
+            continue;
         }
 
-        while (*p_str != '\0')
+        p_conversion = &p_format->p_conversion[p_format->number_of_conversions];
+        p_conversion->literal_index = p_format->literal_index;
+        p_conversion->literal_length = p_format->literal_length;
+
+        width = 0;
+        p_str++;
+        if ((*p_str >= '0') && (*p_str <= '9'))
         {
-            if (*p_str != '%')
-            {
-                buffer[index_buffer++] = *p_str;
-            }
-            else
+            width = (*p_str - '0');
+            p_str++;
+            if ((*p_str >= '0') && (*p_str <= '9'))
             {
-                _number_of_char_to_print = 0;
+                width *= 10;
+                width += (*p_str - '0');
                 p_str++;
-                if ((*p_str >= '0') && (*p_str <= '9'))
-                {
-                    _number_of_char_to_print = (*p_str - '0');
-                    p_str++;
-                    if ((*p_str >= '0') && (*p_str <= '9'))
-                    {
-                        _number_of_char_to_print *= 10;
-                        _number_of_char_to_print += (*p_str - '0');
-                        p_str++;
-                    }
-                }
+            }
+        }
+        if (*p_str == '\0')
+        {
+            break;
+        }
 
-                switch (*p_str)
-                {           
-                    case 'c':
-                        if (index_args < nargs)
-                        {
-                            buffer[index_buffer++] = p_args[index_args];
-                            index_args++;
-                        }
-                        break;
+        p_conversion->type = *p_str;
+        p_conversion->width = width;
+        switch (*p_str)
+        {
+            case 'b':
+                p_conversion->base = BASE_2;
+                break;
+            case 'o':
+                p_conversion->base = BASE_8;
+                break;
+            case 'x':
+                p_conversion->base = BASE_16;
+                break;
+            default:
+                p_conversion->base = BASE_10;
+                break;
+        }
+        p_format->number_of_conversions++;
 
-                    case 's':
-                        if (index_args < nargs)
-                        {
-                            char *str = (char *) p_args[index_args];
-                            do
-                            {
-                                buffer[index_buffer++] = *str++;
-                            }
-                            while (*str != '\0');
-                            index_args++;
-                        }
-                        break;
+        p_str++;
+        p_format->literal_index = (uint16_t) (p_str - p_format->p_str);
+        p_format->literal_length = 0;
+    }
+    // Whatever remains after the last conversion is the final literal segment.
+    p_format->literal_length += strlen(p_str);
+    p_format->is_parsed = true;
+}
 
-                    case 'b':
-                        if (index_args < nargs)
-                        {
-                            index_buffer = _transform_integer_to_string(buffer, index_buffer, p_args[index_args], BASE_2, _number_of_char_to_print);
-                            index_args++;
-                        }
-                        break;
+// Appends the record at p_buffer[index_buffer] without writing beyond p_buffer[size - 1].
+// If the record does not fit, nothing is kept and index_buffer is returned unchanged
+// (a record always adds at least "\n\r" otherwise).
+static uint16_t _format_message(char *p_buffer, uint16_t index_buffer, uint16_t size, log_format_t *p_format, LOG_LEVEL_t level, uint64_t time, const uint32_t *p_args, uint8_t nargs)
+{
+    const log_conversion_t *p_conversion;
+    uint16_t index_start = index_buffer;
+    uint8_t index_args;
+    uint8_t width;
 
-                    case 'o':
-                        if (index_args < nargs)
-                        {
-                            index_buffer = _transform_integer_to_string(buffer, index_buffer, p_args[index_args], BASE_8, _number_of_char_to_print);
-                            index_args++;
-                        }
-                        break;
+    if (!p_format->is_parsed)
+    {
+        _parse_format(p_format);
+    }
 
-                    case 'd':
-                        if (index_args < nargs)
-                        {
-                            index_buffer = _transform_integer_to_string(buffer, index_buffer, p_args[index_args], BASE_10, _number_of_char_to_print);
-                            index_args++;
-                        }
-                        break;
+    if (level != LEVEL_2)
+    {
+        if ((index_buffer + LOG_HEADER_MAX_SIZE) > size)
+        {
+            return index_start;
+        }
+        index_buffer = _get_header_to_string(p_buffer, index_buffer, level, time);
+    }
 
-                    case 'x':
-                        if (index_args < nargs)
-                        {
-                            index_buffer = _transform_integer_to_string(buffer, index_buffer, p_args[index_args], BASE_16, _number_of_char_to_print);
-                            index_args++;
-                        }
-                        break;
+    for (index_args = 0 ; index_args < p_format->number_of_conversions ; index_args++)
+    {
+        p_conversion = &p_format->p_conversion[index_args];
 
-                    case 'f':
-                        if (index_args < nargs)
-                        {
-                            float *p_val = (float *) (uint32_t *) p_args[index_args];
-                            float v = *p_val;
-                            uint32_t integer = fu_get_integer_value(v);
-                            uint32_t decimal = fu_get_decimal_value(v, (_number_of_char_to_print == 0) ? 3 : _number_of_char_to_print);
-
-                            index_buffer = _transform_integer_to_string(buffer, index_buffer, integer, BASE_10, 0);
-                            buffer[index_buffer++] = ',';
-                            index_buffer = _transform_integer_to_string(buffer, index_buffer, decimal, BASE_10, (_number_of_char_to_print == 0) ? 3 : _number_of_char_to_print);
-                            index_args++;
-                        }
-                        break;
+        // Room for the literal segment and the longest conversion (a float is two integers and a ',').
+        if ((index_buffer + p_conversion->literal_length + 2*LOG_INTEGER_MAX_SIZE + 1) > size)
+        {
+            return index_start;
+        }
+        memcpy(&p_buffer[index_buffer], &p_format->p_str[p_conversion->literal_index], p_conversion->literal_length);
+        index_buffer += p_conversion->literal_length;
 
-                    default:
-                        if (index_args < nargs)
+        if (index_args >= nargs)
+        {
+            continue;
+        }
+
+        switch (p_conversion->type)
+        {           
+            case 'c':
+                p_buffer[index_buffer++] = p_args[index_args];
+                break;
+
+            case 's':
+                {
+                    const char *str = (const char *) p_args[index_args];
+                    while (*str != '\0')
+                    {
+                        if (index_buffer >= size)
                         {
-                            index_args++;
+                            return index_start;
                         }
-                        break;
+                        p_buffer[index_buffer++] = *str++;
+                    }
                 }
-            }
-            p_str++;
+                break;
+
+            case 'b':
+            case 'o':
+            case 'd':
+            case 'x':
+                index_buffer = _transform_integer_to_string(p_buffer, index_buffer, p_args[index_args], p_conversion->base, p_conversion->width);
+                break;
+
+            case 'f':
+                {
+                    // p_float(...) passes the raw bits of the float (not its address) so that it can be deferred.
+                    float v = ((union { uint32_t u; float f; }){ .u = p_args[index_args] }).f;
+                    width = (p_conversion->width == 0) ? 3 : p_conversion->width;
+
+                    index_buffer = _transform_integer_to_string(p_buffer, index_buffer, fu_get_integer_value(v), BASE_10, 0);
+                    p_buffer[index_buffer++] = ',';
+                    index_buffer = _transform_integer_to_string(p_buffer, index_buffer, fu_get_decimal_value(v, width), BASE_10, width);
+                }
+                break;
+
+            default:
+                // Unknown conversion: the argument is skipped.
+                break;
         }
+    }
 
-        buffer[index_buffer++] = '\n'; 
-        buffer[index_buffer++] = '\r';
+    if ((index_buffer + p_format->literal_length + 2) > size)
+    {
+        return index_start;
+    }
+    memcpy(&p_buffer[index_buffer], &p_format->p_str[p_format->literal_index], p_format->literal_length);
+    index_buffer += p_format->literal_length;
 
-        dma_tx.src_start_addr = buffer;
-        dma_tx.dst_start_addr = (void *)uart_get_tx_reg(m_uart_id);
-        dma_tx.src_size = index_buffer;
-        dma_tx.dst_size = 1;
-        dma_tx.cell_size = 1;
-        dma_tx.pattern_data = 0x0000,
+    p_buffer[index_buffer++] = '\n'; 
+    p_buffer[index_buffer++] = '\r';
+    
+    return index_buffer;
+}
 
-        dma_set_transfer_params(m_dma_id, &dma_tx);  
-        dma_channel_enable(m_dma_id, ON, true);     // Do not take care of the 'force_transfer' boolean value because the DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).
+void log_frontend(log_format_t *p_format, LOG_LEVEL_t level, const uint32_t *p_args, uint8_t nargs)
+{
+    if (m_uart_id != UART_NUMBER_OF_MODULES)
+    {
+        if (m_mode == LOG_MODE_DEFERRED)
+        {
+            uint32_t int_status;
+            uint16_t head;
+            log_record_t *p_record;
+            uint64_t time;
+            uint8_t i;
+            
+            // Reserve a record (the interrupts are only disabled for the index update).
+            // The time is read without mGetTick() which modifies TMR1 (LOG can be called from an interrupt).
+            int_status = __builtin_disable_interrupts();
+            time = getTick + TMR1;
+            head = m_queue_head;
+            if (((head + 1) & (LOG_QUEUE_SIZE - 1)) == m_queue_tail)
+            {
+                m_overflow_count++;
+                head = LOG_QUEUE_SIZE;
+            }
+            else
+            {
+                m_queue_head = (head + 1) & (LOG_QUEUE_SIZE - 1);
+            }
+            if (int_status & 0x00000001)
+            {
+                __builtin_enable_interrupts();
+            }
+            
+            if (head == LOG_QUEUE_SIZE)
+            {
+                return;
+            }
+            
+            p_record = &m_queue[head];
+            p_record->p_format = p_format;
+            p_record->time = time;
+            p_record->level = level;
+            p_record->nargs = (nargs > LOG_MAX_ARGS) ? LOG_MAX_ARGS : nargs;
+            for (i = 0 ; i < p_record->nargs ; i++)
+            {
+                p_record->args[i] = p_args[i];
+            }
+            // Publish the record only once it is complete.
+            p_record->is_ready = true;
+        }
+        else
+        {
+            uint16_t size;
+            
+            // Wait for a free buffer (the previous message can still be in flight in the other one).
+            while (!_is_buffer_free());
+            
+            size = _format_message(m_buffer[m_buffer_fill], 0, sizeof(m_buffer[0]), p_format, level, mGetTick(), p_args, nargs);
+            if (size > 0)
+            {
+                _queue_buffer(size);
+            }
+            else
+            {
+                m_too_long_count++;
+            }
+        }
     }
 }
+
+/*******************************************************************************
+ * Function: 
+ *      void log_deamon(void)
+ * 
+ * Description:
+ *      Used in LOG_MODE_DEFERRED. When a transmit buffer is free, the pending
+ *      records are formatted in it (as many as possible while half of the
+ *      buffer is free) and it is queued for the DMA. A record which does not
+ *      fit in the rest of the buffer waits for the next one, a record larger
+ *      than a whole buffer is dropped and counted. The next buffer is sent
+ *      by the DMA interrupt as soon as the previous one is done so the UART
+ *      is kept busy while the other buffer is formatted.
+ *      It never waits for the DMA channel.
+ ******************************************************************************/
+void log_deamon(void)
+{
+    uint16_t index_buffer = 0;
+    uint16_t tail = m_queue_tail;
+    
+    if ((m_uart_id == UART_NUMBER_OF_MODULES) || !m_queue[tail].is_ready || !_is_buffer_free())
+    {
+        return;
+    }
+    
+    while (m_queue[tail].is_ready && (index_buffer < (LOG_BUFFER_SIZE / 4)))
+    {
+        log_record_t *p_record = &m_queue[tail];
+        uint16_t index_next = _format_message(m_buffer[m_buffer_fill], index_buffer, sizeof(m_buffer[0]), p_record->p_format, p_record->level, p_record->time, p_record->args, p_record->nargs);
+        
+        if (index_next == index_buffer)
+        {
+            if (index_buffer > 0)
+            {
+                // No room left: the record is kept for the next buffer.
+                break;
+            }
+            // Larger than an empty buffer: the record is dropped.
+            m_too_long_count++;
+        }
+        index_buffer = index_next;
+        // Release the record only once it has been read.
+        p_record->is_ready = false;
+        tail = (tail + 1) & (LOG_QUEUE_SIZE - 1);
+        m_queue_tail = tail;
+    }
+    
+    if (index_buffer > 0)
+    {
+        _queue_buffer(index_buffer);
+    }
+}
+
+/*******************************************************************************
+ * Function: 
+ *      uint32_t log_get_overflow_count(void)
+ * 
+ * Description:
+ *      Returns the number of records dropped because the deferred queue was full.
+ ******************************************************************************/
+uint32_t log_get_overflow_count(void)
+{
+    return m_overflow_count;
+}
+
+/*******************************************************************************
+ * Function: 
+ *      uint32_t log_get_too_long_count(void)
+ * 
+ * Description:
+ *      Returns the number of records dropped because their formatted text was
+ *      larger than a transmit buffer (LOG_BUFFER_SIZE / 2 bytes).
+ ******************************************************************************/
+uint32_t log_get_too_long_count(void)
+{
+    return m_too_long_count;
+}
@@ -1,6 +1,13 @@
 #ifndef __DEF_LOG
 #define __DEF_LOG
 
+#define LOG_QUEUE_SIZE                          (32)        // Number of records of the deferred LOG queue (must be a power of 2)
+#define LOG_MAX_ARGS                            (16)        // Maximum number of arguments kept by a deferred LOG record
+#define LOG_BUFFER_SIZE                         (16000)     // Split in two transmit buffers
+#define LOG_NO_BUFFER                           (0xff)
+#define LOG_HEADER_MAX_SIZE                     (29)        // LEVEL_0 header: 10+2+2+2+3+3 digits, 6 ':' and a space
+#define LOG_INTEGER_MAX_SIZE                    (34)        // 'b' prefix and 32 binary digits (longest integer conversion)
+
 typedef enum
 {
     LEVEL_0     = 0,        // LOG(...)         -> 0:00:00:00:000:000: your_str
@@ -8,15 +15,67 @@ typedef enum
     LEVEL_2     = 2,        // LOG_BLANCK(...)  -> your_str
 } LOG_LEVEL_t;
 
+typedef enum
+{
+    LOG_MODE_BLOCKING   = 0,    // LOG(...) waits for the previous message and formats the new one immediately
+    LOG_MODE_DEFERRED,          // LOG(...) only pushes a record, the formatting and the transmission are done by log_deamon()
+} LOG_MODE_t;
+
+typedef struct
+{
+    uint16_t            literal_index;      // Literal segment printed before the conversion
+    uint16_t            literal_length;
+    char                type;               // c, s, b, o, d, x or f
+    uint8_t             width;              // %NNd -> NN (0: necessary digits only)
+    STR_BASE_t          base;
+} log_conversion_t;
+
+typedef struct
+{
+    const char          *p_str;
+    bool                is_parsed;          // The format string is parsed at the first call only
+    uint8_t             number_of_conversions;
+    uint16_t            literal_index;      // Literal segment printed after the last conversion
+    uint16_t            literal_length;
+    uint8_t             maximum_conversions;    // Size of the conversion array of the call site (its number of arguments)
+    log_conversion_t    *p_conversion;
+} log_format_t;
+
+typedef struct
+{
+    log_format_t        *p_format;
+    uint64_t            time;
+    LOG_LEVEL_t         level;
+    uint8_t             nargs;
+    volatile bool       is_ready;
+    uint32_t            args[LOG_MAX_ARGS];
+} log_record_t;
+
 #define p_string(s)                             (uint32_t) (s)
-#define p_float(f)                              (uint32_t) (&f)
+#define p_float(_f)                             (((union { float f; uint32_t u; }){ .f = (_f) }).u)
 
-#define LOG_INTERNAL_X(level, str, N, ...)      log_frontend(str, level, ((uint32_t[]){ __VA_ARGS__ }), N)
+#define LOG_INTERNAL_X(level, str, N, ...)                                              \
+do                                                                                      \
+{                                                                                       \
+    static log_conversion_t __log_conversion[((N) > 0) ? (N) : 1];                     \
+    static log_format_t __log_format =                                                  \
+    {                                                                                   \
+        .p_str = str,                                                                   \
+        .is_parsed = false,                                                             \
+        .maximum_conversions = sizeof(__log_conversion) / sizeof(log_conversion_t),     \
+        .p_conversion = __log_conversion                                                \
+    };                                                                                  \
+    log_frontend(&__log_format, level, ((uint32_t[]){ __VA_ARGS__ }), N);               \
+} while (0)
 #define LOG(str, ...)                           LOG_INTERNAL_X(LEVEL_0, str, COUNT_ARGUMENTS( __VA_ARGS__ ), __VA_ARGS__)
 #define LOG_SHORT(str, ...)                     LOG_INTERNAL_X(LEVEL_1, str, COUNT_ARGUMENTS( __VA_ARGS__ ), __VA_ARGS__)
 #define LOG_BLANCK(str, ...)                    LOG_INTERNAL_X(LEVEL_2, str, COUNT_ARGUMENTS( __VA_ARGS__ ), __VA_ARGS__)
 
 void log_init(UART_MODULE id_uart, uint32_t data_rate);
-void log_frontend(const char *p_message, LOG_LEVEL_t level, const uint32_t *p_args, uint8_t nargs);
+void log_set_mode(LOG_MODE_t mode);
+void log_frontend(log_format_t *p_format, LOG_LEVEL_t level, const uint32_t *p_args, uint8_t nargs);
+void log_deamon(void);
+uint32_t log_get_overflow_count(void);
+uint32_t log_get_too_long_count(void);
 
 #endif
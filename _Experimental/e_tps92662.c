@@ -4,6 +4,8 @@
  *
  *	Revision history	:
  *		02/05/2019		- Initial release
+ *		17/10/2026		- Write frames of all the devices sent back-to-back in one transfer 
+ *                        (broadcast frame for identical writes) with echo validation.
  * 
  *  The TPS92662 LED matrix manager device enables fully dynamic adaptive 
  *  lighting solutions by providing individual pixel-level LED control.
@@ -456,40 +458,232 @@ static void _set_width(TPS92662_PARAMS *var, uint8_t device_index, uint8_t *buff
     buffer[15] = (((var->p_registers[device_index].width[9] >> 8) & 0x03) << 0) | (((var->p_registers[device_index].width[10] >> 8) & 0x03) << 2) | (((var->p_registers[device_index].width[11] >> 8) & 0x03) << 4);
 }
 
+static const TPS92662_REQUEST tps92662_request[SM_TPS92662_MAX_FLAGS] =
+{
+    [SM_TPS92662_READ_IC_IDENTIFIER]            = {TPS_READ_1B,     TPS92662_ADDR_IC_IDENTIFIER,        _get_ic_identifier,     NULL},
+    [SM_TPS92662_READ_ERRORS]                   = {TPS_READ_3B,     TPS92662_ADDR_ERRORS,               _get_errors,            NULL},
+    [SM_TPS92662_READ_ADCS]                     = {TPS_READ_2B,     TPS92662_ADDR_ADC,                  _get_adc,               NULL},
+    [SM_TPS92662_WRITE_SYSTEM_CONFIG]           = {TPS_WRITE_1B,    TPS92662_ADDR_SYSTEM_CONFIG,        NULL,                   _set_system_config},
+    [SM_TPS92662_WRITE_SLEW_RATE]               = {TPS_WRITE_1B,    TPS92662_ADDR_SLEW_RATE,            NULL,                   _set_slew_rate},
+    [SM_TPS92662_WRITE_OVER_VOLTAGE_LIMIT]      = {TPS_WRITE_1B,    TPS92662_ADDR_OVER_VOLTAGE_LIMIT,   NULL,                   _set_overvoltage_limit},
+    [SM_TPS92662_WRITE_PARALLEL_LED_STRING]     = {TPS_WRITE_1B,    TPS92662_ADDR_PARALLEL_LED_STRING,  NULL,                   _set_parallel_led_string},
+    [SM_TPS92662_WRITE_DEFAULT_PULSE_WIDTH]     = {TPS_WRITE_12B,   TPS92662_ADDR_DEFAULT_PULSE_WIDTH,  NULL,                   _set_default_pulse_width},
+    [SM_TPS92662_WRITE_WATCHDOG_TIMER]          = {TPS_WRITE_1B,    TPS92662_ADDR_WATCHDOG_TIMER,       NULL,                   _set_watchdog_timer},
+    [SM_TPS92662_WRITE_PWM_TICK_PERIOD]         = {TPS_WRITE_1B,    TPS92662_ADDR_PWM_TICK_PERIOD,      NULL,                   _set_pwm_tick_period},
+    [SM_TPS92662_WRITE_ADC_ID]                  = {TPS_WRITE_1B,    TPS92662_ADDR_ADC_ID,               NULL,                   _set_adc_id},
+    [SM_TPS92662_WRITE_SOFTSYNC]                = {TPS_WRITE_1B,    TPS92662_ADDR_SOFTSYNC,             NULL,                   _set_softsync},
+    [SM_TPS92662_WRITE_PHASE_AND_WIDTH]         = {TPS_WRITE_32B,   TPS92662_ADDR_PHASE,                NULL,                   _set_phase_and_width},
+    [SM_TPS92662_WRITE_PHASE]                   = {TPS_WRITE_16B,   TPS92662_ADDR_PHASE,                NULL,                   _set_phase},
+    [SM_TPS92662_WRITE_WIDTH]                   = {TPS_WRITE_16B,   TPS92662_ADDR_WIDTH,                NULL,                   _set_width}
+};
+
+/*******************************************************************************
+  Function:
+    static uint8_t _build_frame(TPS92662_PARAMS *var, uint8_t flag, uint8_t device_index, uint8_t *buffer)
+
+  Description:
+    This routine is used by the driver to write a request frame (init, device id, address,
+    data for a write request and CRC) in the transmit buffer.
+    A broadcast frame (device_index = TPS92662_BROADCAST_INDEX) uses the data of the first 
+    device (all the devices have the same data - see _search_frames()).
+
+  Parameters:
+    *var            - The pointer on the TPS92662_PARAMS structure.
+    flag            - The request (SM_TPS92662_xxx).
+    device_index    - The index of the device or TPS92662_BROADCAST_INDEX.
+    *buffer         - The position of the frame in the transmit buffer.
+ 
+  Return:
+    The size of the frame.
+  *****************************************************************************/
+static uint8_t _build_frame(TPS92662_PARAMS *var, uint8_t flag, uint8_t device_index, uint8_t *buffer)
+{
+    const TPS92662_REQUEST *p_request = &tps92662_request[flag];
+    uint8_t size = 3;
+    uint16_t crc_calc;
+    
+    buffer[0] = tps92662_init_param[p_request->cde_type];
+    buffer[1] = (device_index == TPS92662_BROADCAST_INDEX) ? 0x80 : tps92662_device_id[var->p_device_id[device_index]];     // 0x80: Broadcast ID (ID5 = 0) with its parity bits
+    buffer[2] = p_request->address_register;
+    
+    if (p_request->p_fct_write != NULL)
+    {
+        (*p_request->p_fct_write)(var, (device_index == TPS92662_BROADCAST_INDEX) ? 0 : device_index, &buffer[3]);
+        size += tps92662_init_param_number_of_bytes[p_request->cde_type];
+    }
+    
+    crc_calc = fu_crc_16_ibm(buffer, size);
+    buffer[size++] = (crc_calc >> 0) & 0xff;
+    buffer[size++] = (crc_calc >> 8) & 0xff;
+    
+    return size;
+}
+
 /*******************************************************************************
   Function:
-    static uint8_t e_tps92662_request(TPS92662_PARAMS *var, TPS92662_INIT_PARAM cde_type, uint8_t device_index, uint8_t address_register, p_tps92662_function p_fct_read, p_tps92662_function p_fct_write)
+    static void _search_frames(TPS92662_PARAMS *var)
 
   Description:
-    This routine is used by the driver to send and read data over the UART module thanks to 
-    both DMA modules (one for transmission and one for reception).
-    It calls routines above to transfer and receive data in the good order.
+    This routine is used by the driver to build the next transfer from the pending flags 
+    (by priority order and then by device). The flags are cleared as soon as the frames are 
+    in the transmit buffer (a new request of the user during the transfer is not lost).
+    - A read request is sent alone (the TPS92662 answers after the frame).
+    - Up to TPS92662_MAX_FRAMES_PER_TRANSFER write requests are sent back-to-back.
+    - A write request pending on all the devices with the same data is sent once in a 
+      broadcast frame (all the TPS92662 of the UART line should be in the TPS92662_DEF).
+
+  Parameters:
+    *var            - The pointer on the TPS92662_PARAMS structure.
+  *****************************************************************************/
+static void _search_frames(TPS92662_PARAMS *var)
+{
+    uint8_t flag, device_index, number_of_devices;
+    uint8_t data_1[32], data_2[32];
+    
+    var->number_of_frames = 0;
+    var->transfer_size = 0;
+    
+    for (flag = SM_TPS92662_READ_IC_IDENTIFIER ; flag < SM_TPS92662_MAX_FLAGS ; flag++)
+    {
+        const TPS92662_REQUEST *p_request = &tps92662_request[flag];
+        
+        for (number_of_devices = 0, device_index = 0 ; device_index < var->number_of_device ; device_index++)
+        {
+            number_of_devices += (var->p_flags[device_index] >> flag) & 0x01;
+        }
+        
+        if (number_of_devices == 0)
+        {
+            continue;
+        }
+        
+        if (p_request->p_fct_read != NULL)
+        {
+            if (var->number_of_frames == 0)
+            {
+                for (device_index = 0 ; !((var->p_flags[device_index] >> flag) & 0x01) ; device_index++);
+                var->transfer_size = _build_frame(var, flag, device_index, var->p_transfer);
+                var->frames[0].flag = flag;
+                var->frames[0].device_index = device_index;
+                var->number_of_frames = 1;
+                CLR_BIT(var->p_flags[device_index], flag);
+            }
+            return;
+        }
+        
+        if ((number_of_devices == var->number_of_device) && (number_of_devices > 1))
+        {
+            (*p_request->p_fct_write)(var, 0, data_1);
+            for (device_index = 1 ; device_index < var->number_of_device ; device_index++)
+            {
+                (*p_request->p_fct_write)(var, device_index, data_2);
+                if (memcmp(data_1, data_2, tps92662_init_param_number_of_bytes[p_request->cde_type]))
+                {
+                    break;
+                }
+            }
+            
+            if (device_index >= var->number_of_device)
+            {
+                var->transfer_size += _build_frame(var, flag, TPS92662_BROADCAST_INDEX, &var->p_transfer[var->transfer_size]);
+                var->frames[var->number_of_frames].flag = flag;
+                var->frames[var->number_of_frames].device_index = TPS92662_BROADCAST_INDEX;
+                var->number_of_frames++;
+                for (device_index = 0 ; device_index < var->number_of_device ; device_index++)
+                {
+                    CLR_BIT(var->p_flags[device_index], flag);
+                }
+                number_of_devices = 0;
+            }
+        }
+        
+        for (device_index = 0 ; (device_index < var->number_of_device) && (number_of_devices > 0) ; device_index++)
+        {
+            if ((var->p_flags[device_index] >> flag) & 0x01)
+            {
+                if (var->number_of_frames >= TPS92662_MAX_FRAMES_PER_TRANSFER)
+                {
+                    return;
+                }
+                var->transfer_size += _build_frame(var, flag, device_index, &var->p_transfer[var->transfer_size]);
+                var->frames[var->number_of_frames].flag = flag;
+                var->frames[var->number_of_frames].device_index = device_index;
+                var->number_of_frames++;
+                CLR_BIT(var->p_flags[device_index], flag);
+            }
+        }
+        
+        if (var->number_of_frames >= TPS92662_MAX_FRAMES_PER_TRANSFER)
+        {
+            return;
+        }
+    }
+}
+
+/*******************************************************************************
+  Function:
+    static void _transfer_done(TPS92662_PARAMS *var)
+
+  Description:
+    This routine is used by the driver to update the statistics (frames per second and
+    refresh time of the devices) when a transfer is validated.
+
+  Parameters:
+    *var            - The pointer on the TPS92662_PARAMS structure.
+  *****************************************************************************/
+static void _transfer_done(TPS92662_PARAMS *var)
+{
+    uint64_t tick = mGetTick();
+    uint8_t i, device_index;
+    
+    var->frame_counter += var->number_of_frames;
+    
+    for (i = 0 ; i < var->number_of_frames ; i++)
+    {
+        if ((var->frames[i].flag == SM_TPS92662_WRITE_PHASE_AND_WIDTH) || (var->frames[i].flag == SM_TPS92662_WRITE_PHASE) || (var->frames[i].flag == SM_TPS92662_WRITE_WIDTH))
+        {
+            for (device_index = 0 ; device_index < var->number_of_device ; device_index++)
+            {
+                if ((var->frames[i].device_index == device_index) || (var->frames[i].device_index == TPS92662_BROADCAST_INDEX))
+                {
+                    var->p_refresh_time[device_index] = (uint32_t) (tick - var->p_refresh_tick[device_index]);
+                    var->p_refresh_tick[device_index] = tick;
+                }
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+  Function:
+    static uint8_t e_tps92662_request(TPS92662_PARAMS *var)
+
+  Description:
+    This routine is used by the driver to send the frames of the transmit buffer (see 
+    _search_frames()) and read data over the UART module thanks to both DMA modules 
+    (one for transmission and one for reception).
     The driver is ONLY compatible with a CAN communication without acknowledgment. It means that
     when a data is transmitted on a UART Tx pin, there is a loop back with the CAN transceiver. 
     So when a data is transmitted, this same data should be read back on the UART Rx pin (it is 
-    available on both write and read request).
-    The read operation has a protection for incorrect CRC and no response from TPS92662. If a timeout
-    occurs or the CRC is incorrect then a new transmission is requested. If there is more than 10 
-    fails in a row then we send a break character in order to restart the UART communication. The
-    state machine can be lock in this loop if the TPS92662 does not answer.
+    available on both write and read request). The write frames are sent back-to-back in one 
+    transfer and their echo is compared with the transmit buffer once the whole transfer is received.
+    The transfer has a protection for incorrect echo, incorrect CRC and no response from TPS92662. 
+    If a timeout occurs, the echo or the CRC is incorrect then the same frames are transmitted again. 
+    If there is more than 10 fails in a row then we send a break character in order to restart the 
+    UART communication. The state machine can be lock in this loop if the TPS92662 does not answer.
 
   Parameters:
     *var                - The pointer on the TPS92662_PARAMS structure.
-    cde_type            - The type of requested command. See TPS92662_INIT_PARAM for more details.
-    device_index        - The device you want to select. It is not the direct address of the device
-                        but the index of this address (for example, if you create a TPS92662_DEF
-                        with 3 addresses @1, @2 and @3 then @1 = index 0, @2 = index 1 and @3 = index 2.
-    address_register    - The start address register to read or write data.
-    p_fct_read          - The pointer of the function you want to read. NULL if not used.
-    p_fct_write         - The pointer of the function you want to write. NULL if not used.
  
   Return:
     This routine returns its status (index of its state machine)
     0: Done / Finished
     > 0: On going
   *****************************************************************************/
-static uint8_t e_tps92662_request(TPS92662_PARAMS *var, TPS92662_INIT_PARAM cde_type, uint8_t device_index, uint8_t address_register, p_tps92662_function p_fct_read, p_tps92662_function p_fct_write)
+static uint8_t e_tps92662_request(TPS92662_PARAMS *var)
 {
+    const TPS92662_REQUEST *p_request = &tps92662_request[var->frames[0].flag];
+    uint8_t number_of_bytes = tps92662_init_param_number_of_bytes[p_request->cde_type];
     uint16_t crc_calc, crc_uart;
     
     switch (var->state_machine_for_read_write_request.index)
@@ -516,32 +710,12 @@ static uint8_t e_tps92662_request(TPS92662_PARAMS *var, TPS92662_INIT_PARAM cde_
             
         case 2:
             
-            var->p_transfer[0] = tps92662_init_param[cde_type];
-            var->p_transfer[1] = tps92662_device_id[var->p_device_id[device_index]];
-            var->p_transfer[2] = address_register;     
-            
-            if (p_fct_write != NULL)
-            {
-                (*p_fct_write)(var, device_index, &var->p_transfer[3]);
-                
-                crc_calc = fu_crc_16_ibm(var->p_transfer, 3 + tps92662_init_param_number_of_bytes[cde_type]);
-                var->p_transfer[3 + tps92662_init_param_number_of_bytes[cde_type]] = (crc_calc >> 0) & 0xff;
-                var->p_transfer[4 + tps92662_init_param_number_of_bytes[cde_type]] = (crc_calc >> 8) & 0xff;
-                
-                var->dma_tx_params.src_size = (3 + tps92662_init_param_number_of_bytes[cde_type] + 2);
-                var->dma_rx_params.dst_size = var->dma_tx_params.src_size;
-            }
-            else
-            {
-                crc_calc = fu_crc_16_ibm(var->p_transfer, 3);
-                var->p_transfer[3] = (crc_calc >> 0) & 0xff;
-                var->p_transfer[4] = (crc_calc >> 8) & 0xff;
-                
-                var->dma_tx_params.src_size = 3 + 2;
-                var->dma_rx_params.dst_size = (3 + 2 + tps92662_init_param_number_of_bytes[cde_type] + 2);
-            }
+            var->dma_tx_params.src_size = var->transfer_size;
+            var->dma_rx_params.dst_size = var->transfer_size + ((p_request->p_fct_read != NULL) ? (number_of_bytes + 2) : 0);
+            var->transfer_timeout = TICK_10MS + (uint32_t) ((uint64_t) var->dma_rx_params.dst_size * 10 * TICK_1S / var->uart_baudrate);
             
             dma_abord_transfer(var->dma_rx_id);       
+            dma_clear_flags(var->dma_rx_id, DMA_FLAG_BLOCK_TRANSFER_DONE); 
             dma_set_transfer_params(var->dma_rx_id, &var->dma_rx_params);       
             dma_set_transfer_params(var->dma_tx_id, &var->dma_tx_params);       
             dma_channel_enable(var->dma_rx_id, ON, false);  // Do not force the transfer (it occurs automatically when data is received - UART Rx generates the transfer)
@@ -554,24 +728,40 @@ static uint8_t e_tps92662_request(TPS92662_PARAMS *var, TPS92662_INIT_PARAM cde_
             
             if ((dma_get_flags(var->dma_rx_id) & DMA_FLAG_BLOCK_TRANSFER_DONE) > 0)
             {
-                if (p_fct_read != NULL)
+                dma_clear_flags(var->dma_rx_id, DMA_FLAG_BLOCK_TRANSFER_DONE); 
+                
+                if (!memcmp(var->p_receip, var->p_transfer, var->transfer_size))
                 {
-                    crc_calc = fu_crc_16_ibm(&var->p_receip[5], tps92662_init_param_number_of_bytes[cde_type]);
-                    crc_uart = (var->p_receip[5 + tps92662_init_param_number_of_bytes[cde_type]] << 0) + (var->p_receip[5 + tps92662_init_param_number_of_bytes[cde_type] + 1] << 8);
-                    if (crc_calc == crc_uart)
+                    if (p_request->p_fct_read != NULL)
+                    {
+                        crc_calc = fu_crc_16_ibm(&var->p_receip[var->transfer_size], number_of_bytes);
+                        crc_uart = (var->p_receip[var->transfer_size + number_of_bytes] << 0) + (var->p_receip[var->transfer_size + number_of_bytes + 1] << 8);
+                        if (crc_calc == crc_uart)
+                        {
+                            (*p_request->p_fct_read)(var, var->frames[0].device_index, &var->p_receip[var->transfer_size]);
+                            var->state_machine_for_read_write_request.index = 0;   // End
+                        }
+                    }
+                    else
                     {
-                        (*p_fct_read)(var, device_index, &var->p_receip[5]);
                         var->state_machine_for_read_write_request.index = 0;   // End
-                        var->number_of_read_fail = 0;
                     }
                 }
-                var->state_machine_for_read_write_request.index = 0;   // End
-                dma_clear_flags(var->dma_rx_id, DMA_FLAG_BLOCK_TRANSFER_DONE); 
+                
+                if (var->state_machine_for_read_write_request.index == 0)
+                {
+                    var->number_of_read_fail = 0;
+                    _transfer_done(var);
+                }
+                else
+                {
+                    var->state_machine_for_read_write_request.index = 1;   // Fail: incorrect echo or incorrect CRC. Retry.
+                    var->number_of_read_fail++;
+                }
             }
-                        
-            if (mTickCompare(var->state_machine_for_read_write_request.tick) >= TICK_10MS)
+            else if (mTickCompare(var->state_machine_for_read_write_request.tick) >= var->transfer_timeout)
             {
-                var->state_machine_for_read_write_request.index = 1;   // Fail: nothing has been received or incorrect CRC. Retry.
+                var->state_machine_for_read_write_request.index = 1;   // Fail: nothing has been received. Retry.
                 var->number_of_read_fail++;
             }
             break;
@@ -613,7 +803,7 @@ static uint8_t e_tps92662_request(TPS92662_PARAMS *var, TPS92662_INIT_PARAM cde_
   *****************************************************************************/
 uint8_t e_tps92662_deamon(TPS92662_PARAMS *var)
 {
-    uint8_t ret, i, device_index;
+    uint8_t ret, device_index;
     
     if (!var->is_init_done)
     {
@@ -686,164 +876,29 @@ uint8_t e_tps92662_deamon(TPS92662_PARAMS *var)
     }
     else
     {     
+        if (mTickCompare(var->tick_frames) >= TICK_1S)
+        {
+            var->frames_per_second = var->frame_counter;
+            var->frame_counter = 0;
+            mUpdateTick(var->tick_frames);
+        }
+        
         switch (var->state_machine.index)
         {
             case SM_TPS92662_HOME:
             case SM_TPS92662_SEARCH:
                    
-                for (i = 1 ; i <= SM_TPS92662_MAX_FLAGS ; i++)
-                {
-                    for (device_index = 0 ; device_index < var->number_of_device ; device_index++)
-                    {
-                        if ((var->p_flags[device_index] >> i) & 0x01)
-                        {
-                            var->selected_device_index = device_index;
-                            var->state_machine.index = i;
-                            goto out_of_nested_loop;
-                        }
-                    }
-                }
-                var->state_machine.index = SM_TPS92662_HOME;
-                out_of_nested_loop:
-                break;
-                
-            case SM_TPS92662_READ_IC_IDENTIFIER:
-                
-                if (!e_tps92662_request(var, TPS_READ_1B, var->selected_device_index, TPS92662_ADDR_IC_IDENTIFIER, _get_ic_identifier, NULL))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_READ_ERRORS:
-                
-                if (!e_tps92662_request(var, TPS_READ_3B, var->selected_device_index, TPS92662_ADDR_ERRORS, _get_errors, NULL))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_READ_ADCS:
-                
-                if (!e_tps92662_request(var, TPS_READ_2B, var->selected_device_index, TPS92662_ADDR_ADC, _get_adc, NULL))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_SYSTEM_CONFIG:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_1B, var->selected_device_index, TPS92662_ADDR_SYSTEM_CONFIG, NULL, _set_system_config))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
+                _search_frames(var);
+                var->state_machine.index = (var->number_of_frames > 0) ? var->frames[0].flag : SM_TPS92662_HOME;
                 break;
                 
-            case SM_TPS92662_WRITE_SLEW_RATE:
+            default:    // SM_TPS92662_READ_IC_IDENTIFIER ... SM_TPS92662_WRITE_WIDTH (request of the first frame of the transfer)
                 
-                if (!e_tps92662_request(var, TPS_WRITE_1B, var->selected_device_index, TPS92662_ADDR_SLEW_RATE, NULL, _set_slew_rate))
+                if (!e_tps92662_request(var))
                 {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
                     var->state_machine.index = SM_TPS92662_SEARCH;
                 }
                 break;
-                
-            case SM_TPS92662_WRITE_OVER_VOLTAGE_LIMIT:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_1B, var->selected_device_index, TPS92662_ADDR_OVER_VOLTAGE_LIMIT, NULL, _set_overvoltage_limit))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_PARALLEL_LED_STRING:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_1B, var->selected_device_index, TPS92662_ADDR_PARALLEL_LED_STRING, NULL, _set_parallel_led_string))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_DEFAULT_PULSE_WIDTH:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_12B, var->selected_device_index, TPS92662_ADDR_DEFAULT_PULSE_WIDTH, NULL, _set_default_pulse_width))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_WATCHDOG_TIMER:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_1B, var->selected_device_index, TPS92662_ADDR_WATCHDOG_TIMER, NULL, _set_watchdog_timer))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_PWM_TICK_PERIOD:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_1B, var->selected_device_index, TPS92662_ADDR_PWM_TICK_PERIOD, NULL, _set_pwm_tick_period))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_ADC_ID:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_1B, var->selected_device_index, TPS92662_ADDR_ADC_ID, NULL, _set_adc_id))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_SOFTSYNC:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_1B, var->selected_device_index, TPS92662_ADDR_SOFTSYNC, NULL, _set_softsync))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_PHASE_AND_WIDTH:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_32B, var->selected_device_index, TPS92662_ADDR_PHASE, NULL, _set_phase_and_width))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_PHASE:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_16B, var->selected_device_index, TPS92662_ADDR_PHASE, NULL, _set_phase))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            case SM_TPS92662_WRITE_WIDTH:
-                
-                if (!e_tps92662_request(var, TPS_WRITE_16B, var->selected_device_index, TPS92662_ADDR_WIDTH, NULL, _set_width))
-                {
-                    CLR_BIT(var->p_flags[var->selected_device_index], var->state_machine.index);
-                    var->state_machine.index = SM_TPS92662_SEARCH;
-                }
-                break;
-                
-            default:
-                break;
         }
         ret = var->state_machine.index;
     }
@@ -4,6 +4,10 @@
 #define TPS92662_MAX_TX_SIZE    (1 + 1 + 1 + 32 + 2)
 #define TPS92662_MAX_RX_SIZE    (1 + 1 + 1 + 2 + 32 + 2)   // In the receip line we found the TX data and then the RX data
 
+#define TPS92662_MAX_FRAMES_PER_TRANSFER    8                                                           // Write frames sent back-to-back in one DMA transfer
+#define TPS92662_MAX_TRANSFER_SIZE          (TPS92662_MAX_TX_SIZE * TPS92662_MAX_FRAMES_PER_TRANSFER)   // Greater than TPS92662_MAX_RX_SIZE (the echo of a transfer is received in the same buffer)
+#define TPS92662_BROADCAST_INDEX            0xff                                                        // Device index of a broadcast frame (written by all the devices of the bus)
+
 typedef enum
 {
     SM_TPS92662_HOME = 0,
@@ -288,6 +292,12 @@ typedef struct
     uint8_t                 ic_identification;          // Read Only [0xff / 10010010]
 } TPS92662_REGS;
 
+typedef struct
+{
+    uint8_t                 flag;                       // SM_TPS92662_xxx request
+    uint8_t                 device_index;               // TPS92662_BROADCAST_INDEX for a broadcast write
+} TPS92662_FRAME;
+
 // NOTE: On ONE UART line we can have only ONE EXTERNAL DEVICE type. So no need to use a BUS MANAGEMENT. 
 typedef struct
 {
@@ -308,12 +318,21 @@ typedef struct
     
     uint32_t                *p_flags;
     uint8_t                 number_of_read_fail;
-    uint8_t                 selected_device_index;
+    TPS92662_FRAME          frames[TPS92662_MAX_FRAMES_PER_TRANSFER];  // Frames of the current transfer (only one frame for a read request)
+    uint8_t                 number_of_frames;
+    uint16_t                transfer_size;
+    uint32_t                transfer_timeout;
     state_machine_t         state_machine_for_read_write_request;
     state_machine_t         state_machine;
+    
+    uint32_t                frames_per_second;          // Number of frames validated during the last second
+    uint32_t                frame_counter;
+    uint64_t                tick_frames;
+    uint64_t                *p_refresh_tick;            // Tick of the last phases/widths update of each device
+    uint32_t                *p_refresh_time;            // Time (ticks) between the two last phases/widths updates of each device
 } TPS92662_PARAMS;
 
-#define TPS92662_INSTANCE(_uart_id, _io_port, _io_indice, _baudrate, _number_of_device, _p_transfer, _p_receip, _p_device_id, _p_registers, _p_flags) \
+#define TPS92662_INSTANCE(_uart_id, _io_port, _io_indice, _baudrate, _number_of_device, _p_transfer, _p_receip, _p_device_id, _p_registers, _p_flags, _p_refresh_tick, _p_refresh_time) \
 {                                                                           \
     .is_init_done = 0,                                                      \
     .uart_id = _uart_id,                                                    \
@@ -330,23 +349,44 @@ typedef struct
     .p_receip = _p_receip,                                                  \
     .p_flags = _p_flags,                                                    \
     .number_of_read_fail = 0,                                               \
-    .selected_device_index = 0,                                             \
+    .frames = {{0}},                                                        \
+    .number_of_frames = 0,                                                  \
+    .transfer_size = 0,                                                     \
+    .transfer_timeout = 0,                                                  \
     .state_machine_for_read_write_request = {0},                            \
-    .state_machine = {0}                                                    \
+    .state_machine = {0},                                                   \
+    .frames_per_second = 0,                                                 \
+    .frame_counter = 0,                                                     \
+    .tick_frames = 0,                                                       \
+    .p_refresh_tick = _p_refresh_tick,                                      \
+    .p_refresh_time = _p_refresh_time                                       \
 }
 
 #define TPS92662_DEF(_name, _uart_id, _chip_enable_pin, _baudrate, ...)        \
 static uint8_t _name ## _device_id_ram_allocation[COUNT_ARGUMENTS( __VA_ARGS__ )] = { __VA_ARGS__ };        \
 static TPS92662_REGS _name ## _registers_ram_allocation[COUNT_ARGUMENTS( __VA_ARGS__ )] = {0};              \
-static uint8_t _name ## _transfer_ram_allocation[TPS92662_MAX_TX_SIZE] = {0};                               \
-static uint8_t _name ## _receip_ram_allocation[TPS92662_MAX_RX_SIZE] = {0};                                 \
+static uint8_t _name ## _transfer_ram_allocation[TPS92662_MAX_TRANSFER_SIZE] = {0};                         \
+static uint8_t _name ## _receip_ram_allocation[TPS92662_MAX_TRANSFER_SIZE] = {0};                           \
 static uint32_t _name ## _flags[COUNT_ARGUMENTS( __VA_ARGS__ )] = {0};                                      \
-static TPS92662_PARAMS _name = TPS92662_INSTANCE(_uart_id, __PORT(_chip_enable_pin), __INDICE(_chip_enable_pin), _baudrate, COUNT_ARGUMENTS( __VA_ARGS__ ), _name ## _transfer_ram_allocation, _name ## _receip_ram_allocation, _name ## _device_id_ram_allocation, _name ## _registers_ram_allocation, _name ## _flags)
+static uint64_t _name ## _refresh_tick[COUNT_ARGUMENTS( __VA_ARGS__ )] = {0};                               \
+static uint32_t _name ## _refresh_time[COUNT_ARGUMENTS( __VA_ARGS__ )] = {0};                               \
+static TPS92662_PARAMS _name = TPS92662_INSTANCE(_uart_id, __PORT(_chip_enable_pin), __INDICE(_chip_enable_pin), _baudrate, COUNT_ARGUMENTS( __VA_ARGS__ ), _name ## _transfer_ram_allocation, _name ## _receip_ram_allocation, _name ## _device_id_ram_allocation, _name ## _registers_ram_allocation, _name ## _flags, _name ## _refresh_tick, _name ## _refresh_time)
 
 typedef void (*p_tps92662_function)(TPS92662_PARAMS *var, uint8_t device_index, uint8_t *buffer);
 
+typedef struct
+{
+    TPS92662_INIT_PARAM     cde_type;
+    uint8_t                 address_register;
+    p_tps92662_function     p_fct_read;                 // NULL for a write request
+    p_tps92662_function     p_fct_write;                // NULL for a read request
+} TPS92662_REQUEST;
+
 uint8_t e_tps92662_deamon(TPS92662_PARAMS *var);
 
+#define e_tps92662_get_frames_per_second(var)                                           (var.frames_per_second)
+#define e_tps92662_get_refresh_time(var, _id_device)                                    (var.p_refresh_time[_id_device])
+
 // Defines VARIABLE version
 #define e_tps92662_get_ic_identifier(var, _id_device)                                   (SET_BIT(var.p_flags[_id_device], SM_TPS92662_READ_IC_IDENTIFIER))
 #define e_tps92662_get_errors(var, _id_device)                                          (SET_BIT(var.p_flags[_id_device], SM_TPS92662_READ_ERRORS))
@@ -3,6 +3,12 @@
 
 #define FAT32_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN            0x0ffffff8
 #define FAT16_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN            0xfff8
+#define FAT32_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN_MARK       0x0fffffff  // Value written in the FAT table for the last cluster of a chain
+#define FAT16_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN_MARK       0xffff
+#define FAT32_FILE_SYSTEM_FAT_TABLE_CLUSTER_MASK            0x0fffffff  // The 4 upper bits of a FAT32 entry are reserved (they must be preserved when the entry is modified)
+#define FAT_FILE_SYSTEM_FAT_TABLE_FREE_CLUSTER              0x00000000
+
+#define FAT_FILE_SYSTEM_MAXIMUM_EXTENTS                     8           // Number of fragments (runs of contiguous clusters) of a file kept in cache
 
 typedef enum
 {
@@ -29,6 +35,21 @@ typedef enum
     FAT_FILE_SYSTEM_FLAG_READ_BLOCK_OP_READ_TERMINATED  = 3
 } FAT_FILE_SYSTEM_FLAGS_READ_OP;
 
+typedef enum
+{
+    FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_REQUESTED     = 1,
+    FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_ON_GOING      = 2,
+    FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_TERMINATED    = 3,
+    FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_FAILED        = 4
+} FAT_FILE_SYSTEM_FLAGS_WRITE_OP;
+
+typedef enum
+{
+    FAT_FILE_SYSTEM_WRITE_OP_APPEND                     = 0,            // Data are added at the end of the file (the file is created in the root directory if it is not found)
+    FAT_FILE_SYSTEM_WRITE_OP_SYNC,                                      // The partially filled sector, the directory entry and the FAT table are written on the SD Card
+    FAT_FILE_SYSTEM_WRITE_OP_CLOSE                                      // Same as SYNC + the pre-allocated clusters not used are released
+} FAT_FILE_SYSTEM_WRITE_OP_TYPE;
+
 typedef union
 {
     struct 
@@ -83,6 +104,7 @@ typedef union
         FAT_FILE_SYSTEM_FLAGS_READ_OP   is_read_block_op;               // 0: not used, 1: read_block_requested, 2: read_block_on_going, 3: read_block_terminated
         bool                            is_read_file_stopped;           // 0: play / continue, 1: stop / pause
         bool                            is_read_file_terminated;        // 0: no, 1: yes
+        FAT_FILE_SYSTEM_FLAGS_WRITE_OP  is_write_block_op;              // 0: not used, 1: write_block_requested, 2: write_block_on_going, 3: write_block_terminated, 4: write_block_failed
         unsigned                        :3;
     };
     struct
@@ -91,6 +113,13 @@ typedef union
     };
 } fat_file_system_flags_t;
 
+typedef struct
+{
+    uint32_t                            first_jump_index;               // Index (in the cluster chain of the file) of the first cluster of the extent
+    uint32_t                            first_cluster;
+    uint32_t                            number_of_clusters;             // The extent is [first_cluster .. first_cluster + number_of_clusters - 1]
+} fat_file_system_extent_t;
+
 typedef struct
 {
     char                                file_name[255];                 // File name and extension (example "My Folder\\my_file.extension")
@@ -112,6 +141,17 @@ typedef struct
     uint32_t                            _current_data_sector;           // The current sector where the data is stored when using sd_card_read_file_data(...) routine. 
     uint16_t                            _index_data_in_sector;          // Value between [0..511] when using sd_card_read_file_data(...) routine. 
     
+    fat_file_system_extent_t            _extents[FAT_FILE_SYSTEM_MAXIMUM_EXTENTS];     // Cluster chain of the file already walked (sorted by first_jump_index) - any address in it is reached without reading the FAT table. 
+    uint8_t                             _number_of_extents;
+    
+    state_machine_t                     sm_write;
+    FAT_FILE_SYSTEM_WRITE_OP_TYPE       _write_op;
+    uint8_t                             *_p_write_data;
+    uint32_t                            _write_length;
+    uint32_t                            _number_of_clusters;            // Number of clusters linked to the file (including the pre-allocated clusters not yet used).
+    uint32_t                            _directory_entry_sector;        // Sector where the 32 bytes entry of the file is localized (used to update the file size and the first cluster).
+    uint8_t                             _directory_entry_index;         // Value between [0..15]
+    
     void                                *p_sd_card;
     
 } fat_file_system_entry_t;
@@ -134,6 +174,15 @@ typedef struct
     ._current_fat_sector = 0,                                               \
     ._current_data_sector = 0,                                              \
     ._index_data_in_sector = 0,                                             \
+    ._extents = {{0}},                                                      \
+    ._number_of_extents = 0,                                                \
+    .sm_write = {0},                                                        \
+    ._write_op = FAT_FILE_SYSTEM_WRITE_OP_APPEND,                           \
+    ._p_write_data = NULL,                                                  \
+    ._write_length = 0,                                                     \
+    ._number_of_clusters = 0,                                               \
+    ._directory_entry_sector = 0,                                           \
+    ._directory_entry_index = 0,                                            \
     .p_sd_card = (void*) &_p_sd_card                                        \
 }
 
@@ -287,6 +336,12 @@ typedef struct
 #define fat_file_system_get_first_sector_of_cluster_N(cluster_index)        ((uint32_t) (var->boot_sector.data_space_region_start + ((cluster_index) - 2) * var->boot_sector.number_of_sectors_per_cluster))
 #define fat_file_system_get_cluster_of_sector_N(sector)                     ((uint32_t) (2 + ((sector) - var->boot_sector.data_space_region_start) / var->boot_sector.number_of_sectors_per_cluster))
 #define fat_file_system_get_sector_index_in_cluster(sector)                 ((uint32_t) (((sector) - var->boot_sector.data_space_region_start) % var->boot_sector.number_of_sectors_per_cluster))
+#define fat_file_system_is_end_of_chain(cluster_value)                      ((cluster_value) >= ((var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? FAT32_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN : FAT16_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN))
+#define fat_file_system_get_cluster_length()                                ((uint32_t) (var->boot_sector.number_of_bytes_per_sector * var->boot_sector.number_of_sectors_per_cluster))
+// In which sector of the FAT table the cluster is localized ?
+//      FAT16: ((uint32_t) (fat_region_start + current_cluster_value * 2 / bytes_per_sector))   // Cluster is 16-bit length
+//      FAT32: ((uint32_t) (fat_region_start + current_cluster_value * 4 / bytes_per_sector))   // Cluster is 32-bit length
+#define fat_file_system_get_fat_sector_of_cluster_N(cluster_index)          ((uint32_t) (var->boot_sector.fat_region_start + (cluster_index) * ((var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? 4 : 2) / var->boot_sector.number_of_bytes_per_sector))
 
 #define sd_card_read_file_pause(file)                       (file.flags.is_read_file_stopped = 1)
 #define sd_card_read_file_play(file)                        (file.flags.is_read_file_stopped = 0)
@@ -79,6 +79,99 @@ static const uint32_t sk6812rgbw_ws2812b_mapping[] =
 };
 
 static pink_lady_manager_params_t pink_lady_manager_tab[SPI_NUMBER_OF_MODULES][PL_ID_MAX];
+static pink_lady_params_t *p_pink_lady_of_dma[DMA_NUMBER_OF_MODULES] = {NULL};
+
+// One table look-up and one word store per color. Returns the position of the next LED in the buffer.
+static uint32_t * _encode_leds(pink_lady_params_t *var, uint32_t *p_buffer, const rgbw_color_t *p_led, uint16_t number_of_leds)
+{
+    const uint32_t *p_mapping = var->p_led_model_mapping;
+    uint16_t i;
+    
+    if ((var->led_model & SK6812RGBW_INDICE_MASK) > 0)
+    {
+        for (i = 0 ; i < number_of_leds ; i++, p_led++)
+        {
+            *p_buffer++ = p_mapping[p_led->green];
+            *p_buffer++ = p_mapping[p_led->red];
+            *p_buffer++ = p_mapping[p_led->blue];
+            *p_buffer++ = p_mapping[p_led->white];
+        }
+    }
+    else    // SK6812RGB_MODEL & WS2812B_MODEL
+    {
+        for (i = 0 ; i < number_of_leds ; i++, p_led++)
+        {
+            *p_buffer++ = p_mapping[p_led->green];
+            *p_buffer++ = p_mapping[p_led->red];
+            *p_buffer++ = p_mapping[p_led->blue];
+        }
+    }
+    return p_buffer;
+}
+
+// The whole p_led array is converted in one pass so a frame never mixes two states of the LEDs.
+// A shift region is encoded from its offset: p_led[to - offset + 1..to] then p_led[from..to - offset]
+// (the regions should not overlap).
+static void _encode_frame(pink_lady_params_t *var, uint32_t *p_buffer)
+{
+    uint16_t ind = 0;
+    uint8_t i;
+    
+    while (ind < var->number_of_leds)
+    {
+        pink_lady_shift_params_t *p_next_shift = NULL;
+        
+        for (i = 0 ; i < PINK_LADY_MAXIMUM_SHIFT_REGIONS ; i++)
+        {
+            if ((var->p_shift[i] != NULL) && (var->p_shift[i]->offset > 0) && (var->p_shift[i]->from >= ind) && ((p_next_shift == NULL) || (var->p_shift[i]->from < p_next_shift->from)))
+            {
+                p_next_shift = var->p_shift[i];
+            }
+        }
+        
+        if (p_next_shift == NULL)
+        {
+            _encode_leds(var, p_buffer, &var->p_led[ind], var->number_of_leds - ind);
+            break;
+        }
+        
+        p_buffer = _encode_leds(var, p_buffer, &var->p_led[ind], p_next_shift->from - ind);
+        p_buffer = _encode_leds(var, p_buffer, &var->p_led[p_next_shift->to - p_next_shift->offset + 1], p_next_shift->offset);
+        p_buffer = _encode_leds(var, p_buffer, &var->p_led[p_next_shift->from], p_next_shift->to - p_next_shift->from + 1 - p_next_shift->offset);
+        ind = p_next_shift->to + 1;
+    }
+}
+
+// Must be called with the interrupts disabled (or from the DMA interrupt). 
+// The current frame (including the reset bytes) is sent: the next one is started from the front buffer 
+// which is swapped with the back buffer if a new frame has been encoded.
+static void _frame_transfer_done(pink_lady_params_t *var)
+{
+    if (!dma_channel_is_enable(var->dma_id))
+    {
+        dma_clear_flags(var->dma_id, DMA_FLAG_BLOCK_TRANSFER_DONE);
+        if (var->is_back_buffer_ready)
+        {
+            var->buffer_front ^= 1;
+            var->is_back_buffer_ready = false;
+        }
+        var->dma_params.src_start_addr = var->p_buffer[var->buffer_front];
+        dma_set_transfer_params(var->dma_id, &var->dma_params);
+        dma_channel_enable(var->dma_id, ON, false);
+    }
+}
+
+static void _pink_lady_dma_event_handler(uint8_t id, DMA_CHANNEL_FLAGS flags)
+{
+    if ((p_pink_lady_of_dma[id] != NULL) && ((flags & DMA_FLAG_BLOCK_TRANSFER_DONE) > 0))
+    {
+        _frame_transfer_done(p_pink_lady_of_dma[id]);
+    }
+    else
+    {
+        dma_clear_flags(id, flags);
+    }
+}
 
 /*******************************************************************************
  * Function: 
@@ -111,6 +204,7 @@ void pink_lady_deamon(pink_lady_params_t *var)
         
         
         var->dma_id = dma_get_free_channel();
+        p_pink_lady_of_dma[var->dma_id] = var;
         
         spi_init(   var->spi_id, 
                     NULL, 
@@ -119,9 +213,9 @@ void pink_lady_deamon(pink_lady_params_t *var)
                     SPI_STD_MASTER_CONFIG);
         
         dma_init(   var->dma_id, 
-                    NULL, 
-                    DMA_CONT_PRIO_3 | DMA_CONT_AUTO_ENABLE, 
-                    DMA_INT_NONE, 
+                    _pink_lady_dma_event_handler, 
+                    DMA_CONT_PRIO_3, 
+                    DMA_INT_BLOCK_TRANSFER_DONE, 
                     DMA_EVT_START_TRANSFER_ON_IRQ, 
                     spi_get_tx_irq(var->spi_id), 
                     0xff);
@@ -129,35 +223,122 @@ void pink_lady_deamon(pink_lady_params_t *var)
         var->p_led_model_mapping = (uint32_t *)sk6812rgbw_ws2812b_mapping;
         var->dma_params.dst_start_addr = (void *) spi_get_tx_reg(var->spi_id);       
         dma_set_transfer_params(var->dma_id, &var->dma_params);     // The DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).
-                                                                    // Because the DMA channel is configured in "AUTO_ENABLE" then there is no need to re-call "dma_channel_enable()" to re-execute a DMA transfer (the channel is automatically put "ENABLE" at the end of a transmission)
+                                                                    // The channel is re-enabled by the Block Transfer Done interrupt at the end of each frame (with the front buffer - see _frame_transfer_done()).
         dma_channel_enable(var->dma_id, ON, false);
         var->is_init_done = true;
     }
     else
     {      
-        if ((var->led_model & SK6812RGBW_INDICE_MASK) > 0)
+        uint32_t int_status = __builtin_disable_interrupts();
+        _frame_transfer_done(var);       // In case the interrupt is not mapped on the DMA vector.
+        if (int_status & 0x00000001)
+        {
+            __builtin_enable_interrupts();
+        }
+        
+        // The back buffer is encoded again as soon as the previous frame is swapped (the front buffer is never modified while it is sent).
+        if (!var->is_back_buffer_ready)
+        {
+            _encode_frame(var, var->p_buffer[var->buffer_front ^ 1]);
+            var->is_back_buffer_ready = true;
+        }
+    }
+}
+
+// The value of the first LED is computed once: the next values only need additions (quotient and remainder of delta / N).
+static void _gradient_init(pink_lady_gradient_params_t *p_gradient, uint8_t color1, uint8_t color2, uint16_t number_of_led)
+{
+    uint8_t lowest_value = (color1 <= color2) ? color1 : color2;
+    uint8_t delta = (color1 <= color2) ? (color2 - color1) : (color1 - color2);
+    uint32_t i_x_delta = (color1 <= color2) ? 0 : ((uint32_t) (number_of_led - 1) * delta);     // The first LED is the lowest value (i = 0) or the highest value (i = N - 1)
+    
+    p_gradient->is_rising = (color1 <= color2);
+    p_gradient->quotient = (uint8_t) (delta / number_of_led);
+    p_gradient->remainder = (uint16_t) (delta % number_of_led);
+    p_gradient->value = (uint8_t) (lowest_value + i_x_delta / number_of_led);
+    p_gradient->error = (uint16_t) (i_x_delta % number_of_led);
+}
+
+static inline uint8_t _gradient_next(pink_lady_gradient_params_t *p_gradient, uint16_t number_of_led)
+{
+    uint8_t value = p_gradient->value;
+    
+    if (p_gradient->is_rising)
+    {
+        p_gradient->value += p_gradient->quotient;
+        p_gradient->error += p_gradient->remainder;
+        if (p_gradient->error >= number_of_led)
+        {
+            p_gradient->error -= number_of_led;
+            p_gradient->value++;
+        }
+    }
+    else
+    {
+        p_gradient->value -= p_gradient->quotient;
+        if (p_gradient->error < p_gradient->remainder)
         {
-            var->p_buffer[0 + 4*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].green];
-            var->p_buffer[1 + 4*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].red];
-            var->p_buffer[2 + 4*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].blue];
-            var->p_buffer[3 + 4*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].white];
+            p_gradient->error += number_of_led - p_gradient->remainder;
+            p_gradient->value--;
         }
-        else if ((var->led_model & SK6812RGB_INDICE_MASK) > 0)
+        else
         {
-            var->p_buffer[0 + 3*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].green];
-            var->p_buffer[1 + 3*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].red];
-            var->p_buffer[2 + 3*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].blue];
+            p_gradient->error -= p_gradient->remainder;
         }
-        else if ((var->led_model & WS2812B_INDICE_MASK) > 0)
+    }
+    return value;
+}
+
+static inline uint8_t _fade(uint8_t copy, uint8_t value, uint8_t intensity)
+{
+    return (value >= copy) ? (uint8_t) (copy + (uint16_t) (value - copy) * intensity / 100) : (uint8_t) (copy - (uint16_t) (copy - value) * intensity / 100);
+}
+
+// The whole segment is updated in one pass (LED.x = f(i) with f given below) for the current intensity.
+static void _segment_update(pink_lady_manager_params_t *p_manager, uint16_t from, uint16_t to, PINK_LADY_RESOLUTIONS resolution, bool is_fading)
+{
+    pink_lady_gradient_params_t red = p_manager->red;
+    pink_lady_gradient_params_t green = p_manager->green;
+    pink_lady_gradient_params_t blue = p_manager->blue;
+    pink_lady_gradient_params_t white = p_manager->white;
+    rgbw_color_t *p_led = &p_manager->p_led[from];
+    rgbw_color_t *p_led_copy = &p_manager->p_led_copy[from];
+    uint16_t number_of_led = p_manager->number_of_led;
+    uint8_t step = (uint8_t) (resolution & LED_RESO_1_255);
+    uint8_t phase = (uint8_t) (from % step);
+    uint16_t i;
+    
+    for (i = from ; i <= to ; i++, p_led++, p_led_copy++)
+    {
+        rgbw_color_t color;
+        
+        color.red = _gradient_next(&red, number_of_led);
+        color.green = _gradient_next(&green, number_of_led);
+        color.blue = _gradient_next(&blue, number_of_led);
+        color.white = _gradient_next(&white, number_of_led);
+        
+        if (phase > 0)
+        {
+            if (!(resolution & LED_RESO_JUMP))
+            {
+                *p_led = RGBW_COLOR_OFF;
+            }
+        }
+        else if (is_fading)
+        {
+            p_led->red = _fade(p_led_copy->red, color.red, p_manager->intensity);
+            p_led->green = _fade(p_led_copy->green, color.green, p_manager->intensity);
+            p_led->blue = _fade(p_led_copy->blue, color.blue, p_manager->intensity);
+            p_led->white = _fade(p_led_copy->white, color.white, p_manager->intensity);
+        }
+        else
         {
-            var->p_buffer[0 + 3*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].green];
-            var->p_buffer[1 + 3*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].red];
-            var->p_buffer[2 + 3*var->ind_update_tx_buffer] = var->p_led_model_mapping[var->p_led[var->ind_update_tx_buffer].blue];
+            *p_led = color;
         }
         
-        if (++var->ind_update_tx_buffer >= var->number_of_leds)
+        if (++phase >= step)
         {
-            var->ind_update_tx_buffer = 0;
+            phase = 0;
         }
     }
 }
@@ -173,7 +354,7 @@ void pink_lady_deamon(pink_lady_params_t *var)
  *   - LowestValue.red: The lowest red value between color1 red and color2 red
  *   - delta.red: The absolute difference red value between color1 red and color2 red
  *   - N: The number of concerned LED
- *   - i: The LED index (from 1 to N)
+ *   - i: The LED index (from 0 to N - 1, reversed when color1 > color2)
  *   - I: The intensity (only for delay > 0) (from 0 to 100)
  */
 /*******************************************************************************
@@ -215,111 +396,68 @@ void pink_lady_deamon(pink_lady_params_t *var)
  ******************************************************************************/
 uint8_t pink_lady_set_segment_params(pink_lady_params_t *var, PINK_LADY_MANAGER_IDENTIFIERS id, uint16_t from, uint16_t to, rgbw_color_t color1, rgbw_color_t color2, PINK_LADY_RESOLUTIONS resolution, uint32_t deadline_to_appear)
 {
+    pink_lady_manager_params_t *p_manager = &pink_lady_manager_tab[var->spi_id][id];
     
-    if (pink_lady_manager_tab[var->spi_id][id].status != PL_SEGMENT_FINISHED)
+    if (p_manager->status != PL_SEGMENT_FINISHED)
     {
     
-        switch (pink_lady_manager_tab[var->spi_id][id].sm.index)
+        switch (p_manager->sm.index)
         {
             case 0: // Home            
 
-                //0. Get delta colors between color1 and color2
-                pink_lady_manager_tab[var->spi_id][id].delta_color.red = (uint8_t) ((color1.red <= color2.red) ? (color2.red - color1.red) : (color1.red - color2.red));
-                pink_lady_manager_tab[var->spi_id][id].delta_color.green = (uint8_t) ((color1.green <= color2.green) ? (color2.green - color1.green) : (color1.green - color2.green));
-                pink_lady_manager_tab[var->spi_id][id].delta_color.blue = (uint8_t) ((color1.blue <= color2.blue) ? (color2.blue - color1.blue) : (color1.blue - color2.blue));
-                pink_lady_manager_tab[var->spi_id][id].delta_color.white = (uint8_t) ((color1.white <= color2.white) ? (color2.white - color1.white) : (color1.white - color2.white));
-
-                //1. Set color pointers on appropriate indices type (positive or negative)
-                pink_lady_manager_tab[var->spi_id][id].p_ind_red = (uint16_t *) ((color1.red <= color2.red) ? &pink_lady_manager_tab[var->spi_id][id].ind_pos : &pink_lady_manager_tab[var->spi_id][id].ind_neg);
-                pink_lady_manager_tab[var->spi_id][id].p_ind_green = (uint16_t *) ((color1.green <= color2.green) ? &pink_lady_manager_tab[var->spi_id][id].ind_pos : &pink_lady_manager_tab[var->spi_id][id].ind_neg);
-                pink_lady_manager_tab[var->spi_id][id].p_ind_blue = (uint16_t *) ((color1.blue <= color2.blue) ? &pink_lady_manager_tab[var->spi_id][id].ind_pos : &pink_lady_manager_tab[var->spi_id][id].ind_neg);
-                pink_lady_manager_tab[var->spi_id][id].p_ind_white = (uint16_t *) ((color1.white <= color2.white) ? &pink_lady_manager_tab[var->spi_id][id].ind_pos : &pink_lady_manager_tab[var->spi_id][id].ind_neg);            
-
-                //2. Get the number of LED to lit
-                pink_lady_manager_tab[var->spi_id][id].number_of_led = (uint16_t) (to - from + 1);
-
-                //3. Set the indices
-                pink_lady_manager_tab[var->spi_id][id].ind_pos = from;     
-                pink_lady_manager_tab[var->spi_id][id].ind_neg = to;   
+                //0. Get the number of LED to lit
+                p_manager->number_of_led = (uint16_t) (to - from + 1);
+                
+                //1. Get the gradient of each color (the per LED increments are computed once)
+                _gradient_init(&p_manager->red, color1.red, color2.red, p_manager->number_of_led);
+                _gradient_init(&p_manager->green, color1.green, color2.green, p_manager->number_of_led);
+                _gradient_init(&p_manager->blue, color1.blue, color2.blue, p_manager->number_of_led);
+                _gradient_init(&p_manager->white, color1.white, color2.white, p_manager->number_of_led);
 
-                pink_lady_manager_tab[var->spi_id][id].sm.index = (deadline_to_appear > 0) ? 3 : 1;
-                pink_lady_manager_tab[var->spi_id][id].sm.tick = mGetTick();
+                p_manager->sm.index = (deadline_to_appear > 0) ? 3 : 1;
+                p_manager->sm.tick = mGetTick();
                 
-                pink_lady_manager_tab[var->spi_id][id].status = PL_SEGMENT_BUSY;
+                p_manager->status = PL_SEGMENT_BUSY;
                 break;
 
-            case 1:// Deadline_to_appear == 0 (part 0: initialization)
-
-                pink_lady_manager_tab[var->spi_id][id].p_lowest_value_red = (uint8_t *) ((color1.red <= color2.red) ? &color1.red : &color2.red);
-                pink_lady_manager_tab[var->spi_id][id].p_lowest_value_green = (uint8_t *) ((color1.green <= color2.green) ? &color1.green : &color2.green);
-                pink_lady_manager_tab[var->spi_id][id].p_lowest_value_blue = (uint8_t *) ((color1.blue <= color2.blue) ? &color1.blue : &color2.blue);
-                pink_lady_manager_tab[var->spi_id][id].p_lowest_value_white = (uint8_t *) ((color1.white <= color2.white) ? &color1.white : &color2.white);
-
-                pink_lady_manager_tab[var->spi_id][id].sm.index = 2;
-
-            case 2: // Deadline_to_appear == 0 (part 1: led update)
+            case 1: // Deadline_to_appear == 0 (the whole segment is updated at once)
 
-                pink_lady_manager_tab[var->spi_id][id].ind_ = pink_lady_manager_tab[var->spi_id][id].ind_pos - from;
-
-                // (!(resolution & LED_RESO_JUMP) ? 0 : pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_red].red)
-                
-                pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_red].red       = (uint8_t) (((*pink_lady_manager_tab[var->spi_id][id].p_ind_red % (resolution & LED_RESO_1_255)) > 0) ? (((resolution & LED_RESO_JUMP) > 0) ? pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_red].red : 0) : (uint32_t)(*pink_lady_manager_tab[var->spi_id][id].p_lowest_value_red + pink_lady_manager_tab[var->spi_id][id].ind_ * pink_lady_manager_tab[var->spi_id][id].delta_color.red / pink_lady_manager_tab[var->spi_id][id].number_of_led));
-                pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_green].green   = (uint8_t) (((*pink_lady_manager_tab[var->spi_id][id].p_ind_green % (resolution & LED_RESO_1_255)) > 0) ? (((resolution & LED_RESO_JUMP) > 0) ? pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_green].green : 0) : (uint32_t)(*pink_lady_manager_tab[var->spi_id][id].p_lowest_value_green + pink_lady_manager_tab[var->spi_id][id].ind_ * pink_lady_manager_tab[var->spi_id][id].delta_color.green / pink_lady_manager_tab[var->spi_id][id].number_of_led));
-                pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_blue].blue     = (uint8_t) (((*pink_lady_manager_tab[var->spi_id][id].p_ind_blue % (resolution & LED_RESO_1_255)) > 0) ? (((resolution & LED_RESO_JUMP) > 0) ? pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_blue].blue : 0) : (uint32_t)(*pink_lady_manager_tab[var->spi_id][id].p_lowest_value_blue + pink_lady_manager_tab[var->spi_id][id].ind_ * pink_lady_manager_tab[var->spi_id][id].delta_color.blue / pink_lady_manager_tab[var->spi_id][id].number_of_led));
-                pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_white].white   = (uint8_t) (((*pink_lady_manager_tab[var->spi_id][id].p_ind_white % (resolution & LED_RESO_1_255)) > 0) ? (((resolution & LED_RESO_JUMP) > 0) ? pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_white].white : 0) : (uint32_t)(*pink_lady_manager_tab[var->spi_id][id].p_lowest_value_white + pink_lady_manager_tab[var->spi_id][id].ind_ * pink_lady_manager_tab[var->spi_id][id].delta_color.white / pink_lady_manager_tab[var->spi_id][id].number_of_led));
-
-                --pink_lady_manager_tab[var->spi_id][id].ind_neg;
-                if (++pink_lady_manager_tab[var->spi_id][id].ind_pos > to)
-                {
-                    pink_lady_manager_tab[var->spi_id][id].sm.index = 0;
-                    pink_lady_manager_tab[var->spi_id][id].status = PL_SEGMENT_FINISHED;
-                }
+                _segment_update(p_manager, from, to, resolution, false);
+                p_manager->sm.index = 0;
+                p_manager->status = PL_SEGMENT_FINISHED;
                 break;
 
-            case 3:// Deadline_to_appear > 0 (part 0: initialization)
+            case 3: // Deadline_to_appear > 0 (part 0: initialization)
                 
-                pink_lady_manager_tab[var->spi_id][id].p_lowest_value_red = (uint8_t *) ((color1.red <= color2.red) ? &color1.red : &color2.red);
-                pink_lady_manager_tab[var->spi_id][id].p_lowest_value_green = (uint8_t *) ((color1.green <= color2.green) ? &color1.green : &color2.green);
-                pink_lady_manager_tab[var->spi_id][id].p_lowest_value_blue = (uint8_t *) ((color1.blue <= color2.blue) ? &color1.blue : &color2.blue);
-                pink_lady_manager_tab[var->spi_id][id].p_lowest_value_white = (uint8_t *) ((color1.white <= color2.white) ? &color1.white : &color2.white);
                 //1. Save current LEDs segment
-                memcpy(&pink_lady_manager_tab[var->spi_id][id].p_led_copy[from], &pink_lady_manager_tab[var->spi_id][id].p_led[from], pink_lady_manager_tab[var->spi_id][id].number_of_led * sizeof(rgbw_color_t));            
+                memcpy(&p_manager->p_led_copy[from], &p_manager->p_led[from], p_manager->number_of_led * sizeof(rgbw_color_t));            
                 //2. Set time for intensity
-                pink_lady_manager_tab[var->spi_id][id].time_between_increment = (uint32_t) (deadline_to_appear / 100);            
+                p_manager->time_between_increment = (uint32_t) (deadline_to_appear / 100);            
                 //3. Reset intensity value
-                pink_lady_manager_tab[var->spi_id][id].intensity = 0;            
-                pink_lady_manager_tab[var->spi_id][id].sm.index = 4;
-
-            case 4: // Deadline_to_appear > 0 (part 1: led update)
+                p_manager->intensity = 0;            
+                p_manager->sm.index = 4;
 
-                pink_lady_manager_tab[var->spi_id][id].ind_ = pink_lady_manager_tab[var->spi_id][id].ind_pos - from;
+            case 4: // Deadline_to_appear > 0 (part 1: the whole segment is updated for the current intensity)
 
-                pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_red].red    = (uint8_t) (((*pink_lady_manager_tab[var->spi_id][id].p_ind_red % (resolution & LED_RESO_1_255)) > 0) ? (((resolution & LED_RESO_JUMP) > 0) ? pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_red].red : 0) : (uint32_t)(pink_lady_manager_tab[var->spi_id][id].p_led_copy[*pink_lady_manager_tab[var->spi_id][id].p_ind_red].red + (*pink_lady_manager_tab[var->spi_id][id].p_lowest_value_red + (pink_lady_manager_tab[var->spi_id][id].ind_ * pink_lady_manager_tab[var->spi_id][id].delta_color.red / pink_lady_manager_tab[var->spi_id][id].number_of_led) - pink_lady_manager_tab[var->spi_id][id].p_led_copy[*pink_lady_manager_tab[var->spi_id][id].p_ind_red].red) * pink_lady_manager_tab[var->spi_id][id].intensity / 100));
-                pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_green].green  = (uint8_t) (((*pink_lady_manager_tab[var->spi_id][id].p_ind_green % (resolution & LED_RESO_1_255)) > 0) ? (((resolution & LED_RESO_JUMP) > 0) ? pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_green].green : 0) : (uint32_t)(pink_lady_manager_tab[var->spi_id][id].p_led_copy[*pink_lady_manager_tab[var->spi_id][id].p_ind_green].green + (*pink_lady_manager_tab[var->spi_id][id].p_lowest_value_green + (pink_lady_manager_tab[var->spi_id][id].ind_ * pink_lady_manager_tab[var->spi_id][id].delta_color.green / pink_lady_manager_tab[var->spi_id][id].number_of_led) - pink_lady_manager_tab[var->spi_id][id].p_led_copy[*pink_lady_manager_tab[var->spi_id][id].p_ind_green].green) * pink_lady_manager_tab[var->spi_id][id].intensity / 100));
-                pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_blue].blue   = (uint8_t) (((*pink_lady_manager_tab[var->spi_id][id].p_ind_blue % (resolution & LED_RESO_1_255)) > 0) ? (((resolution & LED_RESO_JUMP) > 0) ? pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_blue].blue : 0) : (uint32_t)(pink_lady_manager_tab[var->spi_id][id].p_led_copy[*pink_lady_manager_tab[var->spi_id][id].p_ind_blue].blue + (*pink_lady_manager_tab[var->spi_id][id].p_lowest_value_blue + (pink_lady_manager_tab[var->spi_id][id].ind_ * pink_lady_manager_tab[var->spi_id][id].delta_color.blue / pink_lady_manager_tab[var->spi_id][id].number_of_led) - pink_lady_manager_tab[var->spi_id][id].p_led_copy[*pink_lady_manager_tab[var->spi_id][id].p_ind_blue].blue) * pink_lady_manager_tab[var->spi_id][id].intensity / 100));
-                pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_white].white  = (uint8_t) (((*pink_lady_manager_tab[var->spi_id][id].p_ind_white % (resolution & LED_RESO_1_255)) > 0) ? (((resolution & LED_RESO_JUMP) > 0) ? pink_lady_manager_tab[var->spi_id][id].p_led[*pink_lady_manager_tab[var->spi_id][id].p_ind_white].white : 0) : (uint32_t)(pink_lady_manager_tab[var->spi_id][id].p_led_copy[*pink_lady_manager_tab[var->spi_id][id].p_ind_white].white + (*pink_lady_manager_tab[var->spi_id][id].p_lowest_value_white + (pink_lady_manager_tab[var->spi_id][id].ind_ * pink_lady_manager_tab[var->spi_id][id].delta_color.white / pink_lady_manager_tab[var->spi_id][id].number_of_led) - pink_lady_manager_tab[var->spi_id][id].p_led_copy[*pink_lady_manager_tab[var->spi_id][id].p_ind_white].white) * pink_lady_manager_tab[var->spi_id][id].intensity / 100));
-
-                --pink_lady_manager_tab[var->spi_id][id].ind_neg;
-                if (++pink_lady_manager_tab[var->spi_id][id].ind_pos > to)
+                _segment_update(p_manager, from, to, resolution, (p_manager->intensity < 100));
+                if (p_manager->intensity < 100)
+                {
+                    p_manager->sm.index = 5;
+                }
+                else
                 {
-                    pink_lady_manager_tab[var->spi_id][id].sm.index = (pink_lady_manager_tab[var->spi_id][id].intensity == 100) ? 0 : 5;
-                    if (pink_lady_manager_tab[var->spi_id][id].sm.index == 0)
-                    {
-                        pink_lady_manager_tab[var->spi_id][id].sm.index = 0;
-                        pink_lady_manager_tab[var->spi_id][id].status = PL_SEGMENT_FINISHED;
-                    }
+                    p_manager->sm.index = 0;
+                    p_manager->status = PL_SEGMENT_FINISHED;
                 }
                 break;
 
             case 5: // Deadline_to_appear > 0 (part 2: intensity update)
 
-                if (mTickCompare(pink_lady_manager_tab[var->spi_id][id].sm.tick) > pink_lady_manager_tab[var->spi_id][id].time_between_increment)
+                if (mTickCompare(p_manager->sm.tick) > p_manager->time_between_increment)
                 {
-                    mUpdateTick_withCathingUpTime(pink_lady_manager_tab[var->spi_id][id].sm.tick, pink_lady_manager_tab[var->spi_id][id].time_between_increment);
-                    pink_lady_manager_tab[var->spi_id][id].intensity++;
-                    pink_lady_manager_tab[var->spi_id][id].sm.index = 4;
-                    pink_lady_manager_tab[var->spi_id][id].ind_pos = from; 
-                    pink_lady_manager_tab[var->spi_id][id].ind_neg = to;                       
+                    mUpdateTick_withCathingUpTime(p_manager->sm.tick, p_manager->time_between_increment);
+                    p_manager->intensity++;
+                    p_manager->sm.index = 4;
                 }
                 break;
 
@@ -329,7 +467,7 @@ uint8_t pink_lady_set_segment_params(pink_lady_params_t *var, PINK_LADY_MANAGER_
         
     }
     
-    return pink_lady_manager_tab[var->spi_id][id].sm.index;
+    return p_manager->sm.index;
 }
 
 PINK_LADY_MANAGER_STATUS pink_lady_get_segment_status(pink_lady_params_t var, PINK_LADY_MANAGER_IDENTIFIERS id)
@@ -355,15 +493,37 @@ void pink_lady_reset_all_segments(pink_lady_params_t var)
 }
 
 /*
- * Timings _shift when executing the memcpy:
- * For 10 bytes (0..9): 1,48 us
- * For 100 bytes (0..99): 12,16 us
- * For 1000 bytes (0..999): 119 us
+ * The LEDs are not moved: a step only updates the offset of the segment (O(1) whatever its length)
+ * and the rotation is applied by the daemon when the frame is encoded. The pattern written in 
+ * p_led[from..to] stays in its original order while the pattern runs (see pink_lady_shift_pattern_clear_offset).
+ * A running pattern holds one of the PINK_LADY_MAXIMUM_SHIFT_REGIONS regions of its bus: PINK_LADY_SHIFT_NO_FREE_REGION
+ * is returned (and the start is retried on the next call) until another pattern is stopped or finished.
  */
 uint8_t pink_lady_shift_pattern(pink_lady_shift_params_t *var)
 {
+    if (!var->enable)
+    {
+        pink_lady_shift_pattern_release(var);
+        return 2;
+    }
+    
     if (var->reset_requested)
     {
+        pink_lady_params_t *p_pink_lady = (pink_lady_params_t *) var->p_pink_lady;
+        uint8_t i;
+        
+        // The segment is registered on its bus (once) so that its offset is applied by the encoder.
+        for (i = 0 ; (i < PINK_LADY_MAXIMUM_SHIFT_REGIONS) && (p_pink_lady->p_shift[i] != var) ; i++);
+        if (i >= PINK_LADY_MAXIMUM_SHIFT_REGIONS)
+        {
+            for (i = 0 ; (i < PINK_LADY_MAXIMUM_SHIFT_REGIONS) && (p_pink_lady->p_shift[i] != NULL) ; i++);
+            if (i >= PINK_LADY_MAXIMUM_SHIFT_REGIONS)
+            {
+                return PINK_LADY_SHIFT_NO_FREE_REGION;
+            }
+            p_pink_lady->p_shift[i] = var;
+        }
+        
         var->reset_requested = false;
         var->current_iteration = 0;
         mUpdateTick(var->tick);
@@ -377,17 +537,11 @@ uint8_t pink_lady_shift_pattern(pink_lady_shift_params_t *var)
             
             if (var->direction == PL_SHIFT_FROM_TO_TO)
             {
-                rgbw_color_t t_rgbw = var->p_led[var->to];        
-                memcpy(&var->p_led_copy[var->from], &var->p_led[var->from], (var->to - var->from + 1)*4);
-                memcpy(&var->p_led[var->from + 1], &var->p_led_copy[var->from], (var->to - var->from)*4);
-                var->p_led[var->from] = t_rgbw;
+                var->offset = (var->offset >= (var->to - var->from)) ? 0 : (var->offset + 1);
             }
             else
             {
-                rgbw_color_t t_rgbw = var->p_led[var->from];        
-                memcpy(&var->p_led_copy[var->from], &var->p_led[var->from], (var->to - var->from + 1)*4);
-                memcpy(&var->p_led[var->from], &var->p_led_copy[var->from + 1], (var->to - var->from)*4);
-                var->p_led[var->to] = t_rgbw;
+                var->offset = (var->offset == 0) ? (var->to - var->from) : (var->offset - 1);
             }
             
             if (var->number_of_iterations > 0)
@@ -396,15 +550,51 @@ uint8_t pink_lady_shift_pattern(pink_lady_shift_params_t *var)
                 if (var->current_iteration >= var->number_of_iterations)
                 {
                     var->current_iteration = 0;
-                    var->enable = OFF;
+                    pink_lady_shift_pattern_release(var);
                     return 0;
                 }
             }
         }
     }
-    else
+    return 1;
+}
+
+static void _reverse_leds(rgbw_color_t *p_first, rgbw_color_t *p_last)
+{
+    rgbw_color_t tmp;
+    
+    for ( ; p_first < p_last ; p_first++, p_last--)
     {
-        return 2;
+        tmp = *p_first;
+        *p_first = *p_last;
+        *p_last = tmp;
+    }
+}
+
+/*
+ * The pattern is stopped and its shift region is given back to the bus. The offset is written 
+ * once in p_led[from..to] (in-place rotation by three reversals, p_led_copy is owned by the 
+ * segment manager) so the LEDs keep the position where the pattern stopped.
+ */
+void pink_lady_shift_pattern_release(pink_lady_shift_params_t *var)
+{
+    pink_lady_params_t *p_pink_lady = (pink_lady_params_t *) var->p_pink_lady;
+    uint8_t i;
+    
+    var->enable = OFF;
+    
+    for (i = 0 ; i < PINK_LADY_MAXIMUM_SHIFT_REGIONS ; i++)
+    {
+        if (p_pink_lady->p_shift[i] == var)
+        {
+            if (var->offset > 0)
+            {
+                _reverse_leds(&p_pink_lady->p_led[var->from], &p_pink_lady->p_led[var->to]);
+                _reverse_leds(&p_pink_lady->p_led[var->from], &p_pink_lady->p_led[var->from + var->offset - 1]);
+                _reverse_leds(&p_pink_lady->p_led[var->from + var->offset], &p_pink_lady->p_led[var->to]);
+                var->offset = 0;
+            }
+            p_pink_lady->p_shift[i] = NULL;
+        }
     }
-    return 1;
 }
@@ -5,6 +5,9 @@
 #define SK6812RGBW_TIMING       3500000
 #define SK6812RGB_TIMING        3500000
 
+#define PINK_LADY_MAXIMUM_SHIFT_REGIONS     4       // Number of shift patterns which can run at same time on a bus
+#define PINK_LADY_SHIFT_NO_FREE_REGION      0xff    // Returned by pink_lady_shift_pattern() while all the shift regions of the bus are used
+
 typedef enum
 {
     // DO NOT MODIFY
@@ -50,8 +53,8 @@ typedef struct
     uint16_t                    to;
     uint64_t                    refresh_time;
     
-    rgbw_color_t                * p_led;
-    rgbw_color_t                * p_led_copy;
+    uint16_t                    offset;             // Rotation applied when the segment is encoded (p_led[from..to] is not moved)
+    void                        *p_pink_lady;
     
     bool                        reset_requested;
     uint32_t                    current_iteration;
@@ -66,8 +69,8 @@ typedef struct
     .from = _from,                                                                      \
     .to = _to,                                                                          \
     .refresh_time = _period,                                                            \
-    .p_led = (rgbw_color_t*) _p_pink_lady_params ## _led_ram_allocation,                \
-    .p_led_copy = (rgbw_color_t*) _p_pink_lady_params ## _copy_led_ram_allocation,      \
+    .offset = 0,                                                                        \
+    .p_pink_lady = (void*) &_p_pink_lady_params,                                        \
     .reset_requested = true,                                                            \
     .current_iteration = 0,                                                             \
     .number_of_iterations = ((_to - _from + 1) * _number_of_cycles),                    \
@@ -112,28 +115,27 @@ typedef enum
 
 typedef struct
 {
-    rgbw_color_t                delta_color;
+    uint8_t                     value;              // Value of the next LED
+    uint8_t                     quotient;           // delta / number_of_led
+    uint16_t                    remainder;          // delta % number_of_led
+    uint16_t                    error;              // (i x delta) % number_of_led for the next LED
+    bool                        is_rising;
+} pink_lady_gradient_params_t;
+
+typedef struct
+{
+    pink_lady_gradient_params_t red;                // Gradient of each color for the first LED of the segment (computed once)
+    pink_lady_gradient_params_t green;
+    pink_lady_gradient_params_t blue;
+    pink_lady_gradient_params_t white;
     uint16_t                    number_of_led;
     uint8_t                     intensity;
-    uint16_t                    ind_pos;
-    uint16_t                    ind_neg;
-    uint16_t                    ind_;
     uint32_t                    time_between_increment;
     PINK_LADY_MANAGER_STATUS    status;
     state_machine_t             sm;
     
     rgbw_color_t                * p_led;
     rgbw_color_t                * p_led_copy;
-    
-    uint16_t                    * p_ind_red;
-    uint16_t                    * p_ind_green;
-    uint16_t                    * p_ind_blue;
-    uint16_t                    * p_ind_white;
-    
-    uint8_t                     * p_lowest_value_red;
-    uint8_t                     * p_lowest_value_green;
-    uint8_t                     * p_lowest_value_blue;
-    uint8_t                     * p_lowest_value_white;
 } pink_lady_manager_params_t;
 
 typedef struct
@@ -146,28 +148,35 @@ typedef struct
     uint16_t                    number_of_leds;
     rgbw_color_t                *p_led;
     rgbw_color_t                *p_led_copy;
-    uint32_t                    *p_buffer;
+    uint32_t                    *p_buffer[2];               // SPI frames (front buffer sent by the DMA / back buffer encoded by the daemon)
     uint32_t                    *p_led_model_mapping;
-    uint16_t                    ind_update_tx_buffer;
+    volatile uint8_t            buffer_front;
+    volatile bool               is_back_buffer_ready;       // A new frame is encoded: the buffers are swapped at the end of the current frame (reset time)
+    pink_lady_shift_params_t    *p_shift[PINK_LADY_MAXIMUM_SHIFT_REGIONS];
 } pink_lady_params_t;
 
+// Size in bytes of one SPI frame (the DMA transfer size). The storage of each frame is rounded up to 32-bit words so that both buffers are aligned for _encode_leds().
+#define PINK_LADY_TX_FRAME_SIZE(_led_model, _number_total_of_leds)   ((_number_total_of_leds) * ((_led_model) & 0x1f) + (((_led_model) >> 8) & 0x3f))
+
 #define PINK_LADY_INSTANCE(_spi_id, _led_model, _led_ram_buffer, _copy_led_ram_buffer, _tx_buffer_ram, _number_total_of_leds)  \
 {                                                                                                                                       \
     .is_init_done = 0,                                                                                                                  \
     .spi_id = _spi_id,                                                                                                                  \
     .dma_id = DMA_NUMBER_OF_MODULES,                                                                                                    \
-    .dma_params = {_tx_buffer_ram, NULL, sizeof(_tx_buffer_ram), 1, 1, 0},                                                              \
+    .dma_params = {_tx_buffer_ram[0], NULL, PINK_LADY_TX_FRAME_SIZE(_led_model, _number_total_of_leds), 1, 1, 0},                      \
     .led_model = _led_model,                                                                                                            \
     .number_of_leds = _number_total_of_leds,                                                                                            \
     .p_led = _led_ram_buffer,                                                                                                           \
     .p_led_copy = _copy_led_ram_buffer,                                                                                                 \
-    .p_buffer = (uint32_t *)_tx_buffer_ram,                                                                                             \
+    .p_buffer = {(uint32_t *)_tx_buffer_ram[0], (uint32_t *)_tx_buffer_ram[1]},                                                         \
     .p_led_model_mapping = NULL,                                                                                                        \
-    .ind_update_tx_buffer = 0                                                                                                           \
+    .buffer_front = 0,                                                                                                                  \
+    .is_back_buffer_ready = false,                                                                                                      \
+    .p_shift = {NULL}                                                                                                                   \
 }
 
 #define PINK_LADY_DEF(_name, _spi_id, _led_model, _number_total_of_leds)                                                                \
-static uint8_t _name ## _tx_buffer_ram_allocation[_number_total_of_leds * (_led_model & 0x1f) + ((_led_model >> 8) & 0x3f)] = {0};      \
+static uint32_t _name ## _tx_buffer_ram_allocation[2][(PINK_LADY_TX_FRAME_SIZE(_led_model, _number_total_of_leds) + 3) / 4] = {{0}};     \
 static rgbw_color_t _name ## _led_ram_allocation[_number_total_of_leds] = {0};                                                          \
 static rgbw_color_t _name ## _copy_led_ram_allocation[_number_total_of_leds] = {0};                                                     \
 static pink_lady_params_t _name = PINK_LADY_INSTANCE(_spi_id, _led_model, _name ## _led_ram_allocation, _name ## _copy_led_ram_allocation, _name ## _tx_buffer_ram_allocation, _number_total_of_leds)	
@@ -184,15 +193,17 @@ void pink_lady_reset_segment(pink_lady_params_t var, PINK_LADY_MANAGER_IDENTIFIE
 #define pink_lady_release_all_segments(var)                     pink_lady_reset_all_segments(var)
 
 uint8_t pink_lady_shift_pattern(pink_lady_shift_params_t *var);
-#define pink_lady_shift_pattern_stop(var)                       (var.enable = OFF)
+void pink_lady_shift_pattern_release(pink_lady_shift_params_t *var);
+#define pink_lady_shift_pattern_stop(var)                       pink_lady_shift_pattern_release(&var)
 #define pink_lady_shift_pattern_start(var)                      (var.enable = ON)
 #define pink_lady_shift_pattern_reset_and_start(var)            (var.enable = ON, var.reset_requested = true)
-#define pink_lady_shift_pattern_reset_and_stop(var)             (var.enable = OFF, var.reset_requested = true)
+#define pink_lady_shift_pattern_reset_and_stop(var)             (var.reset_requested = true, pink_lady_shift_pattern_release(&var))
 #define pink_lady_shift_pattern_set_refresh_time(var, time)     (var.refresh_time = time)
 #define pink_lady_shift_pattern_set_cycles(var, cycles)         ((var.number_of_iterations = ((var.to - var.from + 1) * cycles)), pink_lady_shift_pattern_reset_and_stop(var))
 #define pink_lady_shift_pattern_toggle_direction(var)           ((var.direction = !var.direction), pink_lady_shift_pattern_reset_and_stop(var))
 #define pink_lady_shift_pattern_set_direction_from_to_to(var)   ((var.direction = PL_SHIFT_FROM_TO_TO), pink_lady_shift_pattern_reset_and_stop(var))
 #define pink_lady_shift_pattern_set_direction_to_to_from(var)   ((var.direction = PL_SHIFT_TO_TO_FROM), pink_lady_shift_pattern_reset_and_stop(var))
+#define pink_lady_shift_pattern_clear_offset(var)               (var.offset = 0)
 
 #define pink_lady_put_pattern(var, pattern, from, to)           memcpy(&var.p_led[from], pattern, (sizeof(pattern) >= ((to - from + 1) * 4)) ? ((to - from + 1) * 4) : (sizeof(pattern) * 4))
 #define pink_lady_set_led_rgb(var, ind, r, g, b)                (var.p_led[ind].red = r, var.p_led[ind].green = g, var.p_led[ind].blue = b)
@@ -6,9 +6,25 @@
   * -----------------
   * SD Card driver uses 1 SPI and 2 DMA modules and is compatible ONLY with FAT16 CHS/LBA mode and
   * FAT32 CHS/LBA mode.
-  * READ requests are implemented.
-  * (WRITE requests are not implemented.)
+  * READ and WRITE (append only) requests are implemented.
+  * File data are read with multi-block reads (CMD18): a contiguous run of sectors (up to the end of
+  * the current cluster or the end of the file) is kept open and the next SD_CARD_READ_AHEAD_SECTORS
+  * sectors are prefetched in a ring while the caller consumes the current ones. The run is stopped 
+  * (CMD12) at each fragment boundary or before any other command. While a run is open the CS is kept
+  * low so the SPI bus must be dedicated to the SD Card.
+  * The dummy bytes (0xFF) clocked to receive data are sent by the DMA from a constant buffer in flash.
+  * The data token of each prefetched sector is polled by the daemon (the card can take up to 100 ms to 
+  * send it) and the end of the sector is signaled by the Block Transfer Done interrupt of the Rx DMA 
+  * channel (the flags are polled by the daemon if the DMA interrupt is not mapped).
+  * Data are written at the end of a file (the file is created in the root directory - 8.3 name - if it
+  * is not found) with multi-block writes (ACMD23 + CMD25). Clusters are linked to the file by groups of
+  * SD_CARD_PREALLOCATED_CLUSTERS. The FAT and directory sectors are modified in a write-back cache and
+  * the partially filled data sector is kept in RAM: they are written on the SD Card with sd_card_sync_file() 
+  * or sd_card_close_file() (the FSInfo sector of a FAT32 partition is not updated).
   * A maximum of 120 files can be opened at same time. 
+  * The directories are scanned once: the full path of each entry is looked up in a hash table of the 
+  * opened files and the sub-folders without opened file are not explored (except if the LOG is enabled
+  * to list all the entries). The scan is stopped as soon as all the opened files are found.
   * The maximum SPI frequency is 10 MHz (in theory 25 MHz). 
   * The card detection is implemented in the communication (no need to have a 
   * CD signal). If a card is removed then the software re-launch the initialization
@@ -66,6 +82,12 @@
 #define sd_card_get_cid(var)                    sd_card_get_packet(var, SD_CARD_CMD_10, 0x00000000, SD_CARD_RET_R1, SD_CARD_CID_LENGTH)
 #define sd_card_get_csd(var)                    sd_card_get_packet(var, SD_CARD_CMD_9, 0x00000000, SD_CARD_RET_R1, SD_CARD_CSD_LENGTH)
 #define sd_card_read_single_block(var, sector)  sd_card_get_packet(var, SD_CARD_CMD_17, (var->args_type == SD_CARD_ARGS_TYPE_SECTOR) ? sector : (sector * 512), SD_CARD_RET_R1, SD_CARD_DATA_BLOCK_LENGTH)
+#define sd_card_read_multiple_block(var, sector) sd_card_send_command(var, SD_CARD_CMD_18, (var->args_type == SD_CARD_ARGS_TYPE_SECTOR) ? sector : (sector * 512), SD_CARD_RET_R1, SPI_CS_CLR, SPI_CS_DO_NOTHING)
+#define sd_card_is_stream_open(var)             (var->_is_stream_open || var->_is_write_stream_open)
+#define sd_card_cache_data(var)                 (var->_p_cache[var->_cache_index])
+
+static const uint8_t sd_card_dummy_bytes[SD_CARD_DATA_BLOCK_LENGTH] = {[0 ... (SD_CARD_DATA_BLOCK_LENGTH - 1)] = 0xff};
+static sd_card_params_t *p_sd_card_of_dma_rx[DMA_NUMBER_OF_MODULES] = {NULL};
 
 static uint8_t sd_card_crc7(uint8_t *buffer, uint8_t length)
 {
@@ -135,6 +157,88 @@ static uint8_t _get_entry_full_name(uint8_t lfn_number_of_entry, uint8_t *p_lfn_
     return name_length;
 }
 
+static uint32_t _get_path_hash(const char *p_path, uint8_t path_length)
+{
+    // FNV-1a (32 bits) hash - value 0 is reserved for the empty slots of the hash tables.
+    uint32_t hash = 0x811c9dc5;
+    uint8_t i;
+    
+    for (i = 0 ; i < path_length ; i++)
+    {
+        hash ^= (uint8_t) p_path[i];
+        hash *= 0x01000193;
+    }
+    
+    return (hash > 0) ? hash : 1;
+}
+
+static void _build_file_hash_table(sd_card_params_t *var)
+{
+    uint8_t i, j, k;
+    uint8_t slot;
+    
+    memset(var->_file_hash_table, 0, sizeof(var->_file_hash_table));
+    memset(var->_folder_hash_table, 0, sizeof(var->_folder_hash_table));
+    var->_is_folder_hash_table_full = false;
+    var->_number_of_file_not_found = 0;
+    
+    for (i = 0 ; i < var->number_of_p_file ; i++)
+    {
+        uint8_t name_length = strlen(var->p_file[i]->file_name);
+        
+        if (!var->p_file[i]->flags.is_found)
+        {
+            var->_number_of_file_not_found++;
+        }
+        
+        // Open addressing (linear probing) on the hash of the full path of the file.
+        var->_file_hash[i] = _get_path_hash(var->p_file[i]->file_name, name_length);
+        for (slot = var->_file_hash[i] & (SD_CARD_FILE_HASH_TABLE_SIZE - 1) ; var->_file_hash_table[slot] > 0 ; slot = (slot + 1) & (SD_CARD_FILE_HASH_TABLE_SIZE - 1));
+        var->_file_hash_table[slot] = i + 1;
+        
+        // Each folder of the path ("folder\" then "folder\sub folder\"...) has to be explored.
+        for (j = 0 ; j < name_length ; j++)
+        {
+            if (var->p_file[i]->file_name[j] == '\\')
+            {
+                uint32_t folder_hash = _get_path_hash(var->p_file[i]->file_name, j + 1);
+                
+                for (k = 0, slot = folder_hash & (SD_CARD_FOLDER_HASH_TABLE_SIZE - 1) ; (k < SD_CARD_FOLDER_HASH_TABLE_SIZE) && (var->_folder_hash_table[slot] > 0) && (var->_folder_hash_table[slot] != folder_hash) ; k++, slot = (slot + 1) & (SD_CARD_FOLDER_HASH_TABLE_SIZE - 1));
+                if (k < SD_CARD_FOLDER_HASH_TABLE_SIZE)
+                {
+                    var->_folder_hash_table[slot] = folder_hash;
+                }
+                else
+                {
+                    // No more space: all the folders are explored.
+                    var->_is_folder_hash_table_full = true;
+                }
+            }
+        }
+    }
+}
+
+static bool _is_folder_to_explore(sd_card_params_t *var, const char *p_path, uint8_t path_length)
+{
+    uint32_t folder_hash = _get_path_hash(p_path, path_length);
+    uint8_t k, slot;
+    
+    if (var->_is_folder_hash_table_full)
+    {
+        return true;
+    }
+    
+    for (k = 0, slot = folder_hash & (SD_CARD_FOLDER_HASH_TABLE_SIZE - 1) ; (k < SD_CARD_FOLDER_HASH_TABLE_SIZE) && (var->_folder_hash_table[slot] > 0) ; k++, slot = (slot + 1) & (SD_CARD_FOLDER_HASH_TABLE_SIZE - 1))
+    {
+        if (var->_folder_hash_table[slot] == folder_hash)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
 static void _sort_data_array_to_cid_structure(sd_card_params_t *var)
 {
     var->cid.manufacturer_id = var->_p_ram_rx[0];
@@ -454,6 +558,7 @@ static void _sort_data_array_to_boot_sector_structure(sd_card_params_t *var)
 static bool _search_and_sort_files(sd_card_params_t *var, uint32_t *current_sector)
 {
     uint8_t i;
+    uint8_t slot;
     uint8_t first_byte = 0;
     uint8_t file_attributes = 0;
     
@@ -494,21 +599,37 @@ static bool _search_and_sort_files(sd_card_params_t *var, uint32_t *current_sect
                     if ((file_attributes & FAT_FILE_SYSTEME_FA_ARCHIVE) > 0)
                     {
                         char __full_path_file[255] = {0};
+                        uint32_t __full_path_hash = 0;
                         
                         memcpy(__full_path_file, __path, __path_length);
                         memcpy(&__full_path_file[__path_length], __entry_name, __entry_name_length);
+                        __full_path_hash = _get_path_hash(__full_path_file, __path_length + __entry_name_length);
                         
                         var->number_of_file++;                            
-                        for (i = 0 ; i < var->number_of_p_file ; i++)
+                        for (slot = __full_path_hash & (SD_CARD_FILE_HASH_TABLE_SIZE - 1) ; var->_file_hash_table[slot] > 0 ; slot = (slot + 1) & (SD_CARD_FILE_HASH_TABLE_SIZE - 1))
                         {    
-                            if (!strcmp(__full_path_file, var->p_file[i]->file_name))
+                            i = var->_file_hash_table[slot] - 1;
+                            if ((var->_file_hash[i] == __full_path_hash) && !strcmp(__full_path_file, var->p_file[i]->file_name))
                             {
+                                if (!var->p_file[i]->flags.is_found)
+                                {
+                                    var->_number_of_file_not_found--;
+                                }
                                 var->p_file[i]->flags.is_found = true;
                                 var->p_file[i]->file_attributes.value = file_attributes;
                                 var->p_file[i]->last_write_time.value = (var->_p_ram_rx[__index_of_entry * 32 + 0x16] << 0) | (var->_p_ram_rx[__index_of_entry * 32 + 0x17] << 8);
                                 var->p_file[i]->last_write_date.value = (var->_p_ram_rx[__index_of_entry * 32 + 0x18] << 0) | (var->_p_ram_rx[__index_of_entry * 32 + 0x18] << 8);
                                 var->p_file[i]->first_cluster_of_the_file = (var->_p_ram_rx[__index_of_entry * 32 + 0x1a] << 0) | (var->_p_ram_rx[__index_of_entry * 32 + 0x1b] << 8) | (var->_p_ram_rx[__index_of_entry * 32 + 0x14] << 16) | (var->_p_ram_rx[__index_of_entry * 32 + 0x15] << 24);
                                 var->p_file[i]->file_size = (var->_p_ram_rx[__index_of_entry * 32 + 0x1c] << 0) | (var->_p_ram_rx[__index_of_entry * 32 + 0x1d] << 8) | (var->_p_ram_rx[__index_of_entry * 32 + 0x1e] << 16) | (var->_p_ram_rx[__index_of_entry * 32 + 0x1f] << 24);
+                                var->p_file[i]->current_cluster_of_the_file = var->p_file[i]->first_cluster_of_the_file;
+                                var->p_file[i]->_current_jump_index = 0;
+                                var->p_file[i]->_extents[0].first_jump_index = 0;
+                                var->p_file[i]->_extents[0].first_cluster = var->p_file[i]->first_cluster_of_the_file;
+                                var->p_file[i]->_extents[0].number_of_clusters = 1;
+                                var->p_file[i]->_number_of_extents = (var->p_file[i]->first_cluster_of_the_file > 0) ? 1 : 0;
+                                var->p_file[i]->_number_of_clusters = (var->p_file[i]->first_cluster_of_the_file > 0) ? ((var->p_file[i]->file_size + fat_file_system_get_cluster_length() - 1) / fat_file_system_get_cluster_length()) : 0;
+                                var->p_file[i]->_directory_entry_sector = *current_sector;
+                                var->p_file[i]->_directory_entry_index = __index_of_entry;
                             }
                         }
                         
@@ -527,6 +648,15 @@ static bool _search_and_sort_files(sd_card_params_t *var, uint32_t *current_sect
                                 LOG_BLANCK("[%6d.%3d / %1x]       \\%s (first cluster: %d / first sector: %d / size: %d bytes / attributes: %2x)", fat_file_system_get_cluster_of_sector_N(*current_sector), fat_file_system_get_sector_index_in_cluster(*current_sector), __index_of_entry, p_string(__entry_name), first_cluster, first_sector, size, file_attributes);
                             }
                         }
+                        else if (!var->_number_of_file_not_found)
+                        {
+                            // All the opened files are found: the rest of the directories is not scanned.
+                            __index_of_entry = 0;
+                            __index_of_sub_folder = 0;
+                            __path_length = 0;
+                            __path[__path_length] = '\0';
+                            return 0;
+                        }
                     }
                     else if ((file_attributes & FAT_FILE_SYSTEME_FA_DIRECTORY) > 0)
                     {
@@ -536,16 +666,26 @@ static bool _search_and_sort_files(sd_card_params_t *var, uint32_t *current_sect
                         __path[__path_length + __entry_name_length] = '\\'; 
                         __path[__path_length + __entry_name_length + 1] = '\0'; 
                         __path_length += __entry_name_length + 1;
-                        __saved_address_before_jump[__index_of_sub_folder++] = (*current_sector * var->boot_sector.number_of_bytes_per_sector) + ((__index_of_entry + 1) * 32);
-                        *current_sector = fat_file_system_get_first_sector_of_cluster_N(((var->_p_ram_rx[__index_of_entry * 32 + 0x1a] << 0) | (var->_p_ram_rx[__index_of_entry * 32 + 0x1b] << 8) | (var->_p_ram_rx[__index_of_entry * 32 + 0x14] << 16) | (var->_p_ram_rx[__index_of_entry * 32 + 0x15] << 24)));                      
-                        __index_of_entry = 0;
-
-                        if (var->is_log_enable)
+                        
+                        // A sub-folder without opened file is not explored (except if the LOG is enabled to list all the entries).
+                        if (!var->is_log_enable && !_is_folder_to_explore(var, __path, __path_length))
                         {
-                            LOG_BLANCK("[%6d.%3d / %1x]   D   \\%s", fat_file_system_get_cluster_of_sector_N(*current_sector), fat_file_system_get_sector_index_in_cluster(*current_sector), __index_of_entry, p_string(__path));
+                            __path_length -= __entry_name_length + 1;
+                            __path[__path_length] = '\0';
                         }
+                        else
+                        {
+                            __saved_address_before_jump[__index_of_sub_folder++] = (*current_sector * var->boot_sector.number_of_bytes_per_sector) + ((__index_of_entry + 1) * 32);
+                            *current_sector = fat_file_system_get_first_sector_of_cluster_N(((var->_p_ram_rx[__index_of_entry * 32 + 0x1a] << 0) | (var->_p_ram_rx[__index_of_entry * 32 + 0x1b] << 8) | (var->_p_ram_rx[__index_of_entry * 32 + 0x14] << 16) | (var->_p_ram_rx[__index_of_entry * 32 + 0x15] << 24)));                      
+                            __index_of_entry = 0;
+
+                            if (var->is_log_enable)
+                            {
+                                LOG_BLANCK("[%6d.%3d / %1x]   D   \\%s", fat_file_system_get_cluster_of_sector_N(*current_sector), fat_file_system_get_sector_index_in_cluster(*current_sector), __index_of_entry, p_string(__path));
+                            }
                         
-                        return 1;
+                            return 1;
+                        }
                     }
                 }
                 else 
@@ -577,8 +717,9 @@ static bool _search_and_sort_files(sd_card_params_t *var, uint32_t *current_sect
         else
         {
             // Back from one folder
-            if (__index_of_sub_folder-- > 0)
+            if (__index_of_sub_folder > 0)
             {
+                __index_of_sub_folder--;
                 *current_sector = __saved_address_before_jump[__index_of_sub_folder] / var->boot_sector.number_of_bytes_per_sector;
                 __index_of_entry = (__saved_address_before_jump[__index_of_sub_folder] % var->boot_sector.number_of_bytes_per_sector) / 32;
                 __saved_address_before_jump[__index_of_sub_folder] = 0;
@@ -606,6 +747,11 @@ static bool _search_and_sort_files(sd_card_params_t *var, uint32_t *current_sect
             }
             else
             {
+                // End of the root directory: all the following entries are free (used to create a file).
+                var->_free_root_entry_sector = *current_sector;
+                var->_free_root_entry_index = __index_of_entry;
+                __index_of_entry = 0;
+                
                 if (var->is_log_enable)
                 {
                     LOG_BLANCK("%d folders / %d files\n", var->number_of_folder, var->number_of_file); 
@@ -617,6 +763,54 @@ static bool _search_and_sort_files(sd_card_params_t *var, uint32_t *current_sect
     }
 }
 
+static void _start_data_reception(sd_card_params_t *var, uint16_t length)
+{
+    // The dummy bytes are sent from a constant buffer (no fill of the Tx buffer).
+    var->dma_tx_params.src_start_addr = (void *) sd_card_dummy_bytes;
+    var->dma_tx_params.src_size = length;
+    var->dma_rx_params.dst_size = var->dma_tx_params.src_size;     
+    
+    dma_set_transfer_params(var->dma_rx_id, &var->dma_rx_params);   
+    dma_set_transfer_params(var->dma_tx_id, &var->dma_tx_params);    
+    dma_channel_enable(var->dma_rx_id, ON, false);  // Do not force the transfer (it occurs automatically when data is received - SPI Rx generates the transfer)
+    dma_channel_enable(var->dma_tx_id, ON, false);  // Do not take care of the 'force_transfer' boolean value because the DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).            
+    var->dma_tx_params.src_start_addr = (void *) var->_p_ram_tx;
+}
+
+// Must be called with the interrupts disabled (or from the DMA interrupt).
+static void _dma_rx_transfer_done(sd_card_params_t *var)
+{
+    dma_clear_flags(var->dma_rx_id, DMA_FLAG_BLOCK_TRANSFER_DONE);
+    var->_is_dma_rx_done = true;
+}
+
+static void _sd_card_dma_rx_event_handler(uint8_t id, DMA_CHANNEL_FLAGS flags)
+{
+    if ((p_sd_card_of_dma_rx[id] != NULL) && ((flags & DMA_FLAG_BLOCK_TRANSFER_DONE) > 0))
+    {
+        _dma_rx_transfer_done(p_sd_card_of_dma_rx[id]);
+    }
+}
+
+static bool sd_card_is_dma_rx_done(sd_card_params_t *var)
+{
+    uint32_t int_status = __builtin_disable_interrupts();
+    bool is_done;
+    
+    if ((dma_get_flags(var->dma_rx_id) & DMA_FLAG_BLOCK_TRANSFER_DONE) > 0)
+    {
+        _dma_rx_transfer_done(var);       // In case the interrupt is not mapped on the DMA vector.
+    }
+    is_done = var->_is_dma_rx_done;
+    var->_is_dma_rx_done = false;
+    
+    if (int_status & 0x00000001)
+    {
+        __builtin_enable_interrupts();
+    }
+    return is_done;
+}
+
 static uint8_t sd_card_send_command(sd_card_params_t *var, SD_CARD_COMMAND_TYPE cde_type, uint32_t args, SD_CARD_RESPONSE_COMMAND ret, SPI_CS_CDE cs_at_begining_of_transmission, SPI_CS_CDE cs_at_end_of_transmission)
 {
     static enum _functionState
@@ -663,9 +857,14 @@ static uint8_t sd_card_send_command(sd_card_params_t *var, SD_CARD_COMMAND_TYPE
             
         case SM_GET_RESPONSE:
             
-            if ((dma_get_flags(var->dma_rx_id) & DMA_FLAG_BLOCK_TRANSFER_DONE) > 0)
+            if (sd_card_is_dma_rx_done(var))
             {
-                dma_clear_flags(var->dma_rx_id, DMA_FLAG_BLOCK_TRANSFER_DONE);  
+                
+                if (cde_type == SD_CARD_CMD_12)
+                {
+                    // The byte following CMD12 is a stuff byte (the card can still be sending data) and must be discarded.
+                    while (spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx));
+                }
                 
                 uint8_t number_of_retransmission = 8;
                 
@@ -753,23 +952,14 @@ static uint8_t sd_card_read_data(sd_card_params_t *var, uint16_t length, SPI_CS_
             {
                 ports_clr_bit(var->spi_cs);
             }
-            memset((void *) var->_p_ram_tx, 0xff, length);
-            var->dma_tx_params.src_size = length;
-            var->dma_rx_params.dst_size = var->dma_tx_params.src_size;     
-            
-            dma_set_transfer_params(var->dma_rx_id, &var->dma_rx_params);   
-            dma_set_transfer_params(var->dma_tx_id, &var->dma_tx_params);    
-            dma_channel_enable(var->dma_rx_id, ON, false);  // Do not force the transfer (it occurs automatically when data is received - SPI Rx generates the transfer)
-            dma_channel_enable(var->dma_tx_id, ON, false);  // Do not take care of the 'force_transfer' boolean value because the DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).            
-            
+            _start_data_reception(var, length);
             functionState++;
             break;
             
         case SM_WAIT_FULL_RECEPTION:
             
-            if ((dma_get_flags(var->dma_rx_id) & DMA_FLAG_BLOCK_TRANSFER_DONE) > 0)
+            if (sd_card_is_dma_rx_done(var))
             {
-                dma_clear_flags(var->dma_rx_id, DMA_FLAG_BLOCK_TRANSFER_DONE);
                 if (cs_at_end_of_transmission == SPI_CS_SET)
                 {
                     ports_set_bit(var->spi_cs);
@@ -786,6 +976,129 @@ static uint8_t sd_card_read_data(sd_card_params_t *var, uint16_t length, SPI_CS_
     return functionState;
 }
 
+static uint8_t sd_card_write_data(sd_card_params_t *var, uint8_t token, uint8_t *p_src)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_WAIT_FULL_TRANSMISSION,
+        SM_GET_DATA_RESPONSE,
+        SM_WAIT_NOT_BUSY
+    } functionState = 0;
+    
+    switch (functionState)
+    {
+        case SM_FREE:
+            
+            while (spi_write_and_read_8(var->spi_id, token, var->_p_ram_rx));
+            
+            // The data are directly sent from the source buffer (no copy in the Tx buffer).
+            var->dma_tx_params.src_start_addr = (void *) p_src;
+            var->dma_tx_params.src_size = SD_CARD_DATA_BLOCK_LENGTH - 2;
+            var->dma_rx_params.dst_size = var->dma_tx_params.src_size;     
+            
+            dma_set_transfer_params(var->dma_rx_id, &var->dma_rx_params);   
+            dma_set_transfer_params(var->dma_tx_id, &var->dma_tx_params);    
+            dma_channel_enable(var->dma_rx_id, ON, false);  // Do not force the transfer (it occurs automatically when data is received - SPI Rx generates the transfer)
+            dma_channel_enable(var->dma_tx_id, ON, false);  // Do not take care of the 'force_transfer' boolean value because the DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).            
+            
+            functionState = SM_WAIT_FULL_TRANSMISSION;
+            break;
+            
+        case SM_WAIT_FULL_TRANSMISSION:
+            
+            if (sd_card_is_dma_rx_done(var))
+            {
+                var->dma_tx_params.src_start_addr = (void *) var->_p_ram_tx;
+                
+                // 2 CRC bytes (not checked - CMD59 is not sent)
+                while (spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx));
+                while (spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx));
+                functionState = SM_GET_DATA_RESPONSE;
+            }
+            break;
+            
+        case SM_GET_DATA_RESPONSE:
+            
+            if (!spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx))
+            {
+                if (var->_p_ram_rx[0] != 0xff)
+                {
+                    var->_data_response = var->_p_ram_rx[0] & SD_CARD_MASK_DATA_RESPONSE;
+                    functionState = SM_WAIT_NOT_BUSY;
+                }
+            }
+            break;
+            
+        case SM_WAIT_NOT_BUSY:
+            
+            // The card holds DO low as long as it is programming the data.
+            if (!spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx))
+            {
+                if (var->_p_ram_rx[0] == 0xff)
+                {
+                    functionState = SM_FREE;
+                }
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_stop_transmission(sd_card_params_t *var)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_CMD_12,
+        SM_STOP_TRAN_TOKEN,
+        SM_WAIT_NOT_BUSY
+    } functionState = 0;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            // A multi-block write is stopped with the STOP TRANSMISSION TOKEN and a multi-block read with CMD12.
+            functionState = (var->_is_write_stream_open) ? SM_STOP_TRAN_TOKEN : SM_CMD_12;
+            break;
+            
+        case SM_CMD_12:
+            
+            // The R1 response is not checked: whatever the response, the card returns to the transfer state after CMD12.
+            if (!sd_card_send_command(var, SD_CARD_CMD_12, 0x00000000, SD_CARD_RET_R1B, SPI_CS_DO_NOTHING, SPI_CS_DO_NOTHING))
+            {
+                functionState = SM_WAIT_NOT_BUSY;
+            }
+            break;
+            
+        case SM_STOP_TRAN_TOKEN:
+            
+            while (spi_write_and_read_8(var->spi_id, SD_CARD_STOP_TRAN_TOKEN, var->_p_ram_rx));
+            while (spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx));     // Stuff byte
+            functionState = SM_WAIT_NOT_BUSY;
+            break;
+            
+        case SM_WAIT_NOT_BUSY:
+            
+            // R1b (or end of programming): the card holds DO low as long as it is busy.
+            if (!spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx))
+            {
+                if (var->_p_ram_rx[0] == 0xff)
+                {
+                    ports_set_bit(var->spi_cs);
+                    var->_is_stream_open = false;
+                    var->_is_write_stream_open = false;
+                    functionState = SM_FREE;
+                }
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
 static uint8_t sd_card_initialization(sd_card_params_t *var)
 {
     static enum _functionState
@@ -816,6 +1129,18 @@ static uint8_t sd_card_initialization(sd_card_params_t *var)
             { 
                 LOG_BLANCK("\nSD Card Initialization..."); 
             }
+            var->_is_stream_open = false;
+            var->_is_read_ahead_on_going = false;
+            var->_read_ahead_count = 0;
+            var->_is_dma_rx_done = false;
+            var->_is_write_stream_open = false;
+            var->_cache_is_valid = 0;
+            var->_cache_is_dirty = 0;
+            var->_p_tail_file = NULL;
+            var->_is_tail_dirty = false;
+            var->_next_free_cluster = 2;
+            var->dma_rx_params.dst_start_addr = (void *) var->_p_ram_rx;
+            var->dma_tx_params.src_start_addr = (void *) var->_p_ram_tx;
             spi_set_frequency(var->spi_id, SD_CARD_FREQ_INIT);
             functionState = SM_POWER_SEQUENCE_START;        
             
@@ -1074,6 +1399,7 @@ static uint8_t sd_card_get_packet(sd_card_params_t *var, SD_CARD_COMMAND_TYPE cd
     static enum _functionState
     {
         SM_FREE = 0,
+        SM_STOP_STREAM,
         SM_CMD,
         SM_WAIT_START_TOKEN,
         SM_READ_DATA_PACKET,
@@ -1087,7 +1413,16 @@ static uint8_t sd_card_get_packet(sd_card_params_t *var, SD_CARD_COMMAND_TYPE cd
         case SM_FREE:      
             
             fail_count = 0;
-            functionState = SM_CMD;   
+            functionState = SM_STOP_STREAM;   
+            
+        case SM_STOP_STREAM:
+            
+            // A multi-block read (CMD18) or write (CMD25) has to be stopped before sending any other command.
+            if (sd_card_is_stream_open(var) && sd_card_stop_transmission(var))
+            {
+                break;
+            }
+            functionState = SM_CMD;
             
         case SM_CMD:
             
@@ -1153,100 +1488,689 @@ static uint8_t sd_card_get_packet(sd_card_params_t *var, SD_CARD_COMMAND_TYPE cd
     return functionState;
 }
 
-static uint8_t sd_card_search_files(sd_card_params_t *var)
+static uint8_t sd_card_write_single_block(sd_card_params_t *var, uint32_t sector, uint8_t *p_src)
 {
     static enum _functionState
     {
         SM_FREE = 0,
-        SM_SEARCH_FILES,
-        SM_READ_FAT_TABLE,
-        SM_END
+        SM_STOP_STREAM,
+        SM_CMD_24,
+        SM_WRITE_DATA_PACKET,
+        SM_FAIL
     } functionState = 0;
-    static uint32_t current_sector = 0;
-    static uint32_t current_fat_sector = 0;
-    uint8_t i;
+    static uint64_t functionTick = 0;
+    static uint8_t fail_count = 0;
     
     switch (functionState)
     {
         case SM_FREE:      
             
-            if (var->is_log_enable)
-            {
-                LOG_BLANCK("\nRoot Directories:"); 
-                LOG_BLANCK("Cluster . Index Sector in Cluster (max = Number of sector per cluster) / Index of Entry (Max 16 Entries per sector)"); 
-            }
-            current_sector = var->boot_sector.root_directory_region_start;
-            functionState = SM_SEARCH_FILES;
+            fail_count = 0;
+            var->_read_ahead_count = 0;
+            functionState = SM_STOP_STREAM;   
             
-        case SM_SEARCH_FILES:
+        case SM_STOP_STREAM:
             
-            if (!sd_card_read_single_block(var, current_sector))
+            if (sd_card_is_stream_open(var) && sd_card_stop_transmission(var))
             {
-                uint8_t ret = _search_and_sort_files(var, &current_sector);
-                if (!ret)               // ret == 0 and ret == 1 are used for both FAT16 & FAT32
-                {                                                            
-                    functionState = SM_END;
-                }
-                else if (ret == 2)      // ret == 2 is only used for FAT32
-                {   
-                    current_fat_sector = var->boot_sector.fat_region_start + (fat_file_system_get_cluster_of_sector_N(current_sector) / 128);
-                    uint16_t fat_table_cluster_index = (uint16_t) ((fat_file_system_get_cluster_of_sector_N(current_sector) % 128) * 4);
-                    
-                    if (var->is_log_enable)
-                    {
-                        LOG_BLANCK("        Read FAT Table: Last cluster %d / FAT Table sector where cluster is located: %d - index: %d (%x)", fat_file_system_get_cluster_of_sector_N(current_sector), current_fat_sector, fat_table_cluster_index, fat_table_cluster_index); 
-                    }
-                    
-                    functionState = SM_READ_FAT_TABLE;
-                }
+                break;
             }
-            break;
+            functionState = SM_CMD_24;
             
-        case SM_READ_FAT_TABLE:
+        case SM_CMD_24:
             
-            // Read the FAT table from the last cluster value.             
-            if (!sd_card_read_single_block(var, current_fat_sector))
-            {  
-                uint16_t fat_table_cluster_index = (uint16_t) ((fat_file_system_get_cluster_of_sector_N(current_sector) % 128) * 4);
-                uint32_t next_cluster = (var->_p_ram_rx[fat_table_cluster_index + 0] << 0) | (var->_p_ram_rx[fat_table_cluster_index + 1] << 8) | (var->_p_ram_rx[fat_table_cluster_index + 2] << 16) | (var->_p_ram_rx[fat_table_cluster_index + 3] << 24);
-                if (next_cluster >= FAT32_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN)
-                {
-                    if (var->is_log_enable)
-                    {
-                        LOG_BLANCK("        No next cluster (value FAT Table >= 0x0FFFFFF8)"); 
-                    }
-                    
-                    functionState = SM_END;
+            if (!sd_card_send_command(var, SD_CARD_CMD_24, (var->args_type == SD_CARD_ARGS_TYPE_SECTOR) ? sector : (sector * 512), SD_CARD_RET_R1, SPI_CS_CLR, SPI_CS_DO_NOTHING))
+            {
+                if (!(var->response_command.R1.value & R1_RESPONSE_MASK_NORMAL_STATE) && var->response_command.is_response_returned)
+                {                    
+                    functionState = SM_WRITE_DATA_PACKET;
                 }
                 else
                 {
-                    current_sector = fat_file_system_get_first_sector_of_cluster_N(next_cluster);                                
-
-                    if (var->is_log_enable)
-                    {
-                        LOG_BLANCK("        Next cluster %d / Start sector: %d", next_cluster, current_sector); 
-                    }
-
-                    functionState = SM_SEARCH_FILES;
+                    functionState = SM_FAIL;
                 }
             }
             break;
             
-        case SM_END:
+        case SM_WRITE_DATA_PACKET:
             
-            if (var->is_log_enable) 
-            {            
-                for (i = 0 ; i < var->number_of_p_file ; i++)
-                {
-                    if(var->p_file[i]->flags.is_found)
-                    {
-                        LOG_BLANCK("File open: %s (%d bytes) - Starting Cluster: %d - Attributes: %2x - Last write: %2d/%2d/%4d at %2dh:%2dm:%2ds", p_string(&var->p_file[i]->file_name), var->p_file[i]->file_size, var->p_file[i]->first_cluster_of_the_file, var->p_file[i]->file_attributes.value, var->p_file[i]->last_write_date.day, var->p_file[i]->last_write_date.month, (var->p_file[i]->last_write_date.year + 1980), var->p_file[i]->last_write_time.hours, var->p_file[i]->last_write_time.minutes, var->p_file[i]->last_write_time.seconds);
-                    }
-                    else
-                    {
-                        LOG_BLANCK("File Not Found: %s", p_string(&var->p_file[i]->file_name));
-                    }
-                }
+            if (!sd_card_write_data(var, SD_CARD_DATA_TOKEN, p_src))
+            {      
+                ports_set_bit(var->spi_cs);
+                functionState = (var->_data_response == SD_CARD_DATA_RESPONSE_ACCEPTED) ? SM_FREE : SM_FAIL;
+            }
+            break;
+            
+        case SM_FAIL:
+            
+            ports_set_bit(var->spi_cs);
+            if (++fail_count >= 10)
+            {
+                functionState = SM_FREE;
+                SET_BIT(var->_flags, SM_SD_CARD_INITIALIZATION);
+                return SD_CARD_WRITE_FAIL;
+            }
+            else
+            {
+                mUpdateTick(functionTick);
+                functionState++;
+            }
+            break;
+            
+        default:
+            
+            if (mTickCompare(functionTick) >= TICK_1MS)
+            {
+                functionState = SM_CMD_24;
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_read_file_sector(sd_card_params_t *var, uint32_t sector, uint32_t last_sector)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_STOP_STREAM,
+        SM_CMD_18,
+        SM_WAIT_START_TOKEN,
+        SM_READ_DATA_PACKET,
+        SM_END_OF_RUN,
+        SM_FAIL
+    } functionState = 0;
+    static uint64_t functionTick = 0;
+    static uint8_t fail_count = 0;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            fail_count = 0;
+            
+            if ((var->_read_ahead_count > 0) && (sector >= var->_read_ahead_first_sector) && (sector < (var->_read_ahead_first_sector + var->_read_ahead_count)))
+            {
+                // The sector has already been prefetched: the older sectors of the ring are released.
+                uint8_t offset = (uint8_t) (sector - var->_read_ahead_first_sector);
+                var->_read_ahead_tail = (var->_read_ahead_tail + offset) % SD_CARD_READ_AHEAD_SECTORS;
+                var->_read_ahead_first_sector = sector;
+                var->_read_ahead_count -= offset;
+                var->_p_sector_data = var->_p_read_ahead[var->_read_ahead_tail];
+                break;
+            }
+            
+            var->_read_ahead_count = 0;
+            
+            if (var->_is_stream_open && (var->_stream_next_sector == sector))
+            {
+                functionState = SM_WAIT_START_TOKEN;
+            }
+            else
+            {
+                var->_stream_last_sector = last_sector;
+                functionState = sd_card_is_stream_open(var) ? SM_STOP_STREAM : SM_CMD_18;
+            }
+            break;
+            
+        case SM_STOP_STREAM:
+            
+            if (!sd_card_stop_transmission(var))
+            {
+                functionState = SM_CMD_18;
+            }
+            break;
+            
+        case SM_CMD_18:
+            
+            if (!sd_card_read_multiple_block(var, sector))
+            {
+                if (!(var->response_command.R1.value & R1_RESPONSE_MASK_NORMAL_STATE) && var->response_command.is_response_returned)
+                {        
+                    var->_is_stream_open = true;
+                    var->_stream_next_sector = sector;
+                    functionState = SM_WAIT_START_TOKEN;
+                }
+                else
+                {
+                    functionState = SM_FAIL;
+                }
+            }
+            break;
+            
+        case SM_WAIT_START_TOKEN:
+            
+            if (!spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx))
+            {
+                if (var->_p_ram_rx[0] == SD_CARD_DATA_TOKEN)
+                {
+                    // The sector is received in the tail slot of the read-ahead ring (not in _p_ram_rx which is used by
+                    // CMD12 at the end of the run) and stays there until the next sector is requested.
+                    var->dma_rx_params.dst_start_addr = (void *) var->_p_read_ahead[var->_read_ahead_tail];
+                    functionState = SM_READ_DATA_PACKET;
+                }
+                else if (!(var->_p_ram_rx[0] & SD_CARD_MASK_ERROR_TOKEN))
+                {
+                    functionState = SM_FAIL;
+                }
+            }
+            break;
+            
+        case SM_READ_DATA_PACKET:
+            
+            if (!sd_card_read_data(var, SD_CARD_DATA_BLOCK_LENGTH, SPI_CS_DO_NOTHING, SPI_CS_DO_NOTHING))
+            {      
+                var->dma_rx_params.dst_start_addr = (void *) var->_p_ram_rx;
+                var->_p_sector_data = var->_p_read_ahead[var->_read_ahead_tail];
+                // The slot is held as a prefetched sector so that the read-ahead does not overwrite it.
+                var->_read_ahead_first_sector = sector;
+                var->_read_ahead_count = 1;
+                functionState = (++var->_stream_next_sector > var->_stream_last_sector) ? SM_END_OF_RUN : SM_FREE;
+            }
+            break;
+            
+        case SM_END_OF_RUN:
+            
+            if (!sd_card_stop_transmission(var))
+            {
+                functionState = SM_FREE;
+            }
+            break;
+            
+        case SM_FAIL:
+            
+            if (sd_card_is_stream_open(var))
+            {
+                sd_card_stop_transmission(var);
+            }
+            else if (++fail_count >= 10)
+            {
+                ports_set_bit(var->spi_cs);
+                functionState = SM_FREE;
+                SET_BIT(var->_flags, SM_SD_CARD_INITIALIZATION);
+            }
+            else
+            {
+                ports_set_bit(var->spi_cs);
+                mUpdateTick(functionTick);
+                functionState++;
+            }
+            break;
+            
+        default:
+            
+            if (mTickCompare(functionTick) >= TICK_1MS)
+            {
+                functionState = SM_CMD_18;
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_write_file_sector(sd_card_params_t *var, uint32_t sector, uint32_t last_sector, uint8_t *p_src)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_STOP_STREAM,
+        SM_CMD_55,
+        SM_ACMD_23,
+        SM_CMD_25,
+        SM_WRITE_DATA_PACKET,
+        SM_END_OF_RUN,
+        SM_FAIL
+    } functionState = 0;
+    static uint64_t functionTick = 0;
+    static uint8_t fail_count = 0;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            fail_count = 0;
+            var->_read_ahead_count = 0;
+            
+            if (var->_is_write_stream_open && (var->_write_stream_next_sector == sector))
+            {
+                functionState = SM_WRITE_DATA_PACKET;
+            }
+            else
+            {
+                functionState = sd_card_is_stream_open(var) ? SM_STOP_STREAM : SM_CMD_55;
+            }
+            break;
+            
+        case SM_STOP_STREAM:
+            
+            if (!sd_card_stop_transmission(var))
+            {
+                functionState = SM_CMD_55;
+            }
+            break;
+            
+        case SM_CMD_55:
+            
+            if (!sd_card_send_command(var, SD_CARD_CMD_55, 0x00000000, SD_CARD_RET_R1, SPI_CS_CLR, SPI_CS_DO_NOTHING))
+            {
+                functionState = (!(var->response_command.R1.value & R1_RESPONSE_MASK_NORMAL_STATE) && var->response_command.is_response_returned) ? SM_ACMD_23 : SM_FAIL;
+            }
+            break;
+            
+        case SM_ACMD_23:
+            
+            // Number of blocks to pre-erase before writing (the run can be stopped before its end).
+            if (!sd_card_send_command(var, SD_CARD_ACMD_23, (last_sector - sector + 1) & 0x007fffff, SD_CARD_RET_R1, SPI_CS_DO_NOTHING, SPI_CS_DO_NOTHING))
+            {
+                functionState = (!(var->response_command.R1.value & R1_RESPONSE_MASK_NORMAL_STATE) && var->response_command.is_response_returned) ? SM_CMD_25 : SM_FAIL;
+            }
+            break;
+            
+        case SM_CMD_25:
+            
+            if (!sd_card_send_command(var, SD_CARD_CMD_25, (var->args_type == SD_CARD_ARGS_TYPE_SECTOR) ? sector : (sector * 512), SD_CARD_RET_R1, SPI_CS_DO_NOTHING, SPI_CS_DO_NOTHING))
+            {
+                if (!(var->response_command.R1.value & R1_RESPONSE_MASK_NORMAL_STATE) && var->response_command.is_response_returned)
+                {        
+                    var->_is_write_stream_open = true;
+                    var->_write_stream_next_sector = sector;
+                    var->_write_stream_last_sector = last_sector;
+                    functionState = SM_WRITE_DATA_PACKET;
+                }
+                else
+                {
+                    functionState = SM_FAIL;
+                }
+            }
+            break;
+            
+        case SM_WRITE_DATA_PACKET:
+            
+            if (!sd_card_write_data(var, SD_CARD_DATA_TOKEN_MULTIPLE_WRITE, p_src))
+            {      
+                if (var->_data_response != SD_CARD_DATA_RESPONSE_ACCEPTED)
+                {
+                    functionState = SM_FAIL;
+                }
+                else if (++var->_write_stream_next_sector > var->_write_stream_last_sector)
+                {
+                    functionState = SM_END_OF_RUN;
+                }
+                else
+                {
+                    functionState = SM_FREE;
+                }
+            }
+            break;
+            
+        case SM_END_OF_RUN:
+            
+            if (!sd_card_stop_transmission(var))
+            {
+                functionState = SM_FREE;
+            }
+            break;
+            
+        case SM_FAIL:
+            
+            if (sd_card_is_stream_open(var))
+            {
+                sd_card_stop_transmission(var);
+            }
+            else if (++fail_count >= 10)
+            {
+                ports_set_bit(var->spi_cs);
+                functionState = SM_FREE;
+                SET_BIT(var->_flags, SM_SD_CARD_INITIALIZATION);
+                return SD_CARD_WRITE_FAIL;
+            }
+            else
+            {
+                ports_set_bit(var->spi_cs);
+                mUpdateTick(functionTick);
+                functionState++;
+            }
+            break;
+            
+        default:
+            
+            if (mTickCompare(functionTick) >= TICK_1MS)
+            {
+                functionState = SM_CMD_55;
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_read_ahead(sd_card_params_t *var)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_WAIT_START_TOKEN,
+        SM_WAIT_END_OF_SECTOR,
+        SM_STOP_STREAM
+    } functionState = 0;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            if (var->_is_stream_open && (var->_read_ahead_count < SD_CARD_READ_AHEAD_SECTORS) && (var->_stream_next_sector <= var->_stream_last_sector))
+            {
+                var->_is_read_ahead_on_going = true;
+                functionState = SM_WAIT_START_TOKEN;
+            }
+            break;
+            
+        case SM_WAIT_START_TOKEN:
+            
+            if (!spi_write_and_read_8(var->spi_id, 0xff, var->_p_ram_rx))
+            {
+                if (var->_p_ram_rx[0] == SD_CARD_DATA_TOKEN)
+                {
+                    // The sector is directly received in the next free slot of the ring.
+                    var->dma_rx_params.dst_start_addr = (void *) var->_p_read_ahead[(var->_read_ahead_tail + var->_read_ahead_count) % SD_CARD_READ_AHEAD_SECTORS];
+                    _start_data_reception(var, SD_CARD_DATA_BLOCK_LENGTH);
+                    functionState = SM_WAIT_END_OF_SECTOR;
+                }
+                else if (!(var->_p_ram_rx[0] & SD_CARD_MASK_ERROR_TOKEN))
+                {
+                    // The prefetch is dropped. The sector will be requested again by sd_card_read_file_sector().
+                    functionState = SM_STOP_STREAM;
+                }
+            }
+            break;
+            
+        case SM_WAIT_END_OF_SECTOR:
+            
+            if (sd_card_is_dma_rx_done(var))
+            {      
+                var->dma_rx_params.dst_start_addr = (void *) var->_p_ram_rx;
+                if (!var->_read_ahead_count)
+                {
+                    var->_read_ahead_first_sector = var->_stream_next_sector;
+                }
+                var->_read_ahead_count++;
+                
+                if (++var->_stream_next_sector > var->_stream_last_sector)
+                {
+                    functionState = SM_STOP_STREAM;
+                }
+                else if ((var->_read_ahead_count < SD_CARD_READ_AHEAD_SECTORS) && !var->_is_read_ahead_stop_requested)
+                {
+                    // The data token of the next sector is polled on the next calls (one byte per call).
+                    functionState = SM_WAIT_START_TOKEN;
+                }
+                else
+                {
+                    var->_is_read_ahead_on_going = false;
+                    functionState = SM_FREE;
+                }
+            }
+            break;
+            
+        case SM_STOP_STREAM:
+            
+            if (!sd_card_stop_transmission(var))
+            {
+                var->_is_read_ahead_on_going = false;
+                functionState = SM_FREE;
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_cache_write_back(sd_card_params_t *var, uint8_t index)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_WRITE_SECTOR
+    } functionState = 0;
+    static uint8_t __fat_copy = 0;
+    uint8_t ret;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            __fat_copy = 0;
+            functionState = SM_WRITE_SECTOR;
+            
+        case SM_WRITE_SECTOR:
+            
+            ret = sd_card_write_single_block(var, var->_cache_sector[index] + __fat_copy * var->boot_sector.number_of_sectors_per_fat, var->_p_cache[index]);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                // The sector stays dirty.
+                functionState = SM_FREE;
+                return SD_CARD_WRITE_FAIL;
+            }
+            else if (!ret)
+            {
+                // A sector of the FAT table is written in all the copies of the FAT.
+                bool is_fat_sector = (var->_cache_sector[index] >= var->boot_sector.fat_region_start) && (var->_cache_sector[index] < (var->boot_sector.fat_region_start + var->boot_sector.number_of_sectors_per_fat));
+                
+                if (!is_fat_sector || (++__fat_copy >= var->boot_sector.number_of_file_allocation_tables))
+                {
+                    CLR_BIT(var->_cache_is_dirty, index);
+                    functionState = SM_FREE;
+                }
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_cache_read(sd_card_params_t *var, uint32_t sector)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_WRITE_BACK,
+        SM_READ_SECTOR
+    } functionState = 0;
+    uint8_t i, ret;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            for (i = 0 ; i < SD_CARD_CACHE_SECTORS ; i++)
+            {
+                if (GET_BIT(var->_cache_is_valid, i) && (var->_cache_sector[i] == sector))
+                {
+                    var->_cache_index = i;
+                    var->_cache_next_victim = (i + 1) % SD_CARD_CACHE_SECTORS;
+                    return SM_FREE;
+                }
+            }
+            
+            var->_cache_index = var->_cache_next_victim;
+            for (i = 0 ; i < SD_CARD_CACHE_SECTORS ; i++)
+            {
+                if (!GET_BIT(var->_cache_is_valid, i))
+                {
+                    var->_cache_index = i;
+                    break;
+                }
+            }
+            functionState = GET_BIT(var->_cache_is_dirty, var->_cache_index) ? SM_WRITE_BACK : SM_READ_SECTOR;
+            break;
+            
+        case SM_WRITE_BACK:
+            
+            ret = sd_card_cache_write_back(var, var->_cache_index);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                // The victim cannot be released (it stays valid and dirty).
+                functionState = SM_FREE;
+                return SD_CARD_WRITE_FAIL;
+            }
+            else if (!ret)
+            {
+                CLR_BIT(var->_cache_is_valid, var->_cache_index);
+                functionState = SM_READ_SECTOR;
+            }
+            break;
+            
+        case SM_READ_SECTOR:
+            
+            if (!sd_card_read_single_block(var, sector))
+            {
+                memcpy(sd_card_cache_data(var), var->_p_ram_rx, 512);
+                var->_cache_sector[var->_cache_index] = sector;
+                SET_BIT(var->_cache_is_valid, var->_cache_index);
+                var->_cache_next_victim = (var->_cache_index + 1) % SD_CARD_CACHE_SECTORS;
+                functionState = SM_FREE;
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_cache_flush(sd_card_params_t *var)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_WRITE_BACK
+    } functionState = 0;
+    static uint8_t __index = 0;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            __index = 0;
+            functionState = SM_WRITE_BACK;
+            
+        case SM_WRITE_BACK:
+            
+            while ((__index < SD_CARD_CACHE_SECTORS) && !GET_BIT(var->_cache_is_dirty, __index))
+            {
+                __index++;
+            }
+            
+            if (__index >= SD_CARD_CACHE_SECTORS)
+            {
+                functionState = SM_FREE;
+            }
+            else if (sd_card_cache_write_back(var, __index) == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FREE;
+                return SD_CARD_WRITE_FAIL;
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_search_files(sd_card_params_t *var)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_SEARCH_FILES,
+        SM_READ_FAT_TABLE,
+        SM_END
+    } functionState = 0;
+    static uint32_t current_sector = 0;
+    static uint32_t current_fat_sector = 0;
+    uint8_t i;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            if (var->is_log_enable)
+            {
+                LOG_BLANCK("\nRoot Directories:"); 
+                LOG_BLANCK("Cluster . Index Sector in Cluster (max = Number of sector per cluster) / Index of Entry (Max 16 Entries per sector)"); 
+            }
+            _build_file_hash_table(var);
+            current_sector = var->boot_sector.root_directory_region_start;
+            functionState = SM_SEARCH_FILES;
+            
+        case SM_SEARCH_FILES:
+            
+            if (!sd_card_read_single_block(var, current_sector))
+            {
+                uint8_t ret = _search_and_sort_files(var, &current_sector);
+                if (!ret)               // ret == 0 and ret == 1 are used for both FAT16 & FAT32
+                {                                                            
+                    functionState = SM_END;
+                }
+                else if (ret == 2)      // ret == 2 is only used for FAT32
+                {   
+                    current_fat_sector = var->boot_sector.fat_region_start + (fat_file_system_get_cluster_of_sector_N(current_sector) / 128);
+                    uint16_t fat_table_cluster_index = (uint16_t) ((fat_file_system_get_cluster_of_sector_N(current_sector) % 128) * 4);
+                    
+                    if (var->is_log_enable)
+                    {
+                        LOG_BLANCK("        Read FAT Table: Last cluster %d / FAT Table sector where cluster is located: %d - index: %d (%x)", fat_file_system_get_cluster_of_sector_N(current_sector), current_fat_sector, fat_table_cluster_index, fat_table_cluster_index); 
+                    }
+                    
+                    functionState = SM_READ_FAT_TABLE;
+                }
+            }
+            break;
+            
+        case SM_READ_FAT_TABLE:
+            
+            // Read the FAT table from the last cluster value.             
+            if (!sd_card_read_single_block(var, current_fat_sector))
+            {  
+                uint16_t fat_table_cluster_index = (uint16_t) ((fat_file_system_get_cluster_of_sector_N(current_sector) % 128) * 4);
+                uint32_t next_cluster = (var->_p_ram_rx[fat_table_cluster_index + 0] << 0) | (var->_p_ram_rx[fat_table_cluster_index + 1] << 8) | (var->_p_ram_rx[fat_table_cluster_index + 2] << 16) | (var->_p_ram_rx[fat_table_cluster_index + 3] << 24);
+                if (next_cluster >= FAT32_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN)
+                {
+                    if (var->is_log_enable)
+                    {
+                        LOG_BLANCK("        No next cluster (value FAT Table >= 0x0FFFFFF8)"); 
+                    }
+                    
+                    functionState = SM_END;
+                }
+                else
+                {
+                    current_sector = fat_file_system_get_first_sector_of_cluster_N(next_cluster);                                
+
+                    if (var->is_log_enable)
+                    {
+                        LOG_BLANCK("        Next cluster %d / Start sector: %d", next_cluster, current_sector); 
+                    }
+
+                    functionState = SM_SEARCH_FILES;
+                }
+            }
+            break;
+            
+        case SM_END:
+            
+            if (var->is_log_enable) 
+            {            
+                for (i = 0 ; i < var->number_of_p_file ; i++)
+                {
+                    if(var->p_file[i]->flags.is_found)
+                    {
+                        LOG_BLANCK("File open: %s (%d bytes) - Starting Cluster: %d - Attributes: %2x - Last write: %2d/%2d/%4d at %2dh:%2dm:%2ds", p_string(&var->p_file[i]->file_name), var->p_file[i]->file_size, var->p_file[i]->first_cluster_of_the_file, var->p_file[i]->file_attributes.value, var->p_file[i]->last_write_date.day, var->p_file[i]->last_write_date.month, (var->p_file[i]->last_write_date.year + 1980), var->p_file[i]->last_write_time.hours, var->p_file[i]->last_write_time.minutes, var->p_file[i]->last_write_time.seconds);
+                    }
+                    else
+                    {
+                        LOG_BLANCK("File Not Found: %s", p_string(&var->p_file[i]->file_name));
+                    }
+                }
             }
             functionState = SM_FREE;
             break;
@@ -1254,143 +2178,871 @@ static uint8_t sd_card_search_files(sd_card_params_t *var)
         default:
             break;
     }
-        
+        
+    return functionState;
+}
+
+static int8_t _search_extent(fat_file_system_entry_t *file, uint32_t jump_index)
+{
+    // Binary search of the extent including the cluster "jump_index" of the file (-1 if this cluster is not in cache).
+    int8_t low = 0, high = file->_number_of_extents - 1;
+    
+    if (!file->_number_of_extents)
+    {
+        return -1;
+    }
+    
+    while (low < high)
+    {
+        int8_t middle = (low + high + 1) / 2;
+        
+        if (file->_extents[middle].first_jump_index <= jump_index)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    
+    return ((jump_index >= file->_extents[low].first_jump_index) && (jump_index < (file->_extents[low].first_jump_index + file->_extents[low].number_of_clusters))) ? low : -1;
+}
+
+static bool _add_cluster_to_extents(fat_file_system_entry_t *file, uint32_t jump_index, uint32_t cluster)
+{
+    fat_file_system_extent_t *p_extent = &file->_extents[(file->_number_of_extents > 0) ? (file->_number_of_extents - 1) : 0];
+    
+    if (!file->_number_of_extents)
+    {
+        p_extent->first_jump_index = jump_index;
+        p_extent->first_cluster = cluster;
+        p_extent->number_of_clusters = 1;
+        file->_number_of_extents = 1;
+    }
+    else if (jump_index != (p_extent->first_jump_index + p_extent->number_of_clusters))
+    {
+        return (_search_extent(file, jump_index) >= 0);
+    }
+    else if (cluster == (p_extent->first_cluster + p_extent->number_of_clusters))
+    {
+        p_extent->number_of_clusters++;
+    }
+    else if (file->_number_of_extents < FAT_FILE_SYSTEM_MAXIMUM_EXTENTS)
+    {
+        p_extent++;
+        p_extent->first_jump_index = jump_index;
+        p_extent->first_cluster = cluster;
+        p_extent->number_of_clusters = 1;
+        file->_number_of_extents++;
+    }
+    else
+    {
+        return false;
+    }
+    
+    return true;
+}
+
+static bool _set_current_data_sector(sd_card_params_t *var, fat_file_system_entry_t *file, uint32_t data_address)
+{
+    uint32_t jump_index = data_address / (var->boot_sector.number_of_bytes_per_sector * var->boot_sector.number_of_sectors_per_cluster);     // Number of "jump" (for a same file) to reach the good cluster in the FAT table (the FIRST cluster - start point in the FAT table - is always "file->first_cluster_of_the_file".
+    int8_t extent_index = _search_extent(file, jump_index);
+    
+    if (extent_index >= 0)
+    {
+        file->current_cluster_of_the_file = file->_extents[extent_index].first_cluster + (jump_index - file->_extents[extent_index].first_jump_index);
+        file->_current_jump_index = jump_index;
+    }
+    else if (file->_current_jump_index != jump_index)
+    {
+        // The cluster is not in cache: the FAT table is walked from the last known cluster (the end of the last extent
+        // or the current cluster if it is further and not beyond the expected cluster).
+        fat_file_system_extent_t *p_extent = &file->_extents[file->_number_of_extents - 1];
+        uint32_t last_jump_index_in_cache = p_extent->first_jump_index + p_extent->number_of_clusters - 1;
+        
+        if ((file->_current_jump_index < last_jump_index_in_cache) || (file->_current_jump_index > jump_index))
+        {
+            file->_current_jump_index = last_jump_index_in_cache;
+            file->current_cluster_of_the_file = p_extent->first_cluster + p_extent->number_of_clusters - 1;
+        }
+        
+        file->_current_fat_sector = fat_file_system_get_fat_sector_of_cluster_N(file->current_cluster_of_the_file);
+        return false;
+    }
+    
+    uint8_t sector_index_in_cluster = (data_address / var->boot_sector.number_of_bytes_per_sector) % var->boot_sector.number_of_sectors_per_cluster;     // Value between [0..Sectors Per Cluster]
+    file->_current_data_sector = sector_index_in_cluster + fat_file_system_get_first_sector_of_cluster_N(file->current_cluster_of_the_file);
+    file->_index_data_in_sector = data_address % var->boot_sector.number_of_bytes_per_sector;
+    return true;
+}
+
+static uint32_t _get_last_sector_of_run(sd_card_params_t *var, fat_file_system_entry_t *file, uint32_t data_address)
+{
+    // A run of contiguous sectors ends at the end of the current extent (or the current cluster if it is not in cache) or at the end of the file.
+    int8_t extent_index = _search_extent(file, file->_current_jump_index);
+    uint32_t last_cluster_of_run = (extent_index >= 0) ? (file->_extents[extent_index].first_cluster + file->_extents[extent_index].number_of_clusters - 1) : file->current_cluster_of_the_file;
+    uint32_t last_sector_of_run = fat_file_system_get_first_sector_of_cluster_N(last_cluster_of_run) + var->boot_sector.number_of_sectors_per_cluster - 1;
+    uint32_t last_sector_of_file = file->_current_data_sector + ((file->file_size - 1) / var->boot_sector.number_of_bytes_per_sector) - (data_address / var->boot_sector.number_of_bytes_per_sector);
+    
+    return (last_sector_of_file < last_sector_of_run) ? last_sector_of_file : last_sector_of_run;
+}
+
+static uint32_t _get_fat_entry(sd_card_params_t *var, uint8_t *p_fat_sector, uint32_t cluster)
+{
+    uint16_t index_fat_in_sector = ((var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? ((cluster % 128) * 4) : ((cluster % 256) * 2));                
+    
+    if (var->master_boot_record.partition_entry[0]._is_fat_32_partition)
+    {
+        return ((p_fat_sector[index_fat_in_sector + 0] << 0) | (p_fat_sector[index_fat_in_sector + 1] << 8) | (p_fat_sector[index_fat_in_sector + 2] << 16) | (p_fat_sector[index_fat_in_sector + 3] << 24)) & FAT32_FILE_SYSTEM_FAT_TABLE_CLUSTER_MASK;
+    }
+    return (p_fat_sector[index_fat_in_sector + 0] << 0) | (p_fat_sector[index_fat_in_sector + 1] << 8);
+}
+
+static void _set_fat_entry(sd_card_params_t *var, uint8_t *p_fat_sector, uint32_t cluster, uint32_t value)
+{
+    uint16_t index_fat_in_sector = ((var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? ((cluster % 128) * 4) : ((cluster % 256) * 2));                
+    
+    p_fat_sector[index_fat_in_sector + 0] = (value >> 0) & 0xff;
+    p_fat_sector[index_fat_in_sector + 1] = (value >> 8) & 0xff;
+    if (var->master_boot_record.partition_entry[0]._is_fat_32_partition)
+    {
+        p_fat_sector[index_fat_in_sector + 2] = (value >> 16) & 0xff;
+        p_fat_sector[index_fat_in_sector + 3] = (p_fat_sector[index_fat_in_sector + 3] & 0xf0) | ((value >> 24) & 0x0f);
+    }
+}
+
+static uint8_t sd_card_walk_fat_table(sd_card_params_t *var, fat_file_system_entry_t *file, uint32_t data_address)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_READ_FAT_TABLE
+    } functionState = 0;
+    uint8_t ret;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            functionState = SM_READ_FAT_TABLE;
+            
+        case SM_READ_FAT_TABLE:
+            
+            // Read the FAT table (through the cache) from the last known cluster value.             
+            ret = sd_card_cache_read(var, file->_current_fat_sector);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FREE;
+                return SD_CARD_WRITE_FAIL;
+            }
+            else if (!ret)
+            {  
+                uint32_t jump_index = data_address / fat_file_system_get_cluster_length();
+                uint32_t next_fat_sector = 0;
+                bool is_end_of_chain = false;
+                bool is_in_cache = false;
+                
+                // All the clusters linked in this sector of the FAT table are added to the cache (no more SD Card access).
+                do
+                {
+                    uint32_t next_cluster = _get_fat_entry(var, sd_card_cache_data(var), file->current_cluster_of_the_file);
+                    
+                    is_end_of_chain = fat_file_system_is_end_of_chain(next_cluster);
+                    if (is_end_of_chain)
+                    {
+                        break;
+                    }
+                    
+                    file->current_cluster_of_the_file = next_cluster;
+                    file->_current_jump_index++;
+                    is_in_cache = _add_cluster_to_extents(file, file->_current_jump_index, next_cluster);
+                    next_fat_sector = fat_file_system_get_fat_sector_of_cluster_N(next_cluster);
+                }
+                while ((next_fat_sector == file->_current_fat_sector) && (is_in_cache || (file->_current_jump_index < jump_index)));
+                
+                if ((file->_current_jump_index < jump_index) && !is_end_of_chain)
+                {
+                    file->_current_fat_sector = next_fat_sector;
+                }
+                else
+                {
+                    functionState = SM_FREE;
+                }
+            }
+            break;
+    }
+    
+    return functionState;
+}
+
+static uint8_t sd_card_read_file_data(sd_card_params_t *var)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_READ_FAT_TABLE,
+        SM_GET_FILE_DATA
+    } functionState = 0;
+        
+    static uint32_t __data_address = 0;               // [ 0 .. data_address .. (length_file - 1) ]
+    static uint32_t __data_length = 0;                // 1 .. length_file        
+    fat_file_system_entry_t *file = var->p_file[var->current_selected_file];
+    uint8_t ret;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            __data_address = file->_data_address;
+            __data_length = file->_data_length;
+            file->buffer.index = 0;
+            
+            if ((file->file_size > 0) && (__data_address <= (file->file_size - 1)))
+            {                
+                functionState = _set_current_data_sector(var, file, __data_address) ? SM_GET_FILE_DATA : SM_READ_FAT_TABLE;
+            }
+            else
+            {
+                functionState = SM_FREE;
+            }
+            break;
+            
+        case SM_READ_FAT_TABLE:
+            
+            ret = sd_card_walk_fat_table(var, file, __data_address);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                // A dirty sector of the cache cannot be written back: the read operation is terminated.
+                functionState = SM_FREE;
+            }
+            else if (!ret)
+            {  
+                // The end of the cluster chain is reached before the expected cluster: the read operation is terminated.
+                functionState = _set_current_data_sector(var, file, __data_address) ? SM_GET_FILE_DATA : SM_FREE;
+            }
+            break;
+            
+        case SM_GET_FILE_DATA:
+            
+            if (!sd_card_read_file_sector(var, file->_current_data_sector, _get_last_sector_of_run(var, file, __data_address)))
+            {   
+                uint16_t max_read_byte_in_sector = var->boot_sector.number_of_bytes_per_sector - file->_index_data_in_sector;
+                
+                if (__data_length >= max_read_byte_in_sector)
+                {
+                    memcpy(&file->buffer.p[file->buffer.index], &var->_p_sector_data[file->_index_data_in_sector], max_read_byte_in_sector);
+                    __data_length -= max_read_byte_in_sector;
+                    
+                    file->buffer.index += max_read_byte_in_sector;
+                    __data_address += max_read_byte_in_sector;                    
+                }                
+                else
+                {
+                    memcpy(&file->buffer.p[file->buffer.index], &var->_p_sector_data[file->_index_data_in_sector], __data_length);
+                    __data_length = 0;
+                }
+                
+                if (!__data_length)
+                {
+                    functionState = SM_FREE;
+                }
+                else
+                {
+                    functionState = _set_current_data_sector(var, file, __data_address) ? SM_GET_FILE_DATA : SM_READ_FAT_TABLE;
+                }
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    return functionState;
+}
+
+static bool _get_entry_short_name(const char *p_file_name, uint8_t *p_short_name)
+{
+    uint8_t i, j;
+    
+    //  Only a file of the root directory with a 8.3 name in lower case can be created (example: "movie.io" becomes "MOVIE   IO "). 
+    //  An upper case name (or a name without extension) would not be found by the next search of files (see _get_entry_full_name).
+    memset(p_short_name, ' ', 11);
+    for (i = 0 ; (p_file_name[i] != '\0') && (p_file_name[i] != '.') ; i++)
+    {
+        if ((i >= 8) || (p_file_name[i] == '\\') || (p_file_name[i] == ' ') || ((p_file_name[i] >= 65) && (p_file_name[i] <= 90)))
+        {
+            return false;
+        }
+        p_short_name[i] = ((p_file_name[i] >= 97) && (p_file_name[i] <= 122)) ? (p_file_name[i] - 32) : p_file_name[i];
+    }
+    
+    if (!i || (p_file_name[i] != '.') || (p_file_name[i + 1] == '\0'))
+    {
+        return false;
+    }
+    
+    for (i++, j = 0 ; p_file_name[i] != '\0' ; i++, j++)
+    {
+        if ((j >= 3) || (p_file_name[i] == '\\') || (p_file_name[i] == '.') || (p_file_name[i] == ' ') || ((p_file_name[i] >= 65) && (p_file_name[i] <= 90)))
+        {
+            return false;
+        }
+        p_short_name[8 + j] = ((p_file_name[i] >= 97) && (p_file_name[i] <= 122)) ? (p_file_name[i] - 32) : p_file_name[i];
+    }
+    
+    return true;
+}
+
+static void _trim_extents(fat_file_system_entry_t *file, uint32_t number_of_clusters)
+{
+    while ((file->_number_of_extents > 0) && (file->_extents[file->_number_of_extents - 1].first_jump_index >= number_of_clusters))
+    {
+        file->_number_of_extents--;
+    }
+    
+    if ((file->_number_of_extents > 0) && ((file->_extents[file->_number_of_extents - 1].first_jump_index + file->_extents[file->_number_of_extents - 1].number_of_clusters) > number_of_clusters))
+    {
+        file->_extents[file->_number_of_extents - 1].number_of_clusters = number_of_clusters - file->_extents[file->_number_of_extents - 1].first_jump_index;
+    }
+}
+
+static uint8_t sd_card_allocate_clusters(sd_card_params_t *var, fat_file_system_entry_t *file)
+{
+    static enum _functionState
+    {
+        SM_FREE = 0,
+        SM_SEARCH_FREE_CLUSTER,
+        SM_LINK_CLUSTER,
+        SM_MARK_END_OF_CHAIN
+    } functionState = 0;
+    static uint32_t __cluster = 0;
+    static uint32_t __last_cluster = 0;                     // Last cluster of the file (0 if the file has no cluster)
+    static uint32_t __number_of_scanned_clusters = 0;
+    static uint8_t __number_of_allocated_clusters = 0;
+    uint8_t ret;
+    uint32_t last_cluster_of_the_partition = 1 + (var->boot_sector.number_of_sectors_in_the_partition - (var->boot_sector.data_space_region_start - var->boot_sector.reserved_region_start)) / var->boot_sector.number_of_sectors_per_cluster;
+    
+    switch (functionState)
+    {
+        case SM_FREE:      
+            
+            // The last cluster of the file has to be the current cluster (file->current_cluster_of_the_file) before calling this routine.
+            __last_cluster = (file->_number_of_clusters > 0) ? file->current_cluster_of_the_file : 0;
+            __cluster = ((var->_next_free_cluster < 2) || (var->_next_free_cluster > last_cluster_of_the_partition)) ? 2 : var->_next_free_cluster;
+            __number_of_scanned_clusters = 0;
+            __number_of_allocated_clusters = 0;
+            functionState = SM_SEARCH_FREE_CLUSTER;
+            
+        case SM_SEARCH_FREE_CLUSTER:
+            
+            ret = sd_card_cache_read(var, fat_file_system_get_fat_sector_of_cluster_N(__cluster));
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FREE;
+                return SD_CARD_WRITE_FAIL;
+            }
+            else if (!ret)
+            {
+                uint32_t fat_sector = fat_file_system_get_fat_sector_of_cluster_N(__cluster);
+                
+                // Search a free cluster in the sector of the FAT table already read.
+                while ((fat_file_system_get_fat_sector_of_cluster_N(__cluster) == fat_sector) && (_get_fat_entry(var, sd_card_cache_data(var), __cluster) != FAT_FILE_SYSTEM_FAT_TABLE_FREE_CLUSTER))
+                {
+                    if (++__number_of_scanned_clusters >= (last_cluster_of_the_partition - 1))
+                    {
+                        // No more free cluster (the number of clusters of the file is not modified).
+                        functionState = SM_FREE;
+                        return functionState;
+                    }
+                    
+                    if (++__cluster > last_cluster_of_the_partition)
+                    {
+                        __cluster = 2;
+                    }
+                }
+                
+                if (fat_file_system_get_fat_sector_of_cluster_N(__cluster) == fat_sector)
+                {
+                    functionState = (__last_cluster > 0) ? SM_LINK_CLUSTER : SM_MARK_END_OF_CHAIN;
+                }
+            }
+            break;
+            
+        case SM_LINK_CLUSTER:
+            
+            ret = sd_card_cache_read(var, fat_file_system_get_fat_sector_of_cluster_N(__last_cluster));
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FREE;
+                return SD_CARD_WRITE_FAIL;
+            }
+            else if (!ret)
+            {
+                _set_fat_entry(var, sd_card_cache_data(var), __last_cluster, __cluster);
+                SET_BIT(var->_cache_is_dirty, var->_cache_index);
+                functionState = SM_MARK_END_OF_CHAIN;
+            }
+            break;
+            
+        case SM_MARK_END_OF_CHAIN:
+            
+            ret = sd_card_cache_read(var, fat_file_system_get_fat_sector_of_cluster_N(__cluster));
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FREE;
+                return SD_CARD_WRITE_FAIL;
+            }
+            else if (!ret)
+            {
+                _set_fat_entry(var, sd_card_cache_data(var), __cluster, (var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? FAT32_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN_MARK : FAT16_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN_MARK);
+                SET_BIT(var->_cache_is_dirty, var->_cache_index);
+                
+                if (!__last_cluster)
+                {
+                    file->first_cluster_of_the_file = __cluster;
+                    file->current_cluster_of_the_file = __cluster;
+                    file->_current_jump_index = 0;
+                }
+                _add_cluster_to_extents(file, file->_number_of_clusters, __cluster);
+                file->_number_of_clusters++;
+                __last_cluster = __cluster;
+                
+                if (++__cluster > last_cluster_of_the_partition)
+                {
+                    __cluster = 2;
+                }
+                var->_next_free_cluster = __cluster;
+                
+                if ((++__number_of_allocated_clusters >= SD_CARD_PREALLOCATED_CLUSTERS) || (++__number_of_scanned_clusters >= (last_cluster_of_the_partition - 1)))
+                {
+                    functionState = SM_FREE;
+                }
+                else
+                {
+                    functionState = SM_SEARCH_FREE_CLUSTER;
+                }
+            }
+            break;
+    }
+    
     return functionState;
 }
 
-static uint8_t sd_card_read_file_data(sd_card_params_t *var)
+static uint32_t _get_last_sector_of_write_run(sd_card_params_t *var, fat_file_system_entry_t *file)
+{
+    // A run of contiguous sectors ends at the end of the current extent (or the current cluster if it is not in cache).
+    int8_t extent_index = _search_extent(file, file->_current_jump_index);
+    uint32_t last_cluster_of_run = (extent_index >= 0) ? (file->_extents[extent_index].first_cluster + file->_extents[extent_index].number_of_clusters - 1) : file->current_cluster_of_the_file;
+    
+    return fat_file_system_get_first_sector_of_cluster_N(last_cluster_of_run) + var->boot_sector.number_of_sectors_per_cluster - 1;
+}
+
+static uint8_t sd_card_write_file_data(sd_card_params_t *var)
 {
     static enum _functionState
     {
         SM_FREE = 0,
-        SM_READ_FAT_TABLE,
-        SM_GET_FILE_DATA
+        SM_CREATE_ENTRY,
+        SM_WRITE_DATA,
+        SM_ALLOCATE_CLUSTERS,
+        SM_WALK_FAT_TABLE,
+        SM_FLUSH_TAIL_OF_OTHER_FILE,
+        SM_READ_TAIL,
+        SM_WRITE_SECTOR,
+        SM_RELEASE_CLUSTERS,
+        SM_CUT_CHAIN,
+        SM_FREE_CLUSTERS,
+        SM_FLUSH_TAIL,
+        SM_UPDATE_ENTRY,
+        SM_FLUSH_CACHE,
+        SM_STOP_STREAM,
+        SM_FAIL
     } functionState = 0;
-        
-    static uint32_t __data_address = 0;               // [ 0 .. data_address .. (length_file - 1) ]
-    static uint32_t __data_length = 0;                // 1 .. length_file        
+    
+    static uint8_t __return_state = 0;                  // State to return after walking the FAT table
+    static uint32_t __walk_address = 0;
+    static uint32_t __cluster_to_release = 0;
+    static bool __is_tail_written = false;
+    fat_file_system_entry_t *file = var->p_file[var->current_selected_file];
+    uint8_t ret;
+    uint32_t cluster_length = fat_file_system_get_cluster_length();
+    uint16_t bytes_per_sector = var->boot_sector.number_of_bytes_per_sector;
     
     switch (functionState)
     {
         case SM_FREE:      
             
-            __data_address = var->p_file[var->current_selected_file]->_data_address;
-            __data_length = var->p_file[var->current_selected_file]->_data_length;
-            var->p_file[var->current_selected_file]->buffer.index = 0;
-            
-            if (__data_address < (var->boot_sector.number_of_bytes_per_sector * var->boot_sector.number_of_sectors_per_cluster))
+            if (file->_write_op == FAT_FILE_SYSTEM_WRITE_OP_APPEND)
             {
-                var->p_file[var->current_selected_file]->_current_jump_index = 0;
-                var->p_file[var->current_selected_file]->current_cluster_of_the_file = var->p_file[var->current_selected_file]->first_cluster_of_the_file;
-            }
-            
-            if (__data_address <= (var->p_file[var->current_selected_file]->file_size - 1))
-            {                
-                uint32_t jump_index = __data_address / (var->boot_sector.number_of_bytes_per_sector * var->boot_sector.number_of_sectors_per_cluster);     // Number of "jump" (for a same file) to reach the good cluster in the FAT table (the FIRST cluster - start point in the FAT table - is always "var->p_file[var->current_selected_file]->first_cluster_of_the_file".                                
-                if (var->p_file[var->current_selected_file]->_current_jump_index != jump_index)
-                {   
-                    // In which sector of the FAT table the expected cluster is localized ?
-                    //      FAT16: ((uint32_t) (fat_region_start + current_cluster_value * 2 / bytes_per_sector))   // Cluster is 16-bit length
-                    //      FAT32: ((uint32_t) (fat_region_start + current_cluster_value * 4 / bytes_per_sector))   // Cluster is 32-bit length
-                    var->p_file[var->current_selected_file]->_current_fat_sector = ((uint32_t) (var->boot_sector.fat_region_start + var->p_file[var->current_selected_file]->current_cluster_of_the_file * ((var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? 4 : 2) / var->boot_sector.number_of_bytes_per_sector));
-                    var->p_file[var->current_selected_file]->_current_jump_index = jump_index;
-                    functionState = SM_READ_FAT_TABLE;
-                }
-                else
-                {                    
-                    uint8_t sector_index_in_cluster = (__data_address / var->boot_sector.number_of_bytes_per_sector) % var->boot_sector.number_of_sectors_per_cluster;     // Value between [0..Sectors Per Cluster]
-                    var->p_file[var->current_selected_file]->_current_data_sector = sector_index_in_cluster + fat_file_system_get_first_sector_of_cluster_N(var->p_file[var->current_selected_file]->current_cluster_of_the_file);
-                    var->p_file[var->current_selected_file]->_index_data_in_sector = __data_address % var->boot_sector.number_of_bytes_per_sector;
-                    functionState = SM_GET_FILE_DATA;
-                }
+                functionState = (file->flags.is_found) ? SM_WRITE_DATA : SM_CREATE_ENTRY;
             }
-            else
+            else if (file->flags.is_found)
             {
-                functionState = SM_FREE;
+                functionState = (file->_write_op == FAT_FILE_SYSTEM_WRITE_OP_CLOSE) ? SM_RELEASE_CLUSTERS : SM_FLUSH_TAIL;
             }
             break;
             
-        case SM_READ_FAT_TABLE:
+        case SM_CREATE_ENTRY:
             
-            // Read the FAT table from the last cluster value.             
-            if (!sd_card_read_single_block(var, var->p_file[var->current_selected_file]->_current_fat_sector))
-            {  
-                uint16_t index_fat_in_sector = ((var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? ((var->p_file[var->current_selected_file]->current_cluster_of_the_file % 128) * 4) : ((var->p_file[var->current_selected_file]->current_cluster_of_the_file % 256) * 2));                
-                var->p_file[var->current_selected_file]->current_cluster_of_the_file = (var->_p_ram_rx[index_fat_in_sector + 0] << 0) | (var->_p_ram_rx[index_fat_in_sector + 1] << 8) | ((var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? ((var->_p_ram_rx[index_fat_in_sector + 2] << 16) | (var->_p_ram_rx[index_fat_in_sector + 3] << 24)) : 0);
+            if (!var->_free_root_entry_sector)
+            {
+                functionState = SM_FAIL;
+                break;
+            }
+            ret = sd_card_cache_read(var, var->_free_root_entry_sector);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                uint8_t *p_entry = &sd_card_cache_data(var)[var->_free_root_entry_index * 32];
                 
-                if (var->master_boot_record.partition_entry[0]._is_fat_32_partition)
-                {
-                    if (var->p_file[var->current_selected_file]->current_cluster_of_the_file >= FAT32_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN)
-                    {
-                        functionState = SM_FREE;
-                    }
-                }
-                else
+                memset(p_entry, 0, 32);
+                _get_entry_short_name(file->file_name, p_entry);
+                p_entry[0x0b] = FAT_FILE_SYSTEME_FA_ARCHIVE;
+                p_entry[0x10] = 0x21;       // Creation date: 01/01/1980 (no real time clock)
+                p_entry[0x18] = 0x21;       // Last write date: 01/01/1980 (no real time clock)
+                SET_BIT(var->_cache_is_dirty, var->_cache_index);
+                
+                file->flags.is_found = true;
+                file->file_attributes.value = FAT_FILE_SYSTEME_FA_ARCHIVE;
+                file->last_write_date.value = 0x0021;
+                file->first_cluster_of_the_file = 0;
+                file->file_size = 0;
+                file->current_cluster_of_the_file = 0;
+                file->_current_jump_index = 0;
+                file->_number_of_extents = 0;
+                file->_number_of_clusters = 0;
+                file->_directory_entry_sector = var->_free_root_entry_sector;
+                file->_directory_entry_index = var->_free_root_entry_index;
+                var->number_of_file++;
+                
+                // The next entry is free if it is in the same cluster (FAT32) or in the root directory region (FAT16).
+                if (++var->_free_root_entry_index >= (bytes_per_sector / 32))
                 {
-                    if (var->p_file[var->current_selected_file]->current_cluster_of_the_file >= FAT16_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN)
+                    var->_free_root_entry_index = 0;
+                    var->_free_root_entry_sector++;
+                    if (    (var->master_boot_record.partition_entry[0]._is_fat_32_partition && !fat_file_system_get_sector_index_in_cluster(var->_free_root_entry_sector)) ||
+                            (!var->master_boot_record.partition_entry[0]._is_fat_32_partition && (var->_free_root_entry_sector >= var->boot_sector.data_space_region_start)))
                     {
-                        functionState = SM_FREE;
+                        var->_free_root_entry_sector = 0;
                     }
                 }
                 
-                if (functionState != SM_FREE)
+                if (var->is_log_enable)
                 {
-                    uint8_t sector_index_in_cluster = (__data_address / var->boot_sector.number_of_bytes_per_sector) % var->boot_sector.number_of_sectors_per_cluster;     // Value between [0..Sectors Per Cluster]
-                    var->p_file[var->current_selected_file]->_current_data_sector = sector_index_in_cluster + fat_file_system_get_first_sector_of_cluster_N(var->p_file[var->current_selected_file]->current_cluster_of_the_file);
-                    var->p_file[var->current_selected_file]->_index_data_in_sector = __data_address % var->boot_sector.number_of_bytes_per_sector;
-                    functionState = SM_GET_FILE_DATA;
+                    LOG_BLANCK("File created: %s", p_string(file->file_name));
                 }
+                functionState = SM_WRITE_DATA;
             }
             break;
             
-        case SM_GET_FILE_DATA:
+        case SM_WRITE_DATA:
             
-            if (!sd_card_read_single_block(var, var->p_file[var->current_selected_file]->_current_data_sector))
-            {   
-                uint16_t max_read_byte_in_sector = var->boot_sector.number_of_bytes_per_sector - var->p_file[var->current_selected_file]->_index_data_in_sector;
-                
-                if (__data_length >= max_read_byte_in_sector)
+            if (!file->_write_length)
+            {
+                functionState = SM_FREE;
+            }
+            else if (!(file->file_size % bytes_per_sector) && ((file->file_size / cluster_length) >= file->_number_of_clusters))
+            {
+                // New clusters are linked after the last cluster of the file.
+                if ((file->_number_of_clusters > 0) && !_set_current_data_sector(var, file, (file->_number_of_clusters - 1) * cluster_length))
                 {
-                    memcpy(&var->p_file[var->current_selected_file]->buffer.p[var->p_file[var->current_selected_file]->buffer.index], &var->_p_ram_rx[var->p_file[var->current_selected_file]->_index_data_in_sector], max_read_byte_in_sector);
-                    __data_length -= max_read_byte_in_sector;
-                    
-                    var->p_file[var->current_selected_file]->buffer.index += max_read_byte_in_sector;
-                    __data_address += max_read_byte_in_sector;                    
-                }                
+                    __walk_address = (file->_number_of_clusters - 1) * cluster_length;
+                    __return_state = SM_WRITE_DATA;
+                    functionState = SM_WALK_FAT_TABLE;
+                }
                 else
                 {
-                    memcpy(&var->p_file[var->current_selected_file]->buffer.p[var->p_file[var->current_selected_file]->buffer.index], &var->_p_ram_rx[var->p_file[var->current_selected_file]->_index_data_in_sector], __data_length);
-                    __data_length = 0;
+                    functionState = SM_ALLOCATE_CLUSTERS;
+                }
+            }
+            else if (!_set_current_data_sector(var, file, file->file_size))
+            {
+                __walk_address = file->file_size;
+                __return_state = SM_WRITE_DATA;
+                functionState = SM_WALK_FAT_TABLE;
+            }
+            else if (!file->_index_data_in_sector && (file->_write_length >= bytes_per_sector))
+            {
+                // A full sector is directly written from the source buffer.
+                if (var->_p_tail_file == file)
+                {
+                    var->_p_tail_file = NULL;
+                }
+                __is_tail_written = false;
+                functionState = SM_WRITE_SECTOR;
+            }
+            else if ((var->_p_tail_file != file) || (var->_tail_sector != file->_current_data_sector))
+            {
+                if ((var->_p_tail_file != NULL) && var->_is_tail_dirty)
+                {
+                    functionState = SM_FLUSH_TAIL_OF_OTHER_FILE;
+                }
+                else if (file->_index_data_in_sector > 0)
+                {
+                    functionState = SM_READ_TAIL;
+                }
+                else
+                {
+                    memset(var->_p_ram_tail, 0, bytes_per_sector);
+                    var->_p_tail_file = file;
+                    var->_tail_sector = file->_current_data_sector;
+                    var->_is_tail_dirty = false;
                 }
+            }
+            else
+            {
+                // The data are added to the partially filled sector (written when it is full or on sync / close).
+                uint16_t length = ((bytes_per_sector - file->_index_data_in_sector) < file->_write_length) ? (bytes_per_sector - file->_index_data_in_sector) : file->_write_length;
                 
-                if (!__data_length)
+                memcpy(&var->_p_ram_tail[file->_index_data_in_sector], file->_p_write_data, length);
+                file->_p_write_data += length;
+                file->_write_length -= length;
+                file->file_size += length;
+                var->_is_tail_dirty = true;
+                
+                if ((file->_index_data_in_sector + length) >= bytes_per_sector)
                 {
-                    functionState = SM_FREE;
+                    __is_tail_written = true;
+                    functionState = SM_WRITE_SECTOR;
+                }
+            }
+            break;
+            
+        case SM_ALLOCATE_CLUSTERS:
+            
+            ret = sd_card_allocate_clusters(var, file);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                // The SD Card is full if no cluster has been linked to the file.
+                functionState = ((file->file_size / cluster_length) < file->_number_of_clusters) ? SM_WRITE_DATA : SM_FAIL;
+            }
+            break;
+            
+        case SM_WALK_FAT_TABLE:
+            
+            ret = sd_card_walk_fat_table(var, file, __walk_address);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                functionState = _set_current_data_sector(var, file, __walk_address) ? __return_state : SM_FAIL;
+            }
+            break;
+            
+        case SM_FLUSH_TAIL_OF_OTHER_FILE:
+            
+            ret = sd_card_write_single_block(var, var->_tail_sector, var->_p_ram_tail);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                var->_is_tail_dirty = false;
+                var->_p_tail_file = NULL;
+                functionState = SM_WRITE_DATA;
+            }
+            break;
+            
+        case SM_READ_TAIL:
+            
+            if (!sd_card_read_single_block(var, file->_current_data_sector))
+            {
+                memcpy(var->_p_ram_tail, var->_p_ram_rx, bytes_per_sector);
+                var->_p_tail_file = file;
+                var->_tail_sector = file->_current_data_sector;
+                var->_is_tail_dirty = false;
+                functionState = SM_WRITE_DATA;
+            }
+            break;
+            
+        case SM_WRITE_SECTOR:
+            
+            ret = sd_card_write_file_sector(var, file->_current_data_sector, _get_last_sector_of_write_run(var, file), (__is_tail_written) ? var->_p_ram_tail : file->_p_write_data);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                if (__is_tail_written)
+                {
+                    var->_is_tail_dirty = false;
                 }
                 else
                 {
-                    uint32_t jump_index = __data_address / (var->boot_sector.number_of_bytes_per_sector * var->boot_sector.number_of_sectors_per_cluster);     // Number of "jump" (for a same file) to reach the good cluster in the FAT table (the FIRST cluster - start point in the FAT table - is always "var->p_file[var->current_selected_file]->first_cluster_of_the_file".                                
-                    if (var->p_file[var->current_selected_file]->_current_jump_index != jump_index)
-                    {   
-                        // In which sector of the FAT table the expected cluster is localized ?
-                        //      FAT16: ((uint32_t) (fat_region_start + current_cluster_value * 2 / bytes_per_sector))   // Cluster is 16-bit length
-                        //      FAT32: ((uint32_t) (fat_region_start + current_cluster_value * 4 / bytes_per_sector))   // Cluster is 32-bit length
-                        var->p_file[var->current_selected_file]->_current_fat_sector = ((uint32_t) (var->boot_sector.fat_region_start + var->p_file[var->current_selected_file]->current_cluster_of_the_file * ((var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? 4 : 2) / var->boot_sector.number_of_bytes_per_sector));
-                        var->p_file[var->current_selected_file]->_current_jump_index = jump_index;
-                        functionState = SM_READ_FAT_TABLE;
-                    }
-                    else
-                    {                    
-                        uint8_t sector_index_in_cluster = (__data_address / var->boot_sector.number_of_bytes_per_sector) % var->boot_sector.number_of_sectors_per_cluster;     // Value between [0..Sectors Per Cluster]
-                        var->p_file[var->current_selected_file]->_current_data_sector = sector_index_in_cluster + fat_file_system_get_first_sector_of_cluster_N(var->p_file[var->current_selected_file]->current_cluster_of_the_file);
-                        var->p_file[var->current_selected_file]->_index_data_in_sector = __data_address % var->boot_sector.number_of_bytes_per_sector;
-                        functionState = SM_GET_FILE_DATA;
+                    file->_p_write_data += bytes_per_sector;
+                    file->_write_length -= bytes_per_sector;
+                    file->file_size += bytes_per_sector;
+                }
+                functionState = SM_WRITE_DATA;
+            }
+            break;
+            
+        case SM_RELEASE_CLUSTERS:
+            
+            // The pre-allocated clusters not used are released (number of clusters used = file_size / cluster_length rounded up).
+            if (file->_number_of_clusters <= ((file->file_size + cluster_length - 1) / cluster_length))
+            {
+                functionState = SM_FLUSH_TAIL;
+            }
+            else if (!file->file_size)
+            {
+                __cluster_to_release = file->first_cluster_of_the_file;
+                file->first_cluster_of_the_file = 0;
+                file->current_cluster_of_the_file = 0;
+                file->_current_jump_index = 0;
+                file->_number_of_clusters = 0;
+                file->_number_of_extents = 0;
+                functionState = SM_FREE_CLUSTERS;
+            }
+            else if (!_set_current_data_sector(var, file, file->file_size - 1))
+            {
+                __walk_address = file->file_size - 1;
+                __return_state = SM_RELEASE_CLUSTERS;
+                functionState = SM_WALK_FAT_TABLE;
+            }
+            else
+            {
+                functionState = SM_CUT_CHAIN;
+            }
+            break;
+            
+        case SM_CUT_CHAIN:
+            
+            ret = sd_card_cache_read(var, fat_file_system_get_fat_sector_of_cluster_N(file->current_cluster_of_the_file));
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                __cluster_to_release = _get_fat_entry(var, sd_card_cache_data(var), file->current_cluster_of_the_file);
+                _set_fat_entry(var, sd_card_cache_data(var), file->current_cluster_of_the_file, (var->master_boot_record.partition_entry[0]._is_fat_32_partition) ? FAT32_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN_MARK : FAT16_FILE_SYSTEM_FAT_TABLE_END_OF_CHAIN_MARK);
+                SET_BIT(var->_cache_is_dirty, var->_cache_index);
+                file->_number_of_clusters = file->_current_jump_index + 1;
+                _trim_extents(file, file->_number_of_clusters);
+                functionState = SM_FREE_CLUSTERS;
+            }
+            break;
+            
+        case SM_FREE_CLUSTERS:
+            
+            if ((__cluster_to_release < 2) || fat_file_system_is_end_of_chain(__cluster_to_release))
+            {
+                functionState = SM_FLUSH_TAIL;
+                break;
+            }
+            ret = sd_card_cache_read(var, fat_file_system_get_fat_sector_of_cluster_N(__cluster_to_release));
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                uint32_t fat_sector = fat_file_system_get_fat_sector_of_cluster_N(__cluster_to_release);
+                
+                // All the clusters of the chain localized in this sector of the FAT table are released.
+                do
+                {
+                    uint32_t next_cluster = _get_fat_entry(var, sd_card_cache_data(var), __cluster_to_release);
+                    
+                    _set_fat_entry(var, sd_card_cache_data(var), __cluster_to_release, FAT_FILE_SYSTEM_FAT_TABLE_FREE_CLUSTER);
+                    if (__cluster_to_release < var->_next_free_cluster)
+                    {
+                        var->_next_free_cluster = __cluster_to_release;
                     }
+                    __cluster_to_release = next_cluster;
                 }
+                while ((__cluster_to_release >= 2) && !fat_file_system_is_end_of_chain(__cluster_to_release) && (fat_file_system_get_fat_sector_of_cluster_N(__cluster_to_release) == fat_sector));
+                SET_BIT(var->_cache_is_dirty, var->_cache_index);
             }
             break;
             
-        default:
+        case SM_FLUSH_TAIL:
+            
+            if ((var->_p_tail_file != file) || !var->_is_tail_dirty)
+            {
+                functionState = SM_UPDATE_ENTRY;
+                break;
+            }
+            ret = sd_card_write_single_block(var, var->_tail_sector, var->_p_ram_tail);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                var->_is_tail_dirty = false;
+                functionState = SM_UPDATE_ENTRY;
+            }
+            break;
+            
+        case SM_UPDATE_ENTRY:
+            
+            ret = sd_card_cache_read(var, file->_directory_entry_sector);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                uint8_t *p_entry = &sd_card_cache_data(var)[file->_directory_entry_index * 32];
+                
+                p_entry[0x0b] |= FAT_FILE_SYSTEME_FA_ARCHIVE;
+                p_entry[0x14] = (file->first_cluster_of_the_file >> 16) & 0xff;
+                p_entry[0x15] = (file->first_cluster_of_the_file >> 24) & 0xff;
+                p_entry[0x1a] = (file->first_cluster_of_the_file >> 0) & 0xff;
+                p_entry[0x1b] = (file->first_cluster_of_the_file >> 8) & 0xff;
+                p_entry[0x1c] = (file->file_size >> 0) & 0xff;
+                p_entry[0x1d] = (file->file_size >> 8) & 0xff;
+                p_entry[0x1e] = (file->file_size >> 16) & 0xff;
+                p_entry[0x1f] = (file->file_size >> 24) & 0xff;
+                SET_BIT(var->_cache_is_dirty, var->_cache_index);
+                functionState = SM_FLUSH_CACHE;
+            }
+            break;
+            
+        case SM_FLUSH_CACHE:
+            
+            ret = sd_card_cache_flush(var);
+            if (ret == SD_CARD_WRITE_FAIL)
+            {
+                functionState = SM_FAIL;
+            }
+            else if (!ret)
+            {
+                functionState = SM_STOP_STREAM;
+            }
+            break;
+            
+        case SM_STOP_STREAM:
+            
+            // The multi-block write is stopped so that all the data are programmed in the SD Card.
+            if (!sd_card_is_stream_open(var) || !sd_card_stop_transmission(var))
+            {
+                functionState = SM_FREE;
+            }
+            break;
+            
+        case SM_FAIL:
+            
+            if (var->is_log_enable)
+            {
+                LOG_BLANCK("Write Fail: %s", p_string(file->file_name));
+            }
+            file->flags.is_write_block_op = FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_FAILED;
+            functionState = SM_FREE;
             break;
     }
     
@@ -1409,6 +3061,7 @@ void sd_card_deamon(sd_card_params_t *var)
         
         var->dma_tx_id = dma_get_free_channel();
         var->dma_rx_id = dma_get_free_channel();
+        p_sd_card_of_dma_rx[var->dma_rx_id] = var;
         
         spi_init(   var->spi_id, 
                     NULL, 
@@ -1425,7 +3078,7 @@ void sd_card_deamon(sd_card_params_t *var)
                     0xff);
         
         dma_init(   var->dma_rx_id, 
-                    NULL, 
+                    _sd_card_dma_rx_event_handler, 
                     DMA_CONT_PRIO_3, 
                     DMA_INT_BLOCK_TRANSFER_DONE, 
                     DMA_EVT_START_TRANSFER_ON_IRQ, 
@@ -1534,6 +3187,23 @@ void sd_card_deamon(sd_card_params_t *var)
             
         case SM_SD_CARD_READ_OPERATION_PREPARATION:
             
+            if (var->_is_read_ahead_on_going)
+            {
+                // A prefetched sector is being received: it has to be completed before serving any request (no next 
+                // sector is prefetched if a request is pending).
+                for (i = 0 ; i < var->number_of_p_file ; i++)
+                {
+                    if (    (var->p_file[i]->flags.is_read_block_op == FAT_FILE_SYSTEM_FLAG_READ_BLOCK_OP_READ_REQUESTED) ||
+                            (var->p_file[i]->flags.is_write_block_op == FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_REQUESTED))
+                    {
+                        break;
+                    }
+                }
+                var->_is_read_ahead_stop_requested = (i < var->number_of_p_file);
+                sd_card_read_ahead(var);
+                break;
+            }
+            
             for (i = (var->current_selected_file == 0xff) ? 0 : (var->current_selected_file + 1) ; i < var->number_of_p_file ; i++)                               
             {
                 if (var->p_file[i]->flags.is_read_block_op == FAT_FILE_SYSTEM_FLAG_READ_BLOCK_OP_READ_REQUESTED)
@@ -1543,10 +3213,18 @@ void sd_card_deamon(sd_card_params_t *var)
                     var->_sm.index = SM_SD_CARD_READ_OPERATION;
                     break;
                 }
+                else if (var->p_file[i]->flags.is_write_block_op == FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_REQUESTED)
+                {
+                    var->current_selected_file = i;
+                    var->p_file[i]->flags.is_write_block_op = FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_ON_GOING;
+                    var->_sm.index = SM_SD_CARD_WRITE_OPERATION;
+                    break;
+                }
             }
             if (i >= var->number_of_p_file)
             {
                 var->current_selected_file = 0xff;
+                sd_card_read_ahead(var);
 //                CLR_BIT(var->_flags, SM_SD_CARD_READ_OPERATION_PREPARATION);
 //                var->_sm.index = SM_SD_CARD_HOME;
             }
@@ -1560,6 +3238,18 @@ void sd_card_deamon(sd_card_params_t *var)
                 var->_sm.index = SM_SD_CARD_READ_OPERATION_PREPARATION;
             }
             break;
+            
+        case SM_SD_CARD_WRITE_OPERATION:
+            
+            if (!sd_card_write_file_data(var))
+            {
+                if (var->p_file[var->current_selected_file]->flags.is_write_block_op == FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_ON_GOING)
+                {
+                    var->p_file[var->current_selected_file]->flags.is_write_block_op = FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_TERMINATED;
+                }
+                var->_sm.index = SM_SD_CARD_READ_OPERATION_PREPARATION;
+            }
+            break;
                         
     }
 }
@@ -1673,3 +3363,58 @@ uint8_t sd_card_read_play_file(fat_file_system_entry_t *file, uint8_t *p_dst, ui
     
     return 0xff;
 }
+
+static uint8_t _sd_card_write_file_request(fat_file_system_entry_t *file, FAT_FILE_SYSTEM_WRITE_OP_TYPE write_op, uint8_t *p_src, uint32_t block_length)
+{
+    sd_card_params_t *var = (sd_card_params_t *) file->p_sd_card;
+    
+    switch (file->sm_write.index)
+    {
+        case 0:
+
+            file->_write_op = write_op;
+            file->_p_write_data = p_src;
+            file->_write_length = block_length;
+            file->flags.is_write_block_op = FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_REQUESTED;
+            SET_BIT(var->_flags, SM_SD_CARD_READ_OPERATION_PREPARATION);
+            file->sm_write.index = 1;
+            break;
+
+        case 1:
+
+            if (file->flags.is_write_block_op == FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_TERMINATED)
+            {
+                file->sm_write.index = 0;
+            }
+            else if (file->flags.is_write_block_op == FAT_FILE_SYSTEM_FLAG_WRITE_BLOCK_OP_WRITE_FAILED)
+            {
+                file->sm_write.index = 0;
+                return 0xff;
+            }
+            break;
+    }   
+    
+    return file->sm_write.index;
+}
+
+uint8_t sd_card_write_block_file(fat_file_system_entry_t *file, uint8_t *p_src, uint32_t block_length)
+{
+    uint8_t short_name[11];
+    
+    if (!file->flags.is_found && !_get_entry_short_name(file->file_name, short_name))
+    {
+        return 0xff;
+    }
+    
+    return _sd_card_write_file_request(file, FAT_FILE_SYSTEM_WRITE_OP_APPEND, p_src, block_length);
+}
+
+uint8_t sd_card_sync_file(fat_file_system_entry_t *file)
+{
+    return _sd_card_write_file_request(file, FAT_FILE_SYSTEM_WRITE_OP_SYNC, NULL, 0);
+}
+
+uint8_t sd_card_close_file(fat_file_system_entry_t *file)
+{
+    return _sd_card_write_file_request(file, FAT_FILE_SYSTEM_WRITE_OP_CLOSE, NULL, 0);
+}
@@ -5,6 +5,11 @@
 #define SD_CARD_FREQ                            10000000    // Can be set up to 25 MHz
 
 #define SD_CARD_MAXIMUM_FILE                    120
+#define SD_CARD_FILE_HASH_TABLE_SIZE            256         // Power of 2 (at least 2 x SD_CARD_MAXIMUM_FILE)
+#define SD_CARD_FOLDER_HASH_TABLE_SIZE          64          // Power of 2
+#define SD_CARD_READ_AHEAD_SECTORS              4           // Number of sectors prefetched (multi-block read - CMD18) while the caller consumes the current ones
+#define SD_CARD_CACHE_SECTORS                   2           // Number of FAT / directory sectors kept in RAM (write-back cache flushed on sync / close)
+#define SD_CARD_PREALLOCATED_CLUSTERS           16          // Number of clusters linked at once to a file when more space is needed (released on close if not used)
 
 typedef enum
 {
@@ -17,7 +22,8 @@ typedef enum
     SM_SD_CARD_PARTITION_BOOT_SECTOR,
     SM_SD_CARD_ROOT_DIRECTORY,
     SM_SD_CARD_READ_OPERATION_PREPARATION,
-    SM_SD_CARD_READ_OPERATION,                  // Lower priority
+    SM_SD_CARD_READ_OPERATION,
+    SM_SD_CARD_WRITE_OPERATION,                 // Lower priority
             
     SM_SD_CARD_MAX_FLAGS,
     SM_SD_CARD_END
@@ -64,12 +70,17 @@ typedef enum
     SD_CARD_VER_2_X_SDHC                        = 3,                                // SD Card Ver2.X or Later SDHC / SDXC
 } SD_CARD_VERSION;
 
-#define SD_CARD_DATA_TOKEN                      0xfe                                // DATA TOKEN for CMD9/10/17/18/19
+#define SD_CARD_DATA_TOKEN                      0xfe                                // DATA TOKEN for CMD9/10/17/18/19/24
+#define SD_CARD_DATA_TOKEN_MULTIPLE_WRITE       0xfc                                // DATA TOKEN for CMD25
+#define SD_CARD_STOP_TRAN_TOKEN                 0xfd                                // STOP TRANSMISSION TOKEN for CMD25
+#define SD_CARD_MASK_DATA_RESPONSE              0x1f
+#define SD_CARD_DATA_RESPONSE_ACCEPTED          0x05
 #define SD_CARD_MASK_ERROR_TOKEN                0x1f
 #define SD_CARD_DATA_BLOCK_LENGTH               514                                 // 512 bytes of usefull data + 2 CRC bytes
 #define SD_CARD_END_OF_DATA_BLOCK               0xaa55                              // 2 characters to ends a data packet (510 bytes + 2 characters byte EoP - End of Packet)
 #define SD_CARD_CID_LENGTH                      18                                  // 16 bytes of usedfull data + 2 CRC bytes
 #define SD_CARD_CSD_LENGTH                      18                                  // 16 bytes of usedfull data + 2 CRC bytes
+#define SD_CARD_WRITE_FAIL                      0xff                                // Returned by the routines writing a sector (directly or through the cache) after 10 failures
 
 // Manufacturer ID is present in CID register (get CID just after the Initialization)
 typedef enum
@@ -236,14 +247,54 @@ typedef struct
     uint8_t                                     number_of_p_file;
     uint8_t                                     current_selected_file;
     
+    uint8_t                                     _file_hash_table[SD_CARD_FILE_HASH_TABLE_SIZE];     // Index + 1 in p_file of the opened files (linear probing on the hash of the full path - 0: empty slot)
+    uint32_t                                    _file_hash[SD_CARD_MAXIMUM_FILE];                   // Hash of the full path of each opened file
+    uint32_t                                    _folder_hash_table[SD_CARD_FOLDER_HASH_TABLE_SIZE]; // Hash of the folders including an opened file (0: empty slot)
+    bool                                        _is_folder_hash_table_full;                         // All the folders are explored
+    uint8_t                                     _number_of_file_not_found;
+    
     uint8_t                                     *_p_ram_tx;
     uint8_t                                     *_p_ram_rx;
+    uint8_t                                     *_p_sector_data;                    // Data of the last sector read by sd_card_read_file_sector (_p_ram_rx or a read ahead slot)
+    
+    bool                                        _is_stream_open;                    // A multi-block read (CMD18) is on going (CS is kept low)
+    uint32_t                                    _stream_next_sector;                // Next sector sent by the card in the multi-block read
+    uint32_t                                    _stream_last_sector;                // Last sector of the contiguous run (the multi-block read is stopped with CMD12 after it)
+    uint8_t                                     (*_p_read_ahead)[512+2];            // Ring of prefetched sectors [_read_ahead_first_sector .. _read_ahead_first_sector + _read_ahead_count - 1]
+    uint32_t                                    _read_ahead_first_sector;
+    uint8_t                                     _read_ahead_tail;
+    uint8_t                                     _read_ahead_count;
+    bool                                        _is_read_ahead_on_going;
+    
+    volatile bool                               _is_dma_rx_done;                    // Block Transfer Done of the Rx DMA channel (set by the DMA interrupt)
+    bool                                        _is_read_ahead_stop_requested;      // No sector is prefetched after the current one (a request is pending)
+    
+    bool                                        _is_write_stream_open;              // A multi-block write (CMD25) is on going (CS is kept low)
+    uint32_t                                    _write_stream_next_sector;
+    uint32_t                                    _write_stream_last_sector;          // Last sector pre-erased (ACMD23) - the multi-block write is stopped after it
+    uint8_t                                     _data_response;                     // Data response token of the last block written
+    
+    uint8_t                                     (*_p_cache)[512];                   // Write-back cache of the FAT and directory sectors
+    uint32_t                                    _cache_sector[SD_CARD_CACHE_SECTORS];
+    uint8_t                                     _cache_is_valid;                    // One bit per sector of the cache
+    uint8_t                                     _cache_is_dirty;                    // One bit per sector of the cache
+    uint8_t                                     _cache_index;                       // Sector of the cache returned by the last sd_card_cache_read
+    uint8_t                                     _cache_next_victim;
+    
+    uint8_t                                     *_p_ram_tail;                       // Partially filled data sector of the file being written
+    fat_file_system_entry_t                     *_p_tail_file;
+    uint32_t                                    _tail_sector;
+    bool                                        _is_tail_dirty;
+    
+    uint32_t                                    _next_free_cluster;                 // Start point of the search of free clusters in the FAT table
+    uint32_t                                    _free_root_entry_sector;            // First free entry (end of the root directory) used to create a file (0 if none)
+    uint8_t                                     _free_root_entry_index;
     
     uint32_t                                    _flags;
     state_machine_t                             _sm;
 } sd_card_params_t;
 
-#define SD_CARD_INSTANCE(_spi_module, _io_port, _io_indice, _enable_log, _tx_buffer_ram, _rx_buffer_ram)     \
+#define SD_CARD_INSTANCE(_spi_module, _io_port, _io_indice, _enable_log, _tx_buffer_ram, _rx_buffer_ram, _read_ahead_ram, _cache_ram, _tail_ram)     \
 {                                                                                               \
     .is_init_done = false,                                                                      \
     .spi_id = _spi_module,                                                                      \
@@ -264,8 +315,41 @@ typedef struct
     .p_file = {NULL},                                                                           \
     .number_of_p_file = 0,                                                                      \
     .current_selected_file = 0xff,                                                              \
+    ._file_hash_table = {0},                                                                    \
+    ._file_hash = {0},                                                                          \
+    ._folder_hash_table = {0},                                                                  \
+    ._is_folder_hash_table_full = false,                                                        \
+    ._number_of_file_not_found = 0,                                                             \
     ._p_ram_tx = _tx_buffer_ram,                                                                \
     ._p_ram_rx = _rx_buffer_ram,                                                                \
+    ._p_sector_data = _rx_buffer_ram,                                                           \
+    ._is_stream_open = false,                                                                   \
+    ._stream_next_sector = 0,                                                                   \
+    ._stream_last_sector = 0,                                                                   \
+    ._p_read_ahead = _read_ahead_ram,                                                           \
+    ._read_ahead_first_sector = 0,                                                              \
+    ._read_ahead_tail = 0,                                                                      \
+    ._read_ahead_count = 0,                                                                     \
+    ._is_read_ahead_on_going = false,                                                           \
+    ._is_dma_rx_done = false,                                                                   \
+    ._is_read_ahead_stop_requested = false,                                                     \
+    ._is_write_stream_open = false,                                                             \
+    ._write_stream_next_sector = 0,                                                             \
+    ._write_stream_last_sector = 0,                                                             \
+    ._data_response = 0,                                                                        \
+    ._p_cache = _cache_ram,                                                                     \
+    ._cache_sector = {0},                                                                       \
+    ._cache_is_valid = 0,                                                                       \
+    ._cache_is_dirty = 0,                                                                       \
+    ._cache_index = 0,                                                                          \
+    ._cache_next_victim = 0,                                                                    \
+    ._p_ram_tail = _tail_ram,                                                                   \
+    ._p_tail_file = NULL,                                                                       \
+    ._tail_sector = 0,                                                                          \
+    ._is_tail_dirty = false,                                                                    \
+    ._next_free_cluster = 2,                                                                    \
+    ._free_root_entry_sector = 0,                                                               \
+    ._free_root_entry_index = 0,                                                                \
     ._flags = 0,                                                                                \
     ._sm = {0}                                                                                  \
 }
@@ -273,11 +357,17 @@ typedef struct
 #define SD_CARD_DEF(_name, _spi_module, _cs_pin, _enable_log)                                   \
 static uint8_t _name ## _tx_buffer_ram_allocation[512+2];                                       \
 static uint8_t _name ## _rx_buffer_ram_allocation[512+2];                                       \
-static sd_card_params_t _name = SD_CARD_INSTANCE(_spi_module, __PORT(_cs_pin), __INDICE(_cs_pin), _enable_log, _name ## _tx_buffer_ram_allocation, _name ## _rx_buffer_ram_allocation)
+static uint8_t _name ## _read_ahead_ram_allocation[SD_CARD_READ_AHEAD_SECTORS][512+2];          \
+static uint8_t _name ## _cache_ram_allocation[SD_CARD_CACHE_SECTORS][512];                     \
+static uint8_t _name ## _tail_ram_allocation[512];                                              \
+static sd_card_params_t _name = SD_CARD_INSTANCE(_spi_module, __PORT(_cs_pin), __INDICE(_cs_pin), _enable_log, _name ## _tx_buffer_ram_allocation, _name ## _rx_buffer_ram_allocation, _name ## _read_ahead_ram_allocation, _name ## _cache_ram_allocation, _name ## _tail_ram_allocation)
 
 void sd_card_deamon(sd_card_params_t *var);
 void sd_card_open(fat_file_system_entry_t *file);
 uint8_t sd_card_read_block_file(fat_file_system_entry_t *file, uint8_t *p_dst, uint32_t data_address, uint32_t block_length);
 uint8_t sd_card_read_play_file(fat_file_system_entry_t *file, uint8_t *p_dst, uint16_t block_length, uint32_t period, uint8_t *progression);
+uint8_t sd_card_write_block_file(fat_file_system_entry_t *file, uint8_t *p_src, uint32_t block_length);
+uint8_t sd_card_sync_file(fat_file_system_entry_t *file);
+uint8_t sd_card_close_file(fat_file_system_entry_t *file);
 
 #endif
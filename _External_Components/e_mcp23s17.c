@@ -8,6 +8,28 @@
 
 #include "../PLIB.h"
 
+static void _mcp23s17_start_transfer(mcp23s17_params_t *var, void *p_rx, uint8_t length)
+{
+    var->dma_tx_params.src_start_addr = (void *) var->__buffer;
+    var->dma_tx_params.src_size = length;
+    var->dma_rx_params.dst_start_addr = p_rx;
+    var->dma_rx_params.dst_size = length;
+
+    ports_clr_bit(var->spi_cs);
+
+    dma_set_transfer_params(var->dma_rx_id, &var->dma_rx_params);   
+    dma_set_transfer_params(var->dma_tx_id, &var->dma_tx_params);    
+    dma_channel_enable(var->dma_rx_id, ON, false);  // Do not force the transfer (it occurs automatically when data is received - SPI Rx generates the transfer)
+    dma_channel_enable(var->dma_tx_id, ON, false);  // Do not take care of the 'force_transfer' boolean value because the DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).            
+}
+
+static bool _mcp23s17_is_int_active(mcp23s17_params_t *var)
+{
+    bool is_active_high = ((var->write[0].IOCON & (MCP23S17_IOCON_ODR_OPEN_DRAIN | MCP23S17_IOCON_INTPOL_ACTIVE_HIGH)) == MCP23S17_IOCON_INTPOL_ACTIVE_HIGH);
+    
+    return (ports_get_bit(var->int_pin) == is_active_high);
+}
+
 static uint8_t _mcp23s17_write_and_read(mcp23s17_params_t *var)
 {
     static enum _functionState
@@ -18,46 +40,84 @@ static uint8_t _mcp23s17_write_and_read(mcp23s17_params_t *var)
         SM_WAIT_END_OF_DMA_TRANSMISSION
     } functionState = 0;
     static mcp23s17_registers_t dummy;
+    uint8_t i, first, last;
+    uint8_t *p_write = (uint8_t *) &var->write[var->__current_selected_device]._header + 2;     // Register @=0x00
+    uint8_t *p_shadow = (uint8_t *) &var->__shadow[var->__current_selected_device]._header + 2;
+    uint8_t device_mask = (1 << var->__current_selected_device);
     
     switch (functionState)
     {
         case SM_FREE:
                   
+            var->scan_period = mTickCompare(var->__scan_tick);
+            mUpdateTick(var->__scan_tick);
             var->__current_selected_device = 0;
+            p_write = (uint8_t *) &var->write[0]._header + 2;
+            p_shadow = (uint8_t *) &var->__shadow[0]._header + 2;
+            device_mask = 0x01;
             functionState = SM_SEND;
             
         case SM_SEND:
             
-            var->write[var->__current_selected_device]._header = 0x0040 | (var->__p_device_addresses[var->__current_selected_device] << 1);
+            // Only the registers which differ from the last values sent are written (one burst from the first to the last
+            // modified register - SEQOP auto-increment). INTFx/INTCAPx are read only and GPIOx is a copy of OLATx.
             var->write[var->__current_selected_device]._iocon_copy = var->write[var->__current_selected_device].IOCON;
-            var->dma_tx_params.src_start_addr = (void *) &var->write[var->__current_selected_device];
-            var->dma_rx_params.dst_start_addr = (void *) &dummy;
+            var->write[var->__current_selected_device].GPIOA = var->write[var->__current_selected_device].OLATA;
+            var->write[var->__current_selected_device].GPIOB = var->write[var->__current_selected_device].OLATB;
             
-            ports_clr_bit(var->spi_cs);
-            
-            dma_set_transfer_params(var->dma_rx_id, &var->dma_rx_params);   
-            dma_set_transfer_params(var->dma_tx_id, &var->dma_tx_params);    
-            dma_channel_enable(var->dma_rx_id, ON, false);  // Do not force the transfer (it occurs automatically when data is received - SPI Rx generates the transfer)
-            dma_channel_enable(var->dma_tx_id, ON, false);  // Do not take care of the 'force_transfer' boolean value because the DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).            
-            
-            functionState = SM_WAIT_END_OF_DMA_TRANSMISSION;
+            first = 0xff;
+            last = 0;
+            for (i = 0 ; i <= MCP23S17_REG_OLATB ; i++)
+            {
+                if (((i <= MCP23S17_REG_LAST_CONFIGURATION) || (i >= MCP23S17_REG_OLATA)) && 
+                    (!(var->__shadow_valid_mask & device_mask) || (p_write[i] != p_shadow[i])))
+                {
+                    (first == 0xff) ? (first = i) : 0;
+                    last = i;
+                }
+            }
             
-            break;
+            if (first != 0xff)
+            {
+                if (first <= MCP23S17_REG_LAST_CONFIGURATION)
+                {
+                    var->__full_read_mask |= device_mask;
+                }
+                var->__buffer[0] = 0x40 | (var->__p_device_addresses[var->__current_selected_device] << 1);
+                var->__buffer[1] = first;
+                for (i = first ; i <= last ; i++)
+                {
+                    var->__buffer[2 + i - first] = p_write[i];
+                    p_shadow[i] = p_write[i];
+                }
+                var->__shadow_valid_mask |= device_mask;
+                
+                _mcp23s17_start_transfer(var, (void *) &dummy, 2 + last - first + 1);
+                functionState = SM_WAIT_END_OF_DMA_TRANSMISSION;
+                break;
+            }
+            functionState = SM_READ;
             
         case SM_READ:
             
-            var->read[var->__current_selected_device]._header = 0x0041 | (var->__p_device_addresses[var->__current_selected_device] << 1);
-            var->dma_tx_params.src_start_addr = (void *) &var->read[var->__current_selected_device];
-            var->dma_rx_params.dst_start_addr = (void *) &var->read[var->__current_selected_device];
-            
-            ports_clr_bit(var->spi_cs);
-            
-            dma_set_transfer_params(var->dma_rx_id, &var->dma_rx_params);   
-            dma_set_transfer_params(var->dma_tx_id, &var->dma_tx_params);    
-            dma_channel_enable(var->dma_rx_id, ON, false);  // Do not force the transfer (it occurs automatically when data is received - SPI Rx generates the transfer)
-            dma_channel_enable(var->dma_tx_id, ON, false);  // Do not take care of the 'force_transfer' boolean value because the DMA channel is configure to execute a transfer on event when Tx is ready (IRQ source is Tx of a peripheral - see notes of dma_set_transfer_params()).            
-            
-            functionState = SM_WAIT_END_OF_DMA_TRANSMISSION;
+            // Only INTFx, INTCAPx and GPIOx are read, except after a configuration change: 2 + 6 = 8 SPI bytes per device
+            // (64 bytes for a scan of 8 devices with no output change, instead of the 384 bytes of the full write and read of IODIRA..OLATB).
+            // If the INT pin is used, the inputs are read only when it is active.
+            if ((var->__full_read_mask & device_mask) || (var->int_pin._port == 0) || _mcp23s17_is_int_active(var))
+            {
+                first = (var->__full_read_mask & device_mask) ? 0x00 : MCP23S17_REG_INTFA;
+                last = (var->__full_read_mask & device_mask) ? MCP23S17_REG_OLATB : MCP23S17_REG_GPIOB;
+                
+                var->__buffer[0] = 0x41 | (var->__p_device_addresses[var->__current_selected_device] << 1);
+                var->__buffer[1] = first;
+                
+                _mcp23s17_start_transfer(var, (void *) var->__buffer, 2 + last - first + 1);
+                functionState = SM_WAIT_END_OF_DMA_TRANSMISSION;
+            }
+            else
+            {
+                functionState = (++var->__current_selected_device >= var->__number_of_device) ? SM_FREE : SM_SEND;
+            }
             
             break;
             
@@ -69,12 +129,16 @@ static uint8_t _mcp23s17_write_and_read(mcp23s17_params_t *var)
             
                 ports_set_bit(var->spi_cs);
                 
-                if (var->dma_tx_params.src_start_addr == (void *) &var->write[var->__current_selected_device])
+                if (var->dma_rx_params.dst_start_addr == (void *) &dummy)
                 {
                     functionState = SM_READ;
                 }
                 else
                 {                    
+                    first = (var->dma_rx_params.dst_size == sizeof(mcp23s17_registers_t)) ? 0x00 : MCP23S17_REG_INTFA;    // __buffer[1] has been overwritten by the reception
+                    memcpy((uint8_t *) &var->read[var->__current_selected_device]._header + 2 + first, &var->__buffer[2], var->dma_rx_params.dst_size - 2);
+                    CLR_BIT(var->__full_read_mask, var->__current_selected_device);
+                    
                     if (++var->__current_selected_device >= var->__number_of_device)
                     {
                         functionState = SM_FREE;
@@ -134,6 +198,14 @@ uint8_t e_mcp23s17_deamon(mcp23s17_params_t *var)
         {
             var->write[i].IOCON = MCP23S17_IOCON_ADDRESS_PINS_ENABLE;
         }
+        var->__shadow_valid_mask = 0;
+        var->__full_read_mask = (1 << var->__number_of_device) - 1;
+        
+        if (var->int_pin._port > 0)
+        {
+            ports_reset_pin_input(var->int_pin);
+        }
+        mUpdateTick(var->__scan_tick);
         
         var->is_init_done = true;
     }  
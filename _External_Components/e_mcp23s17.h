@@ -77,11 +77,18 @@ typedef struct
     uint8_t                 OLATB;
 } mcp23s17_registers_t;
 
+#define MCP23S17_REG_INTFA                  0x0E
+#define MCP23S17_REG_GPIOB                  0x13
+#define MCP23S17_REG_OLATA                  0x14
+#define MCP23S17_REG_OLATB                  0x15
+#define MCP23S17_REG_LAST_CONFIGURATION     0x0D    // IODIRA..GPPUB
+
 typedef struct
 {
     bool                    is_init_done;
     SPI_MODULE              spi_id;
     _io_t                   spi_cs;
+    _io_t                   int_pin;                // Optional (port = 0 if not used): INTA/INTB output (MIRROR) of the devices
     DMA_MODULE              dma_tx_id;
     DMA_MODULE              dma_rx_id;
     dma_channel_transfer_t  dma_tx_params;
@@ -89,22 +96,36 @@ typedef struct
     
     mcp23s17_registers_t    *read;
     mcp23s17_registers_t    *write;
+    uint64_t                scan_period;            // Duration (in tick) of the last complete scan of all the devices
+    
+    mcp23s17_registers_t    *__shadow;              // Last values sent to each device
+    uint8_t                 __buffer[sizeof(mcp23s17_registers_t)];
+    uint8_t                 __shadow_valid_mask;    // bit i = 1: __shadow[i] is up to date
+    uint8_t                 __full_read_mask;       // bit i = 1: all the registers of device i should be read back
+    uint64_t                __scan_tick;
     uint8_t                 *__p_device_addresses;
     uint8_t                 __current_selected_device;
     uint8_t                 __number_of_device;
 } mcp23s17_params_t;
 
-#define MCP23S17_INSTANCE(_spi_module, _io_port, _io_indice, _device_addresses, _read_ram, _write_ram, _number_of_device) \
+#define MCP23S17_INSTANCE(_spi_module, _io_port, _io_indice, _int_port, _int_indice, _device_addresses, _read_ram, _write_ram, _shadow_ram, _number_of_device) \
 {                                                                               \
     .is_init_done = false,                                                      \
     .spi_id = _spi_module,                                                      \
     .spi_cs = { _io_port, _io_indice },                                         \
+    .int_pin = { _int_port, _int_indice },                                      \
     .dma_tx_id = DMA_NUMBER_OF_MODULES,                                         \
     .dma_rx_id = DMA_NUMBER_OF_MODULES,                                         \
     .dma_tx_params = {NULL, NULL, sizeof(mcp23s17_registers_t), 1, 1, 0x0000},  \
     .dma_rx_params = {NULL, NULL, 1, sizeof(mcp23s17_registers_t), 1, 0x0000},  \
     .read = _read_ram,                                                          \
     .write = _write_ram,                                                        \
+    .scan_period = 0,                                                           \
+    .__shadow = _shadow_ram,                                                    \
+    .__buffer = {0},                                                            \
+    .__shadow_valid_mask = 0,                                                   \
+    .__full_read_mask = 0,                                                      \
+    .__scan_tick = 0,                                                           \
     .__p_device_addresses = _device_addresses,                                  \
     .__current_selected_device = 0,                                             \
     .__number_of_device = _number_of_device                                     \
@@ -114,7 +135,19 @@ typedef struct
 static uint8_t _name ## _device_addresses[COUNT_ARGUMENTS( __VA_ARGS__ )] = { __VA_ARGS__ };    \
 static mcp23s17_registers_t _name ##_read_ram_allocation[COUNT_ARGUMENTS( __VA_ARGS__ )];       \
 static mcp23s17_registers_t _name ##_write_ram_allocation[COUNT_ARGUMENTS( __VA_ARGS__ )];      \
-static mcp23s17_params_t _name = MCP23S17_INSTANCE(_spi_module, __PORT(_cs_pin), __INDICE(_cs_pin), _name ## _device_addresses, _name ##_read_ram_allocation, _name ##_write_ram_allocation, COUNT_ARGUMENTS( __VA_ARGS__ ))
+static mcp23s17_registers_t _name ##_shadow_ram_allocation[COUNT_ARGUMENTS( __VA_ARGS__ )];     \
+static mcp23s17_params_t _name = MCP23S17_INSTANCE(_spi_module, __PORT(_cs_pin), __INDICE(_cs_pin), 0, 0, _name ## _device_addresses, _name ##_read_ram_allocation, _name ##_write_ram_allocation, _name ##_shadow_ram_allocation, COUNT_ARGUMENTS( __VA_ARGS__ ))
+
+// The inputs are read only when the INT pin is active (or after a configuration change) instead of continuously.
+// GPINTENx/INTCONx/DEFVALx should be set by the user and IOCON should have MIRROR (or ODR for a wired-OR of several devices).
+#define MCP23S17_INT_DEF(_name, _spi_module, _cs_pin, _int_pin, ...)                            \
+static uint8_t _name ## _device_addresses[COUNT_ARGUMENTS( __VA_ARGS__ )] = { __VA_ARGS__ };    \
+static mcp23s17_registers_t _name ##_read_ram_allocation[COUNT_ARGUMENTS( __VA_ARGS__ )];       \
+static mcp23s17_registers_t _name ##_write_ram_allocation[COUNT_ARGUMENTS( __VA_ARGS__ )];      \
+static mcp23s17_registers_t _name ##_shadow_ram_allocation[COUNT_ARGUMENTS( __VA_ARGS__ )];     \
+static mcp23s17_params_t _name = MCP23S17_INSTANCE(_spi_module, __PORT(_cs_pin), __INDICE(_cs_pin), __PORT(_int_pin), __INDICE(_int_pin), _name ## _device_addresses, _name ##_read_ram_allocation, _name ##_write_ram_allocation, _name ##_shadow_ram_allocation, COUNT_ARGUMENTS( __VA_ARGS__ ))
+
+#define mMCP23S17GetScanRate(var)           (((var).scan_period > 0) ? (uint32_t) (TICK_1S / (var).scan_period) : 0)    // Number of scans (of all the devices) per second
 
 uint8_t e_mcp23s17_deamon(mcp23s17_params_t *var);
 
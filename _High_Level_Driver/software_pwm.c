@@ -4,8 +4,11 @@
  * 
  *  Revision history    :
  *              12/03/2019              - Initial release
+ *              17/10/2026              - Port masks sorted by duty: at most one LATCLR 
+ *                                        per port and per duty in the interrupt.
  *
- *  Timings (200 hertz with resolution = 1):
+ *  Timings of the initial release (one LATSET/LATCLR per pin at each 
+ *  interruption - 200 hertz with resolution = 1):
  *  ---------------------------------------
  *  busy = occupation time in the interrupt routine periodically (200 hertz
  *  with a resolution of 1:1 => 200 x 255 = 51000 hertz = 1 interruption
@@ -31,6 +34,67 @@ const ports_registers_t * p_ports_registers_array[] =
 	(ports_registers_t*)_PORTG_BASE_ADDRESS
 };
 
+/*******************************************************************************
+  Function:
+    static void software_pwm_build_edges(SOFTWAPRE_PWM_PARAMS *var)
+
+  Description:
+    This static routine takes a copy of the duties and builds the clear masks
+    of each port sorted by duty. The order of the previous build is kept so the
+    insertion sort is almost linear when only a few duties change.
+
+  Parameters:
+    var*    - A pointer of SOFTWAPRE_PWM_PARAMS.
+  *****************************************************************************/
+static void software_pwm_build_edges(SOFTWAPRE_PWM_PARAMS *var)
+{
+    uint8_t i, j, k;
+    
+    memcpy(var->pwm_applied, var->pwm, var->number_of_pwm_used);
+    memset(var->set_mask, 0, sizeof(var->set_mask));
+    
+    for (i = 1 ; i < var->number_of_pwm_used ; i++)
+    {
+        uint8_t ind = var->order[i];
+        
+        for (j = i ; (j > 0) && (var->pwm_applied[var->order[j - 1]] > var->pwm_applied[ind]) ; j--)
+        {
+            var->order[j] = var->order[j - 1];
+        }
+        var->order[j] = ind;
+    }
+    
+    var->number_of_edges = 0;
+    for (i = 0 ; i < var->number_of_pwm_used ; i++)
+    {
+        uint8_t ind = var->order[i];
+        uint8_t duty = var->pwm_applied[ind];
+        uint8_t port = var->io[ind]._port - 1;
+        uint32_t mask = (uint32_t) (1 << var->io[ind]._indice);
+        
+        if (duty > 0)
+        {
+            var->set_mask[port] |= mask;
+        }
+        
+        if ((duty > 0) && (duty < 255))
+        {
+            for (k = var->number_of_edges ; (k > 0) && (var->edge[k - 1].duty == duty) && (var->edge[k - 1].port != port) ; k--);
+            if ((k > 0) && (var->edge[k - 1].duty == duty))
+            {
+                var->edge[k - 1].mask |= mask;
+            }
+            else
+            {
+                var->edge[var->number_of_edges].duty = duty;
+                var->edge[var->number_of_edges].port = port;
+                var->edge[var->number_of_edges].mask = mask;
+                var->number_of_edges++;
+            }
+        }
+    }
+}
+
 /*******************************************************************************
   Function:
     static void software_pwm_event_handler(uint8_t id)
@@ -39,33 +103,64 @@ const ports_registers_t * p_ports_registers_array[] =
     This static routine is the event handler for the software PWM. Periodically,
     this handler is called to update the output pins. The interruption provides
     by a TIMER module, so it is a TIMER module which generates this event handler.
+    A pin is set while its duty is greater than the counter (always set for 255).
+    At the beginning of a period (the counter wraps) the pins are set/cleared with 
+    one LATSET and one LATCLR per port (the edges are rebuilt if a duty has changed). 
+    Then the pins are cleared with one LATCLR per port each time the counter 
+    reaches a duty.
 
   Parameters:
     id      - The TIMER module which generates the event handler. 
   *****************************************************************************/
 static void software_pwm_event_handler(uint8_t id)
 {    
-    static uint8_t i;
+    SOFTWAPRE_PWM_PARAMS *var = p_software_pwm;
+    uint8_t counter = var->counter;
+    uint8_t k = var->edge_index;
     
-    for (i = 0 ; i < p_software_pwm->number_of_pwm_used ; i++)
+    if (counter < var->resolution)
     {
-        ports_registers_t * pPorts = (ports_registers_t *) p_ports_registers_array[p_software_pwm->io[i]._port - 1];
+        uint32_t clr_mask[SOFTWARE_PWM_MAX_PORTS] = {0};
+        uint8_t port;
+        
+        if (memcmp(var->pwm, var->pwm_applied, var->number_of_pwm_used))
+        {
+            software_pwm_build_edges(var);
+        }
         
-        if (p_software_pwm->pwm[i] == 255)
+        for (k = 0 ; (k < var->number_of_edges) && (var->edge[k].duty <= counter) ; k++)
         {
-            pPorts->LATSET = (uint32_t) (1 << p_software_pwm->io[i]._indice);
+            clr_mask[var->edge[k].port] |= var->edge[k].mask;
         }
-        else if (p_software_pwm->pwm[i] > p_software_pwm->counter)
+        
+        for (port = 0 ; port < SOFTWARE_PWM_MAX_PORTS ; port++)
         {
-            pPorts->LATSET = (uint32_t) (1 << p_software_pwm->io[i]._indice);
+            if (var->pins_mask[port] > 0)
+            {
+                ports_registers_t * pPorts = (ports_registers_t *) p_ports_registers_array[port];
+                uint32_t set_mask = var->set_mask[port] & ~clr_mask[port];
+                
+                if (set_mask > 0)
+                {
+                    pPorts->LATSET = set_mask;
+                }
+                if ((var->pins_mask[port] & ~set_mask) > 0)
+                {
+                    pPorts->LATCLR = var->pins_mask[port] & ~set_mask;
+                }
+            }
         }
-        else
+    }
+    else
+    {
+        for ( ; (k < var->number_of_edges) && (var->edge[k].duty <= counter) ; k++)
         {
-            pPorts->LATCLR = (uint32_t) (1 << p_software_pwm->io[i]._indice);
+            ((ports_registers_t *) p_ports_registers_array[var->edge[k].port])->LATCLR = var->edge[k].mask;
         }
     }
     
-    p_software_pwm->counter += p_software_pwm->resolution;
+    var->edge_index = k;
+    var->counter += var->resolution;
 }
 
 /*******************************************************************************
@@ -87,7 +182,10 @@ void software_pwm_init(SOFTWAPRE_PWM_PARAMS *var)
     for (i = 0 ; i < var->number_of_pwm_used ; i++)
     {
         ports_reset_pin_output(var->io[i]);
+        var->pins_mask[var->io[i]._port - 1] |= (uint32_t) (1 << var->io[i]._indice);
+        var->order[i] = i;
     }
+    software_pwm_build_edges(var);
     
     timer_init_2345_hz(var->timer_module, software_pwm_event_handler, TMR_ON | TMR_SOURCE_INT | TMR_IDLE_CON | TMR_GATE_OFF, var->frequency_hz * 255 / var->resolution);
 }
@@ -2,6 +2,7 @@
 #define	__DEF_SOFTWARE_PWM
 
 #define SOFTWARE_PWM_MAX        30
+#define SOFTWARE_PWM_MAX_PORTS  7           // PORTA to PORTG
 
 typedef enum
 {
@@ -21,6 +22,13 @@ typedef enum
     SOFTWARE_PWM_RESO_20        = 20
 } SOFTWARE_PWM_RESOLUTION;
 
+typedef struct
+{
+    uint8_t                     duty;               // The pins are cleared when the counter reaches this duty
+    uint8_t                     port;               // Index in p_ports_registers_array (_port - 1)
+    uint32_t                    mask;               // All the pins of the port with this duty
+} software_pwm_edge_t;
+
 typedef struct
 {
     TIMER_MODULE                timer_module;
@@ -31,6 +39,14 @@ typedef struct
     uint16_t                    frequency_hz;
     
     uint8_t                     counter;
+    
+    uint8_t                     pwm_applied[SOFTWARE_PWM_MAX];              // Duties used to build the edges (updated at the beginning of a period)
+    uint8_t                     order[SOFTWARE_PWM_MAX];                    // PWM indices sorted by duty
+    software_pwm_edge_t         edge[SOFTWARE_PWM_MAX];                     // Clear masks sorted by duty (0 and 255 are not edges)
+    uint8_t                     number_of_edges;
+    uint8_t                     edge_index;
+    uint32_t                    pins_mask[SOFTWARE_PWM_MAX_PORTS];          // All the PWM pins of each port
+    uint32_t                    set_mask[SOFTWARE_PWM_MAX_PORTS];           // PWM pins of each port with a duty > 0
 } SOFTWAPRE_PWM_PARAMS;
 
 #define SOFTWARE_PWM_PARAMS_INSTANCE(_timer_module, _frequency, _resolution, N, ...)    \
@@ -355,6 +355,9 @@ void            fu_hysteresis(hysteresis_params_t *var);
 
 void            fu_bus_management_task(BUS_MANAGEMENT_VAR *dp);
 uint16_t        fu_crc_16_ibm(uint8_t *buffer, uint16_t length);
+uint16_t        fu_crc_16_ibm_init(void);
+uint16_t        fu_crc_16_ibm_update(uint16_t crc, const uint8_t *buffer, uint16_t length);
+uint16_t        fu_crc_16_ibm_final(uint16_t crc);
 
 uint32_t        fu_get_integer_value(float v);
 uint32_t        fu_get_decimal_value(float v, uint8_t numbers_after_coma);
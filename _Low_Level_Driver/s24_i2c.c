@@ -8,6 +8,8 @@
 *                       - Add i2c_master_state_machine function
 *                       - Modifications of I2C_PARAMS in order to add
 *                       the new features of 'i2c_master_state_machine'. 
+*       17/10/2026      - Add the transaction engine (i2c_transaction_push) 
+*                       driven by the master interrupts.
 *********************************************************************/
 
 #include "../PLIB.h"
@@ -24,6 +26,21 @@ const i2c_registers_t * I2cModules[] =
 static uint32_t real_frequency_tab[I2C_NUMBER_OF_MODULES] = {0};
 static i2c_event_handler_t i2c_event_handler[I2C_NUMBER_OF_MODULES] = {NULL};
 
+typedef struct
+{
+    i2c_transaction_t       *p_queue[I2C_TRANSACTION_QUEUE_SIZE];
+    uint8_t                 head;
+    uint8_t                 tail;
+    volatile bool           is_running;
+    I2C_STATE_MACHINE       state;
+    uint8_t                 index;
+} i2c_transaction_engine_t;
+
+static i2c_transaction_engine_t i2c_transaction_engine[I2C_NUMBER_OF_MODULES] = {0};
+
+static void i2c_transaction_engine_task(I2C_MODULE id);
+static void i2c_transaction_engine_done(I2C_MODULE id, bool is_success);
+
 /*******************************************************************************
  * Function: 
  *      void i2c_init_as_master(    I2C_MODULE id, 
@@ -424,7 +441,20 @@ void i2c_set_slave_address(I2C_MODULE id, uint32_t address, uint32_t mask, I2C_A
  ******************************************************************************/
 void i2c_interrupt_handler(I2C_MODULE id, IRQ_EVENT_TYPE evt_type, uint32_t data)
 {
-    if (i2c_event_handler[id] != NULL)
+    if (i2c_transaction_engine[id].is_running && ((evt_type == IRQ_I2C_MASTER) || (evt_type == IRQ_I2C_BUS_COLISION)))
+    {
+        if (evt_type == IRQ_I2C_BUS_COLISION)
+        {
+            i2c_registers_t * p_i2c = (i2c_registers_t *) I2cModules[id];
+            p_i2c->I2CSTATCLR = _I2C1STAT_BCL_MASK;
+            i2c_transaction_engine_done(id, false);
+        }
+        else
+        {
+            i2c_transaction_engine_task(id);
+        }
+    }
+    else if (i2c_event_handler[id] != NULL)
     {
         (*i2c_event_handler[id])(id, evt_type, data);
     }
@@ -659,3 +689,266 @@ I2C_STATE_MACHINE i2c_master_state_machine(I2C_PARAMS *var, I2C_FUNCTIONS *fct)
     
     return ret;
 }
+
+/*******************************************************************************
+ * Function: 
+ *      void i2c_transaction_engine_enable(I2C_MODULE id)
+ * 
+ * Description:
+ *      This routine enables the master and bus collision interrupts used by
+ *      the transaction engine. It must be called after 'i2c_init_as_master' 
+ *      (which reconfigures these interrupts). The user ISR of the module 
+ *      should call 'i2c_interrupt_handler' with IRQ_I2C_MASTER or 
+ *      IRQ_I2C_BUS_COLISION and clear the flag.
+ *      A module driven by the engine must not be used at the same time by
+ *      'i2c_master_state_machine'.
+ * 
+ * Parameters:
+ *      id: The I2C module you want to use.
+ * 
+ * Return:
+ *      none
+ ******************************************************************************/
+void i2c_transaction_engine_enable(I2C_MODULE id)
+{
+    irq_init(IRQ_I2C1B + id, IRQ_ENABLED, irq_i2c_priority(id));
+    irq_init(IRQ_I2C1M + id, IRQ_ENABLED, irq_i2c_priority(id));
+}
+
+/*******************************************************************************
+ * Function: 
+ *      bool i2c_transaction_push(I2C_MODULE id, i2c_transaction_t *p_transaction)
+ * 
+ * Description:
+ *      This routine adds a transaction descriptor in the queue of the module.
+ *      If the engine is idle, the START condition is sent immediately and the
+ *      whole queue is then executed by the master interrupt (back-to-back, 
+ *      without the main loop). It can also be called from a transaction
+ *      callback to chain a new transaction.
+ * 
+ * Parameters:
+ *      id: The I2C module you want to use.
+ *      *p_transaction: The descriptor (see. i2c_transaction_t). Its status is
+ *      set to I2C_TRANSACTION_PENDING.
+ * 
+ * Return:
+ *      0: Transaction queued.
+ *      1: The queue is full (nothing is done).
+ ******************************************************************************/
+bool i2c_transaction_push(I2C_MODULE id, i2c_transaction_t *p_transaction)
+{
+    i2c_transaction_engine_t *p = &i2c_transaction_engine[id];
+    uint8_t head_next;
+    uint32_t int_status;
+    bool ret = 1;
+    
+    int_status = __builtin_disable_interrupts();
+    head_next = (p->head + 1) & (I2C_TRANSACTION_QUEUE_SIZE - 1);
+    if (head_next != p->tail)
+    {
+        p_transaction->status = I2C_TRANSACTION_PENDING;
+        p->p_queue[p->head] = p_transaction;
+        p->head = head_next;
+        if (!p->is_running)
+        {
+            p->is_running = true;
+            p->index = 0;
+            p->state = _START;
+            p_transaction->status = I2C_TRANSACTION_RUNNING;
+            i2c_start(id);
+        }
+        ret = 0;
+    }
+    if (int_status & 0x00000001)
+    {
+        __builtin_enable_interrupts();
+    }
+    return ret;
+}
+
+/*******************************************************************************
+ * Function: 
+ *      bool i2c_transaction_is_idle(I2C_MODULE id)
+ * 
+ * Description:
+ *      This routine is used to verify that all the queued transactions of
+ *      the module are finished.
+ * 
+ * Parameters:
+ *      id: The I2C module you want to use.
+ * 
+ * Return:
+ *      0: The engine is running.
+ *      1: The engine is idle (queue empty).
+ ******************************************************************************/
+bool i2c_transaction_is_idle(I2C_MODULE id)
+{
+    return !i2c_transaction_engine[id].is_running;
+}
+
+/*******************************************************************************
+ * Function: 
+ *      static void i2c_transaction_engine_done(I2C_MODULE id, bool is_success)
+ * 
+ * Description:
+ *      This routine closes the current transaction (status & callback) and 
+ *      starts the next one of the queue (if any). Called in the interrupt.
+ * 
+ * Parameters:
+ *      id: The I2C module you want to use.
+ *      is_success: The result of the current transaction.
+ * 
+ * Return:
+ *      none
+ ******************************************************************************/
+static void i2c_transaction_engine_done(I2C_MODULE id, bool is_success)
+{
+    i2c_transaction_engine_t *p = &i2c_transaction_engine[id];
+    i2c_transaction_t *p_tr = p->p_queue[p->tail];
+    
+    p->tail = (p->tail + 1) & (I2C_TRANSACTION_QUEUE_SIZE - 1);
+    p_tr->status = is_success ? I2C_TRANSACTION_SUCCESS : I2C_TRANSACTION_FAIL;
+    if (p_tr->callback != NULL)
+    {
+        (*p_tr->callback)(id, p_tr->p_context, is_success);
+    }
+    
+    if (p->tail != p->head)
+    {
+        p->index = 0;
+        p->state = _START;
+        p->p_queue[p->tail]->status = I2C_TRANSACTION_RUNNING;
+        i2c_start(id);
+    }
+    else
+    {
+        p->state = _HOME;
+        p->is_running = false;
+    }
+}
+
+/*******************************************************************************
+ * Function: 
+ *      static void i2c_transaction_engine_task(I2C_MODULE id)
+ * 
+ * Description:
+ *      This routine is called on each master interrupt (end of START, RESTART,
+ *      STOP, byte transmitted, byte received or ACK sent). 'state' is the 
+ *      last operation launched on the bus, the routine verifies it and launches 
+ *      the next one.
+ * 
+ * Parameters:
+ *      id: The I2C module you want to use.
+ * 
+ * Return:
+ *      none
+ ******************************************************************************/
+static void i2c_transaction_engine_task(I2C_MODULE id)
+{
+    i2c_transaction_engine_t *p = &i2c_transaction_engine[id];
+    i2c_transaction_t *p_tr = p->p_queue[p->tail];
+    
+    switch (p->state)
+    {
+        case _START:
+            
+            if ((p_tr->address_register_size > 0) || (p_tr->tx_length > 0) || (p_tr->rx_length == 0))
+            {
+                i2c_send_byte(id, (p_tr->slave_address << 1) & 0xfe);
+                p->state = _SLAVE_ADDRESS_WRITE;
+                break;
+            }
+            // No write sequence: the read request is sent directly after the START.
+        case _RESTART:
+            
+            i2c_send_byte(id, ((p_tr->slave_address << 1) | 0x01) & 0xff);
+            p->state = _SLAVE_ADDRESS_READ;
+            break;
+            
+        case _SLAVE_ADDRESS_WRITE:
+        case _ADDRESS_REGISTER_MSB:
+        case _ADDRESS_REGISTER_LSB:
+        case _WRITE_BYTE:
+            
+            if (!i2c_is_ack_received(id))
+            {
+                i2c_stop(id);
+                p->state = _FAIL;
+            }
+            else if ((p->state == _SLAVE_ADDRESS_WRITE) && (p_tr->address_register_size > 1))
+            {
+                i2c_send_byte(id, (p_tr->address_register >> 8) & 0xff);
+                p->state = _ADDRESS_REGISTER_MSB;
+            }
+            else if (((p->state == _SLAVE_ADDRESS_WRITE) || (p->state == _ADDRESS_REGISTER_MSB)) && (p_tr->address_register_size > 0))
+            {
+                i2c_send_byte(id, (p_tr->address_register >> 0) & 0xff);
+                p->state = _ADDRESS_REGISTER_LSB;
+            }
+            else if (p->index < p_tr->tx_length)
+            {
+                i2c_send_byte(id, p_tr->p_tx[p->index++]);
+                p->state = _WRITE_BYTE;
+            }
+            else if (p_tr->rx_length > 0)
+            {
+                i2c_restart(id);
+                p->state = _RESTART;
+            }
+            else
+            {
+                i2c_stop(id);
+                p->state = _STOP;
+            }
+            break;
+            
+        case _SLAVE_ADDRESS_READ:
+            
+            if (!i2c_is_ack_received(id))
+            {
+                i2c_stop(id);
+                p->state = _FAIL;
+            }
+            else
+            {
+                p->index = 0;
+                i2c_receiver_active_sequence(id);
+                p->state = _READ_BYTE_SEQ1;
+            }
+            break;
+            
+        case _READ_BYTE_SEQ1:
+            
+            i2c_get_byte(id, &p_tr->p_rx[p->index++]);
+            i2c_send_ack(id, (p->index < p_tr->rx_length));
+            p->state = _READ_BYTE_SEQ2;
+            break;
+            
+        case _READ_BYTE_SEQ2:
+            
+            if (p->index < p_tr->rx_length)
+            {
+                i2c_receiver_active_sequence(id);
+                p->state = _READ_BYTE_SEQ1;
+            }
+            else
+            {
+                i2c_stop(id);
+                p->state = _STOP;
+            }
+            break;
+            
+        case _STOP:
+            
+            i2c_transaction_engine_done(id, true);
+            break;
+            
+        case _FAIL:
+            
+            i2c_transaction_engine_done(id, false);
+            break;
+            
+        default:
+            break;
+    }
+}
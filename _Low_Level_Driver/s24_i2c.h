@@ -256,6 +256,59 @@ typedef struct
 } i2c_registers_t;
 
 typedef void (*i2c_event_handler_t)(uint8_t id, IRQ_EVENT_TYPE event_type, uint32_t event_value);
+typedef void (*i2c_transaction_handler_t)(uint8_t id, void *p_context, bool is_success);
+
+#define I2C_TRANSACTION_QUEUE_SIZE      8       // Must be a power of 2 (one slot is always kept free)
+
+typedef enum
+{
+    I2C_TRANSACTION_PENDING             = 0,
+    I2C_TRANSACTION_RUNNING,
+    I2C_TRANSACTION_SUCCESS,
+    I2C_TRANSACTION_FAIL
+} I2C_TRANSACTION_STATUS;
+
+/*******************************************************************************
+  Description:
+    A transaction descriptor queued with 'i2c_transaction_push' and executed by
+    the master interrupt. The sequence on the bus is:
+    START - address (W) - register address (0, 1 or 2 bytes, MSB first) - tx bytes
+    then, if 'rx_length' > 0: RESTART - address (R) - rx bytes (NACK on the last one)
+    and finally STOP.
+    When there is no register address and no tx byte, the read sequence starts
+    directly after the START. A 'slave_address' of 0x00 is a general call.
+    The descriptor and its buffers belong to the caller and must stay valid
+    until 'status' is I2C_TRANSACTION_SUCCESS or I2C_TRANSACTION_FAIL.
+    The 'callback' (if not NULL) is called from the interrupt.
+  *****************************************************************************/
+
+typedef struct
+{
+    uint8_t                     slave_address;          // 7 bits address
+    uint8_t                     address_register_size;
+    uint16_t                    address_register;
+    const uint8_t               *p_tx;
+    uint8_t                     tx_length;
+    uint8_t                     *p_rx;
+    uint8_t                     rx_length;
+    i2c_transaction_handler_t   callback;
+    void                        *p_context;
+    volatile I2C_TRANSACTION_STATUS status;
+} i2c_transaction_t;
+
+#define I2C_TRANSACTION_INSTANCE(_address, _register_size, _register, _p_tx, _tx_length, _p_rx, _rx_length, _callback, _p_context)   \
+{                                                           \
+    .slave_address = _address,                              \
+    .address_register_size = _register_size,                \
+    .address_register = _register,                          \
+    .p_tx = _p_tx,                                          \
+    .tx_length = _tx_length,                                \
+    .p_rx = _p_rx,                                          \
+    .rx_length = _rx_length,                                \
+    .callback = _callback,                                  \
+    .p_context = _p_context,                                \
+    .status = I2C_TRANSACTION_SUCCESS                       \
+}
 
 void i2c_init_as_master(    I2C_MODULE id, 
                             i2c_event_handler_t evt_handler,
@@ -283,4 +336,8 @@ void i2c_interrupt_handler(I2C_MODULE id, IRQ_EVENT_TYPE evt_type, uint32_t data
 
 I2C_STATE_MACHINE i2c_master_state_machine(I2C_PARAMS *var, I2C_FUNCTIONS *fct);
 
+void i2c_transaction_engine_enable(I2C_MODULE id);
+bool i2c_transaction_push(I2C_MODULE id, i2c_transaction_t *p_transaction);
+bool i2c_transaction_is_idle(I2C_MODULE id);
+
 #endif
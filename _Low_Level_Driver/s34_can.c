@@ -9,6 +9,13 @@
 *                       - Improvement of the CANTaskTx() routine 
 *                       - Sort by increasing period when a frame is added CANAddFrame() -> Necessary for the new CANTaskTx()
 *                       - Global refresh in can.h and can.c
+*       17/10/2026      - Frames stored in a static pool (CAN_FRAMES_DEF) indexed by an open addressing hash table on (id, idExtended)
+*                       - No more malloc/realloc - O(1) insert/lookup/timeout of the received frames
+*                       - CANTaskTx() scheduled by deadline (min-heap): only the frames to send are read at each call
+*                       - CAN_NUM_OF_TX_CHANNELS Tx channels, frames dispatched by CAN ID priority
+*                       - Jitter and late frames statistics for each Tx frame
+*                       - CANTaskRx() (main loop, or interrupt if CAN_RX_INTERRUPT_ENABLE) drains all the Rx channels in a lock-free queue, CANDeamonRx() (main loop) updates the frames
+*                       - CANComputeFilters() computes the filters and masks from the list of the desired IDs
 *
 * 
 * FILTERS:
@@ -32,8 +39,8 @@
 * 
 * Example of application in the main program:
 
-    CAN_FRAMES framesTx = INIT_CAN_FRAMES();                // Define Tx variable
-    CAN_FRAMES framesRx = INIT_CAN_FRAMES();                // Define Rx variable
+    CAN_FRAMES_DEF(framesTx, 8);                            // Define Tx variable (up to 8 frames)
+    CAN_FRAMES_DEF(framesRx, 256);                          // Define Rx variable (up to 256 IDs)
     CAN_FILTERS filters = INIT_CAN_FILTERS();               // Define filters variable
     ...
     filters.mask[CAN_FILTER_MASK0] = CAN_DEFAULT_MASK0;     // Param MASK 0
@@ -48,6 +55,7 @@
     // 0x300/0x301/0x302/0x303
     // 0x200/0x201/0x202/0x203
     CANSetLinkForFramesReception(CAN1, &framesRx);          // Set a link between the CAN module and the Rx variable
+    // Or compute all filters/masks from the IDs to receive: CANComputeFilters(&filters, idsToReceive, numberOfIdsToReceive);
     CANAddFrame(&framesTx, 0x600, CAN_ID_STANDARD, 8, TICK_10MS);
     CANAddFrame(&framesTx, 0x601, CAN_ID_STANDARD, 8, TICK_10MS);
     CANAddFrame(&framesTx, 0x602, CAN_ID_STANDARD, 8, TICK_20MS);
@@ -55,7 +63,7 @@
 
      while(1)
     {
-        CAN_FRAME *frame_0x300 = CANGetFrame(framesRx, 0x300);
+        CAN_FRAME *frame_0x300 = CANGetFrame(&framesRx, 0x300);
         
         CANSetData1Byte(&framesTx, 0x600, 0, framesRx.numberOfFrame);
         if(framesRx.numberOfFrame > 0)
@@ -78,11 +86,16 @@
             ...
         }
 
+        CANTaskRx(CAN1);                                    // Not needed here if CAN_RX_INTERRUPT_ENABLE (called in the interrupt handler)
+        CANDeamonRx(CAN1);
         CANFreedomReceiveMemory(&framesRx, TICK_2S);
         CANTaskTx(CAN1, &framesTx);
         CANDeamonFilters(CAN1, &filters);
 
     }
+    
+    // Only if CAN_RX_INTERRUPT_ENABLE: CAN1 interrupt handler provided by the user (priority: cf. irq_can_priority)
+    CANTaskRx(CAN1);
 *********************************************************************/
 
 #include "../PLIB.h"
@@ -90,6 +103,7 @@
 CAN_FILTERS currentFilters[CAN_NUM_OF_MODULES] = {INIT_CAN_FILTERS(), INIT_CAN_FILTERS()};
 BYTE CANMessageFifoArea[CAN_NUM_OF_MODULES][CAN_SIZE_MESSAGE_FIFO_AREA];
 CAN_FRAMES *mCANAdressFramesRx[CAN_NUM_OF_MODULES];
+CAN_RX_QUEUE mCANRxQueue[CAN_NUM_OF_MODULES];
 const CAN_REGISTERS * mCANModules[CAN_NUM_OF_MODULES] = 
 {
 #ifdef CAN1_BASE_ADDRESS
@@ -169,10 +183,13 @@ void CANInit(CAN_MODULE module, DWORD busSpeed)
     canRegisters->CxFIFOBA = KVA_TO_PA(&CANMessageFifoArea[module][0]);
 
     // Configure Channels (channel_number, number of message...) for TX and RX
-    CANConfigureChannelForTx(module, CAN_CHANNEL0, 32, CAN_TX_RTR_DISABLED, CAN_HIGHEST_PRIORITY);  // Utilisation du canal 0 pour l'envoi.
-    for(i = 0 ; i < 31 ; i++)
+    for(i = 0 ; i < CAN_NUM_OF_TX_CHANNELS ; i++)
+    {
+        CANConfigureChannelForTx(module, CAN_CHANNEL0 + i, CAN_TX_CHANNEL_SIZE, CAN_TX_RTR_DISABLED, CAN_HIGHEST_PRIORITY - i);  // Canaux 0.. pour l'envoi (du plus prioritaire au moins prioritaire).
+    }
+    for(i = 0 ; i < CAN_NUM_OF_RX_CHANNELS ; i++)
     {
-        CANConfigureChannelForRx(module, CAN_CHANNEL1 + i, 5, CAN_RX_FULL_RECEIVE); // Utilisation des canaux 1  31 pour la rception.
+        CANConfigureChannelForRx(module, CAN_CHANNEL0 + CAN_NUM_OF_TX_CHANNELS + i, CAN_RX_CHANNEL_SIZE, CAN_RX_FULL_RECEIVE); // Canaux suivants pour la rception.
     }
     
     // Set baudrate
@@ -190,11 +207,19 @@ void CANInit(CAN_MODULE module, DWORD busSpeed)
     
     // Set Events (by default, all module and channel EVENT are disable)
     CANEnableModuleEvent(module, CAN_RX_EVENT, TRUE);
-    CANEnableChannelEvent(module, CAN_CHANNEL0, (CAN_TX_CHANNEL_EMPTY), TRUE);  // On peut vrifier qu'il y a un vnement TX_EMPTY avec CANGetChannelEvent(...) car on l'autorise mais on n'autorise pas le vecteur d'interruption avec CANEnableModuleEvent(module, CAN_RX_EVENT|CAN_TX_EVENT, TRUE);
-    for(i = 0 ; i < 31 ; i++)
+    for(i = 0 ; i < CAN_NUM_OF_TX_CHANNELS ; i++)
     {
-        CANEnableChannelEvent(module, CAN_CHANNEL1 + i, (CAN_RX_CHANNEL_NOT_EMPTY|CAN_RX_CHANNEL_FULL), TRUE);
+        CANEnableChannelEvent(module, CAN_CHANNEL0 + i, (CAN_TX_CHANNEL_EMPTY), TRUE);  // On peut vrifier qu'il y a un vnement TX_EMPTY avec CANGetChannelEvent(...) car on l'autorise mais on n'autorise pas le vecteur d'interruption avec CANEnableModuleEvent(module, CAN_RX_EVENT|CAN_TX_EVENT, TRUE);
     }
+    for(i = 0 ; i < CAN_NUM_OF_RX_CHANNELS ; i++)
+    {
+        CANEnableChannelEvent(module, CAN_CHANNEL0 + CAN_NUM_OF_TX_CHANNELS + i, (CAN_RX_CHANNEL_NOT_EMPTY|CAN_RX_CHANNEL_FULL|CAN_RX_CHANNEL_OVERFLOW), TRUE);
+    }
+    
+#if (CAN_RX_INTERRUPT_ENABLE)
+    // The Rx channels are drained by CANTaskRx() in the CAN interrupt handler (to be provided by the user)
+    irq_init(IRQ_CAN1 + module, IRQ_ENABLED, irq_can_priority(module));
+#endif
 }
 
 /*******************************************************************************
@@ -291,8 +316,8 @@ static void CANConfigMask(CAN_MODULE module, CAN_FILTER_MASK mask, UINT32 maskbi
 
   Description:
     This routine allow the driver to link a filter with a mask and a channel and enable it. 
-    Channel 0 is always use for the data transmission.  (cf. CANInit())
-    Channel 1..31 is always use for the data reception.  (cf. CANInit())
+    Channel 0..(CAN_NUM_OF_TX_CHANNELS-1) are always use for the data transmission.  (cf. CANInit())
+    The following channels are always use for the data reception.  (cf. CANInit())
 
   Parameters:
     module      - Identifies the desired CAN module.
@@ -301,7 +326,7 @@ static void CANConfigMask(CAN_MODULE module, CAN_FILTER_MASK mask, UINT32 maskbi
 
     mask        - the desire Mask n (n=0..3).
 
-    channel     - the desire Channel n (n=1..31).
+    channel     - the desire Channel n (n=CAN_NUM_OF_TX_CHANNELS..31).
 
     enable      - Enable or disable the selected filter.
 
@@ -375,9 +400,190 @@ void CANDeamonFilters(CAN_MODULE module, CAN_FILTERS *filters)
         if(currentFilters[module].enableFilterAndAttachMask[i] != filters->enableFilterAndAttachMask[i])
         {
             currentFilters[module].enableFilterAndAttachMask[i] = filters->enableFilterAndAttachMask[i];
-            CANLinkFilterToChannelAndEnable(module, i, (filters->enableFilterAndAttachMask[i] >> 0)&0x03, i+1, (filters->enableFilterAndAttachMask[i] >> 7)&0x01);
+            CANLinkFilterToChannelAndEnable(module, i, (filters->enableFilterAndAttachMask[i] >> 0)&0x03, CAN_NUM_OF_TX_CHANNELS + (i % CAN_NUM_OF_RX_CHANNELS), (filters->enableFilterAndAttachMask[i] >> 7)&0x01);
+        }
+    }
+}
+
+/*******************************************************************************
+  Function:
+    static BYTE CANGetNumberOfDontCareBits(DWORD mask)
+
+  Description:
+    This routine must not be called by user. It returns the number of bits of
+    an identifier (29 bits) which are not compared by a mask.
+
+  Parameters:
+    mask        - The mask.
+
+  Returns:
+    BYTE        - The number of bits at 0 in the mask.
+
+  Example:
+    <code>
+    </code>
+  *****************************************************************************/
+static BYTE CANGetNumberOfDontCareBits(DWORD mask)
+{
+    BYTE ret = 0;
+    
+    mask = ~mask & 0x1FFFFFFF;
+    for( ; mask > 0 ; mask &= (mask - 1))
+    {
+        ret++;
+    }
+    return ret;
+}
+
+/*******************************************************************************
+  Function:
+    BYTE CANComputeFilters(CAN_FILTERS *filters, const DWORD *ids, BYTE numberOfId)
+
+  Description:
+    This routine computes the masks and filters of a CAN_FILTERS variable in order
+    to receive the desired IDs (the CANDeamonFilters function applies them).
+    Each ID has its own filter when there are enough filters (exact reception).
+    Otherwise the IDs with the most common bits are grouped (greedy algorithm):
+    - The filters are merged two by two (the merge adding the smallest number of
+      IDs first) until there is one filter by filter register.
+    - The masks are merged the same way until there are 4 masks.
+    Some unwanted IDs can then be received but the hardware still rejects most
+    of the traffic. This function must be called at the initialization (O(n^3)).
+
+  Parameters:
+    filters     - The CAN_FILTERS variable to update.
+
+    ids         - The IDs to receive.
+
+    numberOfId  - The number of IDs (max CAN_FILTERS_MAX_ID).
+
+  Returns:
+    BYTE        - The number of filters used (0 if numberOfId is too big).
+
+  Example:
+    <code>
+    const DWORD idsToReceive[] = {0x100, 0x101, 0x210, 0x300};
+    CAN_FILTERS filters = INIT_CAN_FILTERS();
+    ...
+    CANComputeFilters(&filters, idsToReceive, 4);
+    ...
+    CANDeamonFilters(CAN1, &filters);
+    </code>
+  *****************************************************************************/
+BYTE CANComputeFilters(CAN_FILTERS *filters, const DWORD *ids, BYTE numberOfId)
+{
+    static DWORD value[CAN_FILTERS_MAX_ID];
+    static DWORD mask[CAN_FILTERS_MAX_ID];
+    DWORD masks[31];
+    DWORD newMask;
+    BYTE numberOfGroup = numberOfId;
+    BYTE numberOfMask = 0;
+    BYTE i, j, k, a = 0, b = 0;
+    DWORD count;
+    QWORD cost, bestCost;       // Sum of up to 31 penalties of up to 2^29 IDs (does not fit in 32 bits)
+    
+    if(numberOfId > CAN_FILTERS_MAX_ID)
+    {
+        return 0;
+    }
+    
+    for(i = 0 ; i < numberOfId ; i++)
+    {
+        value[i] = ids[i] & 0x1FFFFFFF;
+        mask[i] = 0x1FFFFFFF;
+    }
+    
+    // Merge the filters: the new filter only compares the bits which are common to both filters
+    while(numberOfGroup > 31)
+    {
+        for(i = 0, bestCost = 0xffffffffffffffffull ; i < numberOfGroup ; i++)
+        {
+            for(j = i + 1 ; j < numberOfGroup ; j++)
+            {
+                // Number of IDs added by the merge (0 if both filters overlap)
+                cost = (1ul << CANGetNumberOfDontCareBits(mask[i] & mask[j] & ~(value[i] ^ value[j])));
+                count = (1ul << CANGetNumberOfDontCareBits(mask[i])) + (1ul << CANGetNumberOfDontCareBits(mask[j]));
+                cost = (cost > count) ? (cost - count) : 0;
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    a = i;
+                    b = j;
+                }
+            }
+        }
+        mask[a] &= mask[b] & ~(value[a] ^ value[b]);
+        value[a] &= mask[a];
+        numberOfGroup--;
+        value[b] = value[numberOfGroup];
+        mask[b] = mask[numberOfGroup];
+    }
+    
+    // List the masks needed by the filters
+    for(i = 0 ; i < numberOfGroup ; i++)
+    {
+        for(j = 0 ; (j < numberOfMask) && (masks[j] != mask[i]) ; j++);
+        if(j == numberOfMask)
+        {
+            masks[numberOfMask++] = mask[i];
+        }
+    }
+    
+    // Merge the masks: the filters using one of both masks use the new mask
+    while(numberOfMask > 4)
+    {
+        for(i = 0, bestCost = 0xffffffffffffffffull ; i < numberOfMask ; i++)
+        {
+            for(j = i + 1 ; j < numberOfMask ; j++)
+            {
+                // Number of IDs added for all the filters using one of both masks
+                for(k = 0, cost = 0 ; k < numberOfGroup ; k++)
+                {
+                    if((mask[k] == masks[i]) || (mask[k] == masks[j]))
+                    {
+                        cost += (QWORD)((1ul << CANGetNumberOfDontCareBits(masks[i] & masks[j])) - (1ul << CANGetNumberOfDontCareBits(mask[k])));
+                    }
+                }
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    a = i;
+                    b = j;
+                }
+            }
+        }
+        newMask = masks[a] & masks[b];
+        for(i = 0 ; i < numberOfGroup ; i++)
+        {
+            if((mask[i] == masks[a]) || (mask[i] == masks[b]))
+            {
+                mask[i] = newMask;
+                value[i] &= newMask;
+            }
+        }
+        masks[a] = newMask;
+        masks[b] = masks[--numberOfMask];
+    }
+    
+    for(i = 0 ; i < 4 ; i++)
+    {
+        filters->mask[i] = (i < numberOfMask) ? masks[i] : CAN_DEFAULT_MASK0;
+    }
+    for(i = 0 ; i < 31 ; i++)
+    {
+        if(i < numberOfGroup)
+        {
+            for(j = 0 ; masks[j] != mask[i] ; j++);
+            filters->id[i] = value[i];
+            filters->enableFilterAndAttachMask[i] = CAN_ENABLE_FILTER | j;
+        }
+        else
+        {
+            filters->id[i] = 0;
+            filters->enableFilterAndAttachMask[i] = CAN_DISABLE_FILTER;
         }
     }
+    return numberOfGroup;
 }
 
 /*******************************************************************************
@@ -501,16 +707,120 @@ BOOL CANSendMessage(CAN_MODULE module, CAN_CHANNEL channel, DWORD id, BOOL idExt
 
 /*******************************************************************************
   Function:
-    void CANTaskTx(CAN_MODULE module, CAN_CHANNEL channel, CAN_FRAMES *frame)
+    static void CANHeapDown(CAN_FRAMES *frames, WORD position)
+
+  Description:
+    This routine must not be called by user. It moves down the frame at the
+    selected position of the Tx heap until its deadline is lower or equal than
+    the deadlines of its children.
+
+  Parameters:
+    frames      - The CAN_FRAMES variable containing all frames.
+
+    position    - The position in the heap.
+
+  Returns:
+    None.
+
+  Example:
+    <code>
+    </code>
+  *****************************************************************************/
+static void CANHeapDown(CAN_FRAMES *frames, WORD position)
+{
+    WORD child;
+    WORD ind = frames->ptrHeap[position];
+    QWORD deadline = frames->ptrFrames[ind].deadline;
+    
+    while((child = 2*position + 1) < frames->numberOfFrame)
+    {
+        if(((child + 1) < frames->numberOfFrame) && (frames->ptrFrames[frames->ptrHeap[child + 1]].deadline < frames->ptrFrames[frames->ptrHeap[child]].deadline))
+        {
+            child++;
+        }
+        if(deadline <= frames->ptrFrames[frames->ptrHeap[child]].deadline)
+        {
+            break;
+        }
+        frames->ptrHeap[position] = frames->ptrHeap[child];
+        position = child;
+    }
+    frames->ptrHeap[position] = ind;
+}
+
+/*******************************************************************************
+  Function:
+    static void CANBuildTxSchedule(CAN_FRAMES *frames, QWORD tick)
+
+  Description:
+    This routine must not be called by user. It is called by CANTaskTx() after
+    a frame has been added or removed:
+    - The Tx channel of each frame depends of the priority of its CAN ID
+      compared to the other frames (lowest IDs on channel 0 - highest priority).
+    - The first transmission of a new frame is delayed by a part of its period
+      (depending of the rank of its CAN ID) in order to spread the frames with
+      the same period, then the heap of the deadlines is rebuilt.
+
+  Parameters:
+    frames      - The CAN_FRAMES variable containing all frames.
+
+    tick        - The current tick.
+
+  Returns:
+    None.
+
+  Example:
+    <code>
+    </code>
+  *****************************************************************************/
+static void CANBuildTxSchedule(CAN_FRAMES *frames, QWORD tick)
+{
+    WORD i, j, rank;
+    DWORD key_i, key_j;
+    
+    for(i = 0 ; i < frames->numberOfFrame ; i++)
+    {
+        // Arbitration order: the 11 bits of a standard ID are compared with the 11 MSB of an extended ID
+        key_i = frames->ptrFrames[i].idExtended ? frames->ptrFrames[i].id : (frames->ptrFrames[i].id << 18);
+        for(j = 0, rank = 0 ; j < frames->numberOfFrame ; j++)
+        {
+            key_j = frames->ptrFrames[j].idExtended ? frames->ptrFrames[j].id : (frames->ptrFrames[j].id << 18);
+            if((key_j < key_i) || ((key_j == key_i) && (j < i)))
+            {
+                rank++;
+            }
+        }
+        frames->ptrFrames[i].channel = ((DWORD) rank * CAN_NUM_OF_TX_CHANNELS) / frames->numberOfFrame;
+        if(frames->ptrFrames[i].deadline == TICK_INIT)
+        {
+            frames->ptrFrames[i].deadline = tick + (frames->ptrFrames[i].period * rank) / frames->numberOfFrame;
+        }
+        frames->ptrHeap[i] = i;
+    }
+    for(i = frames->numberOfFrame / 2 ; i > 0 ; i--)
+    {
+        CANHeapDown(frames, i - 1);
+    }
+    frames->isTxScheduleUpdated = TRUE;
+}
+
+/*******************************************************************************
+  Function:
+    void CANTaskTx(CAN_MODULE module, CAN_FRAMES *frames)
 
   Description:
     This routine is the deamon for the CAN transmission (full management of frames).
     This function must be called in the main loop (go inside as much as possible).
+    Only the frames whose deadline is reached are read (top of the heap). The next
+    deadline is the previous one + period (no drift). A frame is late when a
+    complete period is missed (the deadline is then resynchronized) or when its
+    Tx channel is full.
+    The statistics of a frame (jitterMax, numberOfLateFrame) can be read with CANGetFrame().
 
   Parameters:
     module      - Identifies the desired CAN module.
 
-    frames      - The CAN_FRAMES variable containing all dynamic frames.
+    frames      - The CAN_FRAMES variable containing all frames.
 
   Returns:
     None.
@@ -521,19 +831,57 @@ BOOL CANSendMessage(CAN_MODULE module, CAN_CHANNEL channel, DWORD id, BOOL idExt
   *****************************************************************************/
 void CANTaskTx(CAN_MODULE module, CAN_FRAMES *frames)
 {     
-    BYTE i = 0;
+    WORD i = 0;
+    BYTE flush = 0;
+    QWORD tick = mGetTick();
+    CAN_FRAME *frame;
     CAN_REGISTERS * canRegisters = (CAN_REGISTERS *)mCANModules[module];
     
-    for(i = 0 ; i < frames->numberOfFrame ; i++)
+    if(!frames->isTxScheduleUpdated)
+    {
+        CANBuildTxSchedule(frames, tick);
+    }
+    
+    // Each frame is read at most one time by call (even if its period is lower than the time between 2 calls)
+    for(i = 0 ; (i < frames->numberOfFrame) && (frames->ptrFrames[frames->ptrHeap[0]].deadline <= tick) ; i++)
     {
-        if((mTickCompare(frames->ptrFrames[i].tick) >= frames->ptrFrames[i].period) && frames->ptrFrames[i].enable)
+        frame = &frames->ptrFrames[frames->ptrHeap[0]];
+        if(frame->enable)
         {
-            frames->ptrFrames[i].tick = mGetTick();
-            CANAddMessageFifoBuffer(module, CAN_CHANNEL0, frames->ptrFrames[i].id, frames->ptrFrames[i].idExtended, frames->ptrFrames[i].length, frames->ptrFrames[i].data);    
-        } 
+            if((tick - frame->deadline) > frame->jitterMax)
+            {
+                frame->jitterMax = tick - frame->deadline;
+            }
+            if(CANAddMessageFifoBuffer(module, CAN_CHANNEL0 + frame->channel, frame->id, frame->idExtended, frame->length, frame->data))
+            {
+                frame->tick = tick;
+                flush |= (1 << frame->channel);
+            }
+            else
+            {
+                frame->numberOfLateFrame++;
+            }
+        }
+        frame->deadline += frame->period;
+        if(frame->deadline <= tick)
+        {
+            if(frame->enable)
+            {
+                frame->numberOfLateFrame++;
+            }
+            frame->deadline = tick + frame->period;
+        }
+        CANHeapDown(frames, 0);
+    }
+    
+    for(i = 0 ; i < CAN_NUM_OF_TX_CHANNELS ; i++)
+    {
+        if((flush >> i) & 0x01)
+        {
+            // TxFlush
+            canRegisters->canFifoRegisters[CAN_CHANNEL0 + i].CxFIFOCONSET = 0x00000008;
+        }
     }
-    // TxFlush
-    canRegisters->canFifoRegisters[CAN_CHANNEL0].CxFIFOCONSET = 0x00000008;
 }
 
 /*******************************************************************************
@@ -541,12 +889,13 @@ void CANTaskTx(CAN_MODULE module, CAN_FRAMES *frames)
     void CANAddFrame(CAN_FRAMES *frames, DWORD id, BOOL idExtended, BYTE length, QWORD period)
 
   Description:
-    This routine allow the user to create a new CAN frame. Each time a frame is
-    created (or removed) the RAM memory is dynamically modify. Thus the RAM
-    size is never constant and depends of the number of frame (Tx and Rx).
+    This routine allow the user to create a new CAN frame. Frames are stored in the
+    static pool of the CAN_FRAMES variable (cf. CAN_FRAMES_DEF) and sorted by increasing
+    period. The frame is not added if the pool is full.
+    The first transmission is done during the next period (cf. CANBuildTxSchedule()).
 
   Parameters:
-    frames      - The CAN_FRAMES variable containing all dynamic frames.
+    frames      - The CAN_FRAMES variable containing all frames.
 
     id          - The desier identifier.
 
@@ -565,20 +914,11 @@ void CANTaskTx(CAN_MODULE module, CAN_FRAMES *frames)
   *****************************************************************************/
 void CANAddFrame(CAN_FRAMES *frames, DWORD id, BOOL idExtended, BYTE length, QWORD period)
 {    
-    BYTE i = 0;
-    BYTE ind = frames->numberOfFrame;
+    WORD i = 0;
+    WORD ind = frames->numberOfFrame;
     
-    if(CANGetIndiceID(*frames, id) == -1)
+    if((frames->ptrHashTable[CANGetHashSlot(frames, id, idExtended)] == 0) && (frames->numberOfFrame < frames->maxFrames))
     {
-        if(frames->numberOfFrame == 0)
-        {
-            frames->ptrFrames = malloc(sizeof(CAN_FRAME));
-        }
-        else
-        {
-            frames->ptrFrames = realloc(frames->ptrFrames, (frames->numberOfFrame + 1)*sizeof(CAN_FRAME));
-        }
-        
         for(i = 0 ; i < frames->numberOfFrame ; i++)
         {
             if(frames->ptrFrames[i].period > period)
@@ -590,10 +930,7 @@ void CANAddFrame(CAN_FRAMES *frames, DWORD id, BOOL idExtended, BYTE length, QWO
         
         if(ind != frames->numberOfFrame)
         {
-            for(i = frames->numberOfFrame ; i > ind ; i--)
-            {
-                memcpy(&frames->ptrFrames[i], &frames->ptrFrames[i-1], sizeof(CAN_FRAME));
-            }
+            memmove(&frames->ptrFrames[ind + 1], &frames->ptrFrames[ind], (frames->numberOfFrame - ind)*sizeof(CAN_FRAME));
         }
         
         frames->ptrFrames[ind].enable = ON;
@@ -610,8 +947,14 @@ void CANAddFrame(CAN_FRAMES *frames, DWORD id, BOOL idExtended, BYTE length, QWO
         frames->ptrFrames[ind].data[7] = 0;
         frames->ptrFrames[ind].period = period;
         frames->ptrFrames[ind].tick = TICK_INIT;
+        frames->ptrFrames[ind].deadline = TICK_INIT;
+        frames->ptrFrames[ind].jitterMax = 0;
+        frames->ptrFrames[ind].numberOfLateFrame = 0;
         
         frames->numberOfFrame++;
+        frames->isTxScheduleUpdated = FALSE;
+        // The indices of the shifted frames have changed
+        CANRebuildHashTable(frames);
     }
 }
 
@@ -620,12 +963,11 @@ void CANAddFrame(CAN_FRAMES *frames, DWORD id, BOOL idExtended, BYTE length, QWO
     void CANRemoveFrame(CAN_FRAMES *frames, DWORD id)
 
   Description:
-    This routine allow the user to remove a CAN frame. Each time a frame is
-    created (or removed) the RAM memory is dynamically modify. Thus the RAM
-    size is never constant and depends of the number of frame (Tx and Rx).
+    This routine allow the user to remove a CAN frame. The order (increasing period)
+    of the remaining frames is kept.
 
   Parameters:
-    frames      - The CAN_FRAMES variable containing all dynamic frames.
+    frames      - The CAN_FRAMES variable containing all frames.
 
     id          - The desire identifier to remove.
 
@@ -638,52 +980,196 @@ void CANAddFrame(CAN_FRAMES *frames, DWORD id, BOOL idExtended, BYTE length, QWO
   *****************************************************************************/
 void CANRemoveFrame(CAN_FRAMES *frames, DWORD id)
 {
-    BYTE i;
-    CHAR8 ind = CANGetIndiceID(*frames, id);
+    INT32 ind = CANGetIndiceID(frames, id);
     if(ind >= 0)
     {
-        for(i = ind ; i < (frames->numberOfFrame - 1) ; i++)
+        memmove(&frames->ptrFrames[ind], &frames->ptrFrames[ind + 1], (frames->numberOfFrame - 1 - ind)*sizeof(CAN_FRAME));
+        frames->numberOfFrame--;
+        frames->isTxScheduleUpdated = FALSE;
+        CANRebuildHashTable(frames);
+    }
+}
+
+/*******************************************************************************
+  Function:
+    static DWORD CANGetHash(DWORD id, BOOL idExtended)
+
+  Description:
+    This routine must not be called by user. It returns the hash of the key (id, idExtended)
+    used to index the CAN_FRAMES variable (multiplicative hash - Knuth).
+
+  Parameters:
+    id          - The identifier.
+
+    idExtended  - 0: ID STANDAR / 1: ID EXTENDED.
+
+  Returns:
+    DWORD       - The hash of the key.
+
+  Example:
+    <code>
+    </code>
+  *****************************************************************************/
+static DWORD CANGetHash(DWORD id, BOOL idExtended)
+{
+    DWORD hash = (id | (idExtended ? 0x80000000 : 0)) * 2654435761u;
+    return (hash ^ (hash >> 16));
+}
+
+/*******************************************************************************
+  Function:
+    static WORD CANGetHashSlot(CAN_FRAMES *frames, DWORD id, BOOL idExtended)
+
+  Description:
+    This routine must not be called by user. It returns the slot of the hash table
+    containing the frame (id, idExtended) or the empty slot where this frame must be
+    inserted (linear probing). The hash table is never more than half full, so the
+    probe sequence always ends on an empty slot.
+
+  Parameters:
+    frames      - The CAN_FRAMES variable containing all frames.
+
+    id          - The identifier.
+
+    idExtended  - 0: ID STANDAR / 1: ID EXTENDED.
+
+  Returns:
+    WORD        - The slot of the hash table. ptrHashTable[slot] is 0 if the frame is not stored.
+
+  Example:
+    <code>
+    </code>
+  *****************************************************************************/
+static WORD CANGetHashSlot(CAN_FRAMES *frames, DWORD id, BOOL idExtended)
+{
+    WORD mask = 2*frames->maxFrames - 1;
+    WORD slot = CANGetHash(id, idExtended) & mask;
+    CAN_FRAME *frame;
+    
+    while(frames->ptrHashTable[slot] > 0)
+    {
+        frame = &frames->ptrFrames[frames->ptrHashTable[slot] - 1];
+        if((frame->id == id) && (!frame->idExtended == !idExtended))
         {
-            memcpy(&frames->ptrFrames[i], &frames->ptrFrames[i+1], sizeof(CAN_FRAME));
+            break;
         }
-        frames->numberOfFrame--;
-        frames->ptrFrames = realloc(frames->ptrFrames, frames->numberOfFrame*sizeof(CAN_FRAME));
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/*******************************************************************************
+  Function:
+    static void CANRemoveHashSlot(CAN_FRAMES *frames, WORD slot)
+
+  Description:
+    This routine must not be called by user. It clears a slot of the hash table and
+    shifts back the following slots of the probe sequence (no tombstone, so the
+    lookups stay short whatever the number of timeouts).
+
+  Parameters:
+    frames      - The CAN_FRAMES variable containing all frames.
+
+    slot        - The slot to remove.
+
+  Returns:
+    None.
+
+  Example:
+    <code>
+    </code>
+  *****************************************************************************/
+static void CANRemoveHashSlot(CAN_FRAMES *frames, WORD slot)
+{
+    WORD mask = 2*frames->maxFrames - 1;
+    WORD next = slot;
+    WORD home;
+    CAN_FRAME *frame;
+    
+    while(1)
+    {
+        next = (next + 1) & mask;
+        if(frames->ptrHashTable[next] == 0)
+        {
+            break;
+        }
+        frame = &frames->ptrFrames[frames->ptrHashTable[next] - 1];
+        home = CANGetHash(frame->id, frame->idExtended) & mask;
+        // The entry can fill the hole only if its home slot is not (cyclically) in ]slot..next]
+        if(((next - home) & mask) >= ((next - slot) & mask))
+        {
+            frames->ptrHashTable[slot] = frames->ptrHashTable[next];
+            slot = next;
+        }
+    }
+    frames->ptrHashTable[slot] = 0;
+}
+
+/*******************************************************************************
+  Function:
+    static void CANRebuildHashTable(CAN_FRAMES *frames)
+
+  Description:
+    This routine must not be called by user. It rebuilds the hash table after
+    the frames have been moved in the pool (CANAddFrame/CANRemoveFrame).
+
+  Parameters:
+    frames      - The CAN_FRAMES variable containing all frames.
+
+  Returns:
+    None.
+
+  Example:
+    <code>
+    </code>
+  *****************************************************************************/
+static void CANRebuildHashTable(CAN_FRAMES *frames)
+{
+    WORD i;
+    
+    memset(frames->ptrHashTable, 0, 2*frames->maxFrames*sizeof(WORD));
+    for(i = 0 ; i < frames->numberOfFrame ; i++)
+    {
+        frames->ptrHashTable[CANGetHashSlot(frames, frames->ptrFrames[i].id, frames->ptrFrames[i].idExtended)] = i + 1;
     }
 }
 
 /*******************************************************************************
   Function:
-    CHAR8 CANGetIndiceID(CAN_FRAMES frames, DWORD id)
+    INT32 CANGetIndiceID(CAN_FRAMES *frames, DWORD id)
 
   Description:
     This routine return the indice (of an array) corresponding of the desire ID.
     The CAN_FRAMES variable contains an array of CAN_FRAME, each CAN_FRAME as an unique
     identifier but we don't know where this frame is located in memory. This function
-    return this information.
+    return this information (hash table lookup). A standard ID is searched first
+    then an extended ID.
 
   Parameters:
-    frames      - The CAN_FRAMES variable containing all dynamic frames.
+    frames      - The CAN_FRAMES variable containing all frames.
 
-    id          - The desire identifier to remove.
+    id          - The desire identifier.
 
   Returns:
-    CHAR8       - The indice of CAN_FRAME array.
+    INT32       - The indice of CAN_FRAME array (-1 if not found).
 
   Example:
     <code>
     </code>
   *****************************************************************************/
-CHAR8 CANGetIndiceID(CAN_FRAMES frames, DWORD id)
+INT32 CANGetIndiceID(CAN_FRAMES *frames, DWORD id)
 {
-    BYTE i;
-    for(i = 0 ; i < frames.numberOfFrame ; i++)
+    WORD ind = 0;
+    
+    if(id <= 0x7ff)
     {
-        if(frames.ptrFrames[i].id == id)
-        {
-            return i;
-        }
+        ind = frames->ptrHashTable[CANGetHashSlot(frames, id, CAN_ID_STANDARD)];
     }
-    return -1;
+    if(ind == 0)
+    {
+        ind = frames->ptrHashTable[CANGetHashSlot(frames, id, CAN_ID_EXTENDED)];
+    }
+    return ((INT32) ind - 1);
 }
 
 /*******************************************************************************
@@ -706,7 +1192,7 @@ CHAR8 CANGetIndiceID(CAN_FRAMES frames, DWORD id)
   Example:
     <code>
 
-    CAN_FRAMES framesTx = INIT_CAN_FRAMES();
+    CAN_FRAMES_DEF(framesTx, 8);
     ...
     CANEnableFrame(&framesTx, 0x200, OFF);
     ...
@@ -715,7 +1201,7 @@ CHAR8 CANGetIndiceID(CAN_FRAMES frames, DWORD id)
   *****************************************************************************/
 void CANEnableFrame(CAN_FRAMES *frames, DWORD id, BOOL enable)
 {
-    CHAR8 ind = CANGetIndiceID(*frames, id);
+    INT32 ind = CANGetIndiceID(frames, id);
     if(ind >= 0)
     {
         frames->ptrFrames[ind].enable = enable;
@@ -743,7 +1229,7 @@ void CANEnableFrame(CAN_FRAMES *frames, DWORD id, BOOL enable)
   Example:
     <code>
 
-    CAN_FRAMES framesTx = INIT_CAN_FRAMES();
+    CAN_FRAMES_DEF(framesTx, 8);
     BYTE newDataArray[8] = {...};
     ...
     CANSetData(&framesTx, 0x200, newDataArray);
@@ -753,7 +1239,7 @@ void CANEnableFrame(CAN_FRAMES *frames, DWORD id, BOOL enable)
   *****************************************************************************/
 void CANSetData(CAN_FRAMES *frames, DWORD id, BYTE data[8])
 {
-    CHAR8 ind = CANGetIndiceID(*frames, id);
+    INT32 ind = CANGetIndiceID(frames, id);
     if(ind >= 0)
     {
         memcpy(frames->ptrFrames[ind].data, data, 8);
@@ -782,7 +1268,7 @@ void CANSetData(CAN_FRAMES *frames, DWORD id, BYTE data[8])
   Example:
     <code>
 
-    CAN_FRAMES framesTx = INIT_CAN_FRAMES();
+    CAN_FRAMES_DEF(framesTx, 8);
     BYTE newDataArray[8] = {...};
     ...
     CANSetData_mask(&framesTx, 0x200, newDataArray, 0b00111100); // Only BYTES 2, 3, 4, 5 will me modify in framesTx.
@@ -792,7 +1278,7 @@ void CANSetData(CAN_FRAMES *frames, DWORD id, BYTE data[8])
   *****************************************************************************/
 void CANSetData_mask(CAN_FRAMES *frames, DWORD id, BYTE data[8], BYTE mask)
 {
-    CHAR8 ind = CANGetIndiceID(*frames, id);
+    INT32 ind = CANGetIndiceID(frames, id);
     if(ind >= 0)
     {
         if((mask >> 0) & 0x01)      {frames->ptrFrames[ind].data[0] = data[0];}
@@ -831,7 +1317,7 @@ void CANSetData_mask(CAN_FRAMES *frames, DWORD id, BYTE data[8], BYTE mask)
   *****************************************************************************/
 void CANSetData1Byte(CAN_FRAMES *frames, DWORD id, BYTE indiceData, BYTE data)
 {
-    CHAR8 ind = CANGetIndiceID(*frames, id);
+    INT32 ind = CANGetIndiceID(frames, id);
     if(ind >= 0)
     {
         frames->ptrFrames[ind].data[indiceData] = data;
@@ -845,11 +1331,11 @@ void CANSetData1Byte(CAN_FRAMES *frames, DWORD id, BYTE indiceData, BYTE data)
   Description:
     This routine create a link between the CAN_FRAMES variable (creating by user in the main)
     and the receive functions (not accessible by user). If this link is not realized then
-    each receive frames will not be stored in RAM memory (so frames will only be accessible
-    in the interrupt handler).
-    The CAN_FRAMES variable for reception is also dynamicaly managed. RAM size depends
-    of the number of reading CAN frame. A timeout can be setting in order to release memory
-    (for frame that are no longer present). Cf. CANFreedomReceiveMemory function.
+    each receive frames will not be stored in RAM memory (the messages are only removed
+    from the queue by CANDeamonRx).
+    The received frames are stored in the static pool of the CAN_FRAMES variable (cf. CAN_FRAMES_DEF).
+    New IDs are dropped (numberOfLostFrame) when the pool is full. A timeout can be setting in order
+    to release the entries (for frame that are no longer present). Cf. CANFreedomReceiveMemory function.
 
   Parameters:
     module      - The desire CAN module.
@@ -874,8 +1360,13 @@ void CANSetLinkForFramesReception(CAN_MODULE module, CAN_FRAMES *frames)
 
   Description:
     This routine is the deamon for the CAN reception (full management of frames).
-    This function must be called in the interrupt handler (called eache time a new
-    frame is received).
+    By default this function must be called in the main loop (polled mode). If
+    CAN_RX_INTERRUPT_ENABLE is set, it must be called in the CAN interrupt handler
+    (enabled by CANInit() with the priority irq_can_priority) instead.
+    All the messages of all the Rx channels are copied in a queue (CAN_RX_QUEUE_SIZE
+    messages) and the hardware FIFO are released immediately. The messages are then
+    stored in the frames by CANDeamonRx() in the main loop.
+    When the queue is full, the messages are lost (mCANGetNumberOfDroppedFrame).
 
   Parameters:
     module      - The desire CAN module.
@@ -889,51 +1380,104 @@ void CANSetLinkForFramesReception(CAN_MODULE module, CAN_FRAMES *frames)
   *****************************************************************************/
 void CANTaskRx(CAN_MODULE module)
 {
-    CAN_EVENT_CODE eventCode;
-    CANRxMessageBuffer* mCANGetMessageBuffer[CAN_NUM_OF_MODULES];
+    BYTE i;
+    DWORD pending, overflow;
+    CANRxMessageBuffer *message;
+    CAN_RX_QUEUE *queue = &mCANRxQueue[module];
+    WORD head = queue->head;
     CAN_REGISTERS * canRegisters = (CAN_REGISTERS *)mCANModules[module];
     
-    if((CANGetModuleEvent(module) & CAN_RX_EVENT) != 0)
+    // Channels with a pending interrupt (not empty/full/overflow)
+    pending = canRegisters->CxFSTAT & ~((1ul << CAN_NUM_OF_TX_CHANNELS) - 1);
+    overflow = canRegisters->CxRXOVF & pending;
+    
+    for(i = CAN_NUM_OF_TX_CHANNELS ; (i < CAN_NUM_OF_CHANNELS) && (pending > 0) ; i++)
     {
-        eventCode = CANGetPendingEventCode(module);
-        switch(eventCode)
+        if((pending >> i) & 0x01)
         {
-            case CAN_NO_EVENT:
-                break;
-            case CAN_ERROR_EVENT:
-                break;
-            case CAN_WAKEUP_EVENT:
-                break;
-            default:
-                // Up to 32 Channels Event (cf. CANInit() for configuration of channels)
-                mCANGetMessageBuffer[module] = (CANRxMessageBuffer*)CANGetRxMessage(module, eventCode);
-                // Update channel            
-                canRegisters->canFifoRegisters[eventCode].CxFIFOCONSET = 0x00002000;
-                if(mCANAdressFramesRx[module] != NULL)
+            pending &= ~(1ul << i);
+            if((overflow >> i) & 0x01)
+            {
+                queue->numberOfOverflow++;
+                canRegisters->canFifoRegisters[i].CxFIFOINTCLR = 0x00000008;
+            }
+            while((message = (CANRxMessageBuffer*) CANGetRxMessage(module, CAN_CHANNEL0 + i)) != NULL)
+            {
+                if(((head + 1) & (CAN_RX_QUEUE_SIZE - 1)) != queue->tail)
                 {
-                    CANAddToReceivedBuffer(module, *mCANGetMessageBuffer[module]);
+                    queue->messages[head].id = message->msgEID.IDE ? (message->msgEID.EID | CAN_RX_MESSAGE_EXTENDED) : message->msgSID.SID;
+                    queue->messages[head].length = message->msgEID.DLC;
+                    memcpy(queue->messages[head].data, message->data, 8);
+                    head = (head + 1) & (CAN_RX_QUEUE_SIZE - 1);
                 }
-                break;
+                else
+                {
+                    queue->numberOfDroppedFrame++;
+                }
+                // Update channel
+                canRegisters->canFifoRegisters[i].CxFIFOCONSET = 0x00002000;
+            }
+        }
+    }
+    // The messages must be written before the new head is visible by CANDeamonRx()
+    __sync_synchronize();
+    queue->head = head;
+    irq_clr_flag(IRQ_CAN1 + module);
+}
+
+/*******************************************************************************
+  Function:
+    void CANDeamonRx(CAN_MODULE module)
+
+  Description:
+    This routine stores the messages received by CANTaskRx() in the CAN_FRAMES variable
+    linked with the module (cf. CANSetLinkForFramesReception).
+    This function must be called in the main loop (go inside as much as possible).
+
+  Parameters:
+    module      - The desire CAN module.
+
+  Returns:
+    None.
+
+  Example:
+    <code>
+    </code>
+  *****************************************************************************/
+void CANDeamonRx(CAN_MODULE module)
+{
+    CAN_RX_QUEUE *queue = &mCANRxQueue[module];
+    WORD tail = queue->tail;
+    
+    while(tail != queue->head)
+    {
+        if(mCANAdressFramesRx[module] != NULL)
+        {
+            CANAddToReceivedBuffer(mCANAdressFramesRx[module], &queue->messages[tail]);
         }
+        tail = (tail + 1) & (CAN_RX_QUEUE_SIZE - 1);
+        // The message must be read before its place is released for CANTaskRx()
+        __sync_synchronize();
+        queue->tail = tail;
     }
 }
 
 /*******************************************************************************
   Function:
-    static void CANAddToReceivedBuffer(CAN_MODULE module, CANRxMessageBuffer frame)
+    static void CANAddToReceivedBuffer(CAN_FRAMES *frames, const CAN_RX_MESSAGE *message)
 
   Description:
     This routine must not be called by user. It's an internal function used by
-    the CAN driver when the CANTaskRx is called.
-    When a new frame is detected then it's automaticaly store is the RAM
-    memory (dynamicaly) or data is updated if already stored.
+    the CAN driver when the CANDeamonRx is called.
+    When a new frame is detected then it's automaticaly store in the pool
+    (O(1) hash table lookup) or data is updated if already stored.
     Be careful, the CANSetLinkForFramesReception function must be called
     in order to use the RAM memory storage.
 
   Parameters:
-    frames      - The CAN_FRAMES variable containing all dynamic frames.
+    frames      - The CAN_FRAMES variable containing all frames.
 
-    frame       - The CAN frame received.
+    message     - The CAN message received.
 
   Returns:
     None.
@@ -942,60 +1486,53 @@ void CANTaskRx(CAN_MODULE module)
     <code>
     </code>
   *****************************************************************************/
-static void CANAddToReceivedBuffer(CAN_MODULE module, CANRxMessageBuffer frame)
+static void CANAddToReceivedBuffer(CAN_FRAMES *frames, const CAN_RX_MESSAGE *message)
 {
-    CHAR8 ind;
-    if(frame.msgEID.IDE)        // Extended ID
-    {
-        ind = CANGetIndiceID(*mCANAdressFramesRx[module], (DWORD) frame.msgEID.EID);
-    }
-    else                        // Standar ID
-    {
-        ind = CANGetIndiceID(*mCANAdressFramesRx[module], (DWORD) frame.msgSID.SID);
-    }
+    BOOL idExtended = (message->id & CAN_RX_MESSAGE_EXTENDED) ? CAN_ID_EXTENDED : CAN_ID_STANDARD;
+    DWORD id = message->id & ~CAN_RX_MESSAGE_EXTENDED;
+    WORD slot = CANGetHashSlot(frames, id, idExtended);
+    WORD ind;
+    QWORD tick = mGetTick();
 
-    if(ind == -1)               // New frame (not yet stored in receive buffer)
+    if(frames->ptrHashTable[slot] == 0)     // New frame (not yet stored in receive buffer)
     {
-        ind = mCANAdressFramesRx[module]->numberOfFrame;
-        if(ind == 0)
+        if(frames->numberOfFrame >= frames->maxFrames)
         {
-            mCANAdressFramesRx[module]->ptrFrames = malloc(sizeof(CAN_FRAME));
+            frames->numberOfLostFrame++;
+            return;
         }
-        else
-        {
-            mCANAdressFramesRx[module]->ptrFrames = realloc(mCANAdressFramesRx[module]->ptrFrames, (ind + 1)*sizeof(CAN_FRAME));
-        }
-        mCANAdressFramesRx[module]->ptrFrames[ind].enable = ON;
-        if(frame.msgEID.IDE)    // Extended ID
-        {
-            mCANAdressFramesRx[module]->ptrFrames[ind].id = frame.msgEID.EID;
-        }
-        else                    // Standar ID
-        {
-            mCANAdressFramesRx[module]->ptrFrames[ind].id = frame.msgSID.SID;
-        }
-        mCANAdressFramesRx[module]->ptrFrames[ind].idExtended = frame.msgEID.IDE;
-        mCANAdressFramesRx[module]->numberOfFrame++;
+        ind = frames->numberOfFrame;
+        frames->ptrFrames[ind].enable = ON;
+        frames->ptrFrames[ind].id = id;
+        frames->ptrFrames[ind].idExtended = idExtended;
+        frames->ptrFrames[ind].tick = tick;
+        frames->ptrHashTable[slot] = ind + 1;
+        frames->numberOfFrame++;
+    }
+    else
+    {
+        ind = frames->ptrHashTable[slot] - 1;
     }
 
-    mCANAdressFramesRx[module]->ptrFrames[ind].length = frame.msgEID.DLC;
-    memcpy(mCANAdressFramesRx[module]->ptrFrames[ind].data, frame.data, 8);
-    mCANAdressFramesRx[module]->ptrFrames[ind].period = mGetTick() - mCANAdressFramesRx[module]->ptrFrames[ind].tick;
-    mCANAdressFramesRx[module]->ptrFrames[ind].tick = mGetTick();
+    frames->ptrFrames[ind].length = message->length;
+    memcpy(frames->ptrFrames[ind].data, message->data, 8);
+    frames->ptrFrames[ind].period = tick - frames->ptrFrames[ind].tick;
+    frames->ptrFrames[ind].tick = tick;
 }
 
 /*******************************************************************************
   Function:
-    void CANFreedomReceiveMemory(CAN_FRAMES *frame, QWORD timeout)
+    void CANFreedomReceiveMemory(CAN_FRAMES *frames, QWORD timeout)
 
   Description:
-    This routine allow the program to realease RAM memory when a frame is no longer
-    present on the BUS. This timeout is define by the user.
-    We are doing that because the CAN_FRAMES variable for reception is dynamicaly managed.
-    RAM size depends of the number of reading CAN frame.
+    This routine allow the program to remove a frame when it is no longer present
+    on the BUS. This timeout is define by the user. Only one frame is checked
+    each time the function is called.
+    The last frame of the pool takes the place of the removed frame, so the
+    indices of the received frames can change after a timeout.
 
   Parameters:
-    frames      - The CAN_FRAMES variable containing all dynamic frames.
+    frames      - The CAN_FRAMES variable containing all frames.
 
     timeout     - The desire timeout.
 
@@ -1008,36 +1545,44 @@ static void CANAddToReceivedBuffer(CAN_MODULE module, CANRxMessageBuffer frame)
   *****************************************************************************/
 void CANFreedomReceiveMemory(CAN_FRAMES *frames, QWORD timeout)
 {
-    static BYTE i = 0, j = 0;
+    WORD i = frames->indiceTimeout;
+    WORD last;
 
     if(frames->numberOfFrame > 0)
     {
+        if(i >= frames->numberOfFrame)
+        {
+            i = 0;
+        }
         if(mTickCompare(frames->ptrFrames[i].tick) > timeout)
         {
-            for(j = i ; j < (frames->numberOfFrame - 1) ; j++)
+            last = frames->numberOfFrame - 1;
+            CANRemoveHashSlot(frames, CANGetHashSlot(frames, frames->ptrFrames[i].id, frames->ptrFrames[i].idExtended));
+            if(i != last)
             {
-                memcpy(&frames->ptrFrames[j], &frames->ptrFrames[j+1], sizeof(CAN_FRAME));
+                memcpy(&frames->ptrFrames[i], &frames->ptrFrames[last], sizeof(CAN_FRAME));
+                frames->ptrHashTable[CANGetHashSlot(frames, frames->ptrFrames[i].id, frames->ptrFrames[i].idExtended)] = i + 1;
             }
             frames->numberOfFrame--;
-            frames->ptrFrames = realloc(frames->ptrFrames, frames->numberOfFrame*sizeof(CAN_FRAME));
         }
-        if(++i >= frames->numberOfFrame)
+        else
         {
-            i = 0;
+            i++;
         }
+        frames->indiceTimeout = i;
     }
 }
 
 /*******************************************************************************
   Function:
-    CAN_FRAME* CANGetFrame(CAN_FRAMES frame, DWORD id)
+    CAN_FRAME* CANGetFrame(CAN_FRAMES *frames, DWORD id)
 
   Description:
     This routine allow the user to get the content of a frame (define by the
     ID in parameter).
 
   Parameters:
-    frames      - The CAN_FRAMES variable containing all dynamic frames.
+    frames      - The CAN_FRAMES variable containing all frames.
 
     id          - The identifier of the receive frame.
 
@@ -1050,13 +1595,13 @@ void CANFreedomReceiveMemory(CAN_FRAMES *frames, QWORD timeout)
     cf. can.c header
     </code>
   *****************************************************************************/
-CAN_FRAME* CANGetFrame(CAN_FRAMES frame, DWORD id)
+CAN_FRAME* CANGetFrame(CAN_FRAMES *frames, DWORD id)
 {
-    CHAR8 indId = CANGetIndiceID(frame, id);
+    INT32 indId = CANGetIndiceID(frames, id);
     
     if(indId != -1)
     {
-        return (CAN_FRAME*) (&frame.ptrFrames[indId]);
+        return (CAN_FRAME*) (&frames->ptrFrames[indId]);
     }
     else
     {
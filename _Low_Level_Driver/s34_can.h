@@ -17,12 +17,23 @@
     #endif
 #endif
 
-// x * y * z
+// Channels 0..(CAN_NUM_OF_TX_CHANNELS-1) are used for the transmission (channel 0: highest priority)
+// and the other channels for the reception (cf. CANInit())
+#define CAN_NUM_OF_TX_CHANNELS      3
+#define CAN_NUM_OF_RX_CHANNELS      (32 - CAN_NUM_OF_TX_CHANNELS)
+#define CAN_TX_CHANNEL_SIZE         16
+#define CAN_RX_CHANNEL_SIZE         5
+
+#if (CAN_NUM_OF_TX_CHANNELS < 1) || (CAN_NUM_OF_TX_CHANNELS > 4)
+#error "CAN_NUM_OF_TX_CHANNELS must be in 1..4 (one hardware priority level per channel)"
+#endif
+
+// (x1 * y1 + x2 * y2) * z
 // x: number of channel use
 // y: number of message buffer use (with all channel use - define by x)
 // z: if full message then 16 else if data-only then 8
 // For more details, cf PIC32 MX CAN Peripheral Libraries
-#define CAN_SIZE_MESSAGE_FIFO_AREA ((32 + (31 * 5)) * 16)
+#define CAN_SIZE_MESSAGE_FIFO_AREA ((CAN_NUM_OF_TX_CHANNELS * CAN_TX_CHANNEL_SIZE + CAN_NUM_OF_RX_CHANNELS * CAN_RX_CHANNEL_SIZE) * 16)
 
 // Prop + Seg1 >= Seg2
 // Seg2 > SJW
@@ -339,14 +350,51 @@ typedef struct
     BYTE    data[8];
     QWORD   period;
     QWORD   tick;
+    QWORD   deadline;                       // Tx: next transmission
+    DWORD   jitterMax;                      // Tx: max delay (tick) between the deadline and the transmission
+    DWORD   numberOfLateFrame;              // Tx: transmissions missed (period exceeded or Tx channel full)
+    BYTE    channel;                        // Tx: offset of the Tx channel (CAN ID priority)
 }CAN_FRAME;
 
+// Frames are stored in a static pool (ptrFrames[0..numberOfFrame-1]) and indexed by an open addressing
+// hash table on (id, idExtended). Each slot of the hash table contains the indice + 1 of the frame (0: empty slot).
+// For the transmission, the frames are scheduled by a binary min-heap on their deadline.
 typedef struct
 {
-    BYTE    numberOfFrame;
+    WORD    numberOfFrame;
+    WORD    maxFrames;                      // Capacity of the pool (power of 2)
+    WORD    indiceTimeout;                  // Next frame checked by CANFreedomReceiveMemory()
+    WORD    numberOfLostFrame;              // Frames received with a new ID while the pool was full
     CAN_FRAME *ptrFrames;
+    WORD    *ptrHashTable;                  // 2 * maxFrames slots
+    WORD    *ptrHeap;                       // Tx: indices of the frames sorted by deadline (min-heap)
+    BOOL    isTxScheduleUpdated;            // Tx: FALSE when a frame has been added/removed
 }CAN_FRAMES;
 
+// Compact copy of a received message - filled by CANTaskRx() and read by CANDeamonRx() (main loop)
+typedef struct
+{
+    DWORD   id;                             // bit 31: extended ID
+    BYTE    length;
+    BYTE    data[8];
+}CAN_RX_MESSAGE;
+
+#define CAN_RX_QUEUE_SIZE           64      // Power of 2
+#define CAN_RX_INTERRUPT_ENABLE     0       // 1: CANInit() enables the CAN interrupt and CANTaskRx() must be called in its handler (the vector is provided by the user) / 0: CANTaskRx() is called in the main loop
+#define CAN_RX_MESSAGE_EXTENDED     0x80000000
+
+// Single producer (CANTaskRx) / single consumer (CANDeamonRx) queue: no lock needed even if CANTaskRx() runs in the interrupt
+typedef struct
+{
+    volatile WORD   head;                   // Written only by CANTaskRx()
+    volatile WORD   tail;                   // Written only by CANDeamonRx()
+    DWORD   numberOfDroppedFrame;           // Messages lost because the queue was full
+    DWORD   numberOfOverflow;               // Hardware FIFO overflows (messages lost before the interrupt)
+    CAN_RX_MESSAGE messages[CAN_RX_QUEUE_SIZE];
+}CAN_RX_QUEUE;
+
+#define CAN_FILTERS_MAX_ID          128     // Max number of IDs for CANComputeFilters()
+
 typedef struct
 {
     UINT32  mask[4];
@@ -355,28 +403,51 @@ typedef struct
 }CAN_FILTERS;
 
 #define INIT_CAN_FRAME(id, idExtended, length, period)      {ON, id, idExtended, length, {0}, period, TICK_INIT}
-#define INIT_CAN_FRAMES()                                   {0, NULL}
+#define INIT_CAN_FRAMES(_frames, _hash_table, _heap, _max_frames)   {0, _max_frames, 0, 0, _frames, _hash_table, _heap, FALSE}
 #define INIT_CAN_FILTERS()                                  {{0}, {0}, {0}}
 
+#define mCANGetNumberOfDroppedFrame(module)                 (mCANRxQueue[module].numberOfDroppedFrame)
+#define mCANGetNumberOfOverflow(module)                     (mCANRxQueue[module].numberOfOverflow)
+
+// _max_frames must be a power of 2 (the hash table has 2 * _max_frames slots in order to keep short probe sequences
+// and CANGetHashSlot() wraps its probes with a 2 * _max_frames - 1 mask): any other value gives a negative hash table size.
+#define CAN_IS_POWER_OF_2(n)                                (((n) > 0) && (((n) & ((n) - 1)) == 0))
+#define CAN_FRAMES_DEF(_name, _max_frames)                                                      \
+static CAN_FRAME _name ## _frames_ram_allocation[_max_frames];                                  \
+static WORD _name ## _hash_table_ram_allocation[CAN_IS_POWER_OF_2(_max_frames) ? (2 * (_max_frames)) : -1] = {0};   \
+static WORD _name ## _heap_ram_allocation[_max_frames];                                         \
+static CAN_FRAMES _name = INIT_CAN_FRAMES(_name ## _frames_ram_allocation, _name ## _hash_table_ram_allocation, _name ## _heap_ram_allocation, _max_frames)
+
+extern CAN_RX_QUEUE mCANRxQueue[CAN_NUM_OF_MODULES];
+
 void CANInit(CAN_MODULE module, DWORD busSpeed);
 static void CANConfigFilter(CAN_MODULE module, CAN_FILTER filter, UINT32 id);
 static void CANConfigMask(CAN_MODULE module, CAN_FILTER_MASK mask, UINT32 maskbits);
 static void CANLinkFilterToChannelAndEnable(CAN_MODULE module, CAN_FILTER filter, CAN_FILTER_MASK mask, CAN_CHANNEL channel, BOOL enable);
 void CANDeamonFilters(CAN_MODULE module, CAN_FILTERS *filters);
+static BYTE CANGetNumberOfDontCareBits(DWORD mask);
+BYTE CANComputeFilters(CAN_FILTERS *filters, const DWORD *ids, BYTE numberOfId);
 static BOOL CANAddMessageFifoBuffer(CAN_MODULE module, CAN_CHANNEL channel, DWORD id, BOOL idExtended, BYTE length, BYTE* data);
 BOOL CANSendMessage(CAN_MODULE module, CAN_CHANNEL channel, DWORD id, BOOL idExtended, BYTE length, BYTE* data);
-void CANTaskTx(CAN_MODULE module, CAN_FRAMES *frame);
+static void CANHeapDown(CAN_FRAMES *frames, WORD position);
+static void CANBuildTxSchedule(CAN_FRAMES *frames, QWORD tick);
+void CANTaskTx(CAN_MODULE module, CAN_FRAMES *frames);
 void CANAddFrame(CAN_FRAMES *frames, DWORD id, BOOL idExtended, BYTE length, QWORD period);
 void CANRemoveFrame(CAN_FRAMES *frames, DWORD id);
-CHAR8 CANGetIndiceID(CAN_FRAMES frames, DWORD id);
+static DWORD CANGetHash(DWORD id, BOOL idExtended);
+static WORD CANGetHashSlot(CAN_FRAMES *frames, DWORD id, BOOL idExtended);
+static void CANRemoveHashSlot(CAN_FRAMES *frames, WORD slot);
+static void CANRebuildHashTable(CAN_FRAMES *frames);
+INT32 CANGetIndiceID(CAN_FRAMES *frames, DWORD id);
 void CANEnableFrame(CAN_FRAMES *frames, DWORD id, BOOL enable);
 void CANSetData(CAN_FRAMES *frames, DWORD id, BYTE data[8]);
 void CANSetData_mask(CAN_FRAMES *frames, DWORD id, BYTE data[8], BYTE mask);
 void CANSetData1Byte(CAN_FRAMES *frames, DWORD id, BYTE indiceData, BYTE data);
 void CANSetLinkForFramesReception(CAN_MODULE module, CAN_FRAMES *frames);
 void CANTaskRx(CAN_MODULE module);
-static void CANAddToReceivedBuffer(CAN_MODULE module, CANRxMessageBuffer frame);
-void CANFreedomReceiveMemory(CAN_FRAMES *frame, QWORD timeout);
-CAN_FRAME* CANGetFrame(CAN_FRAMES frame, DWORD id);
+void CANDeamonRx(CAN_MODULE module);
+static void CANAddToReceivedBuffer(CAN_FRAMES *frames, const CAN_RX_MESSAGE *message);
+void CANFreedomReceiveMemory(CAN_FRAMES *frames, QWORD timeout);
+CAN_FRAME* CANGetFrame(CAN_FRAMES *frames, DWORD id);
 
 #endif
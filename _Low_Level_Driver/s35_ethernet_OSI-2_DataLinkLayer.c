@@ -44,6 +44,8 @@ int _stackMgrRxBadPkts = 0;
 int _stackMgrInGetHdr = 0;
 int _stackMgrRxDiscarded = 0;
 int _stackMgrTxNotReady = 0;
+int _stackMgrRxBytes = 0;       // bytes received in valid frames
+int _stackMgrRxCopiedBytes = 0; // bytes copied out of the RX buffers (MACGetArray, MACMemCopyAsync)
 
 /******************************************************************************
  * ---MACInit
@@ -95,7 +97,8 @@ BYTE MACInit(void)
     }
 
 
-    if (EthDescriptorsPoolAdd(EMAC_TX_DESCRIPTORS, ETH_DCPT_TYPE_TX, _MacAllocCallback, 0) != EMAC_TX_DESCRIPTORS) 
+    // every queued frame can use one hardware descriptor per fragment
+    if (EthDescriptorsPoolAdd(EMAC_TX_DESCRIPTORS * EMAC_TX_FRAGMENTS, ETH_DCPT_TYPE_TX, _MacAllocCallback, 0) != EMAC_TX_DESCRIPTORS * EMAC_TX_FRAGMENTS) 
     {
         initFail++;
     }
@@ -156,6 +159,8 @@ BOOL MACIsLinked(void)
  * ---MACIsTxReady
  * TRUE: If data can be inserted in the current TX buffer
  * FALSE: there is no free TX buffer
+ * The TX buffers are used as a ring: up to EMAC_TX_DESCRIPTORS frames can be
+ * queued in the ETHC, they are released by _TxAckCallback() once sent.
  ******************************************************************************/
 BOOL MACIsTxReady(void) 
 {
@@ -186,6 +191,10 @@ BOOL MACIsTxReady(void)
                 }
             }
         }
+        if (_pTxCurrDcpt != 0) 
+        {
+            _pTxCurrDcpt->nFragments = 0;
+        }
     }
 
 
@@ -225,6 +234,7 @@ WORD MACGetArray(BYTE *address, WORD len)
     if (address) 
     {
         memcpy(address, _CurrRdPtr, len);
+        _stackMgrRxCopiedBytes += len;
     }
 
     _CurrRdPtr += len;
@@ -237,6 +247,35 @@ void MACPutArray(BYTE *buff, WORD len)
     _CurrWrPtr += len;
 }
 
+/******************************************************************************
+ * ---MACPutArrayRef
+ * Appends len bytes of buff to the current TX frame without copying them
+ * (scatter-gather). The referenced fragments are sent in call order after
+ * the bytes written in the TX buffer, so buff must stay unchanged until the
+ * frame has been transmitted. The dataLen given to MACPutHeader() includes
+ * them. At most EMAC_TX_FRAGMENTS - 1 fragments can be added per frame:
+ * FALSE is returned when no fragment is left, and the caller must then
+ * not send the frame (its length would not match the headers).
+ ******************************************************************************/
+BOOL MACPutArrayRef(BYTE *buff, WORD len) 
+{
+    int ix;
+
+    if (len == 0) 
+    {
+        return TRUE;
+    }
+    if (_pTxCurrDcpt->nFragments >= EMAC_TX_FRAGMENTS - 1) 
+    {
+        return FALSE;
+    }
+
+    ix = ++_pTxCurrDcpt->nFragments;
+    _pTxCurrDcpt->fragments[ix].pBuff = buff;
+    _pTxCurrDcpt->fragments[ix].nBytes = len;
+    return TRUE;
+}
+
 /******************************************************************************
  * ---MACGetHeader
  * Input:           *remote: Location to store the Source MAC address of the
@@ -293,6 +332,7 @@ BOOL MACGetHeader(MAC_ADDR *remote, BYTE* type)
             WORD_VAL newType;
             _RxCurrSize = pRxPktStat->rxBytes;
             _pRxCurrBuff = pNewPkt;
+            _stackMgrRxBytes += _RxCurrSize;
             _CurrRdPtr = _pRxCurrBuff + sizeof (ETHER_HEADER); // skip the packet header
             // set the packet type
             memcpy(remote, &((ETHER_HEADER*) pNewPkt)->SourceMACAddr, sizeof (*remote));
@@ -345,6 +385,57 @@ WORD MACCalcRxChecksum(WORD offset, WORD len)
     return CalcIPChecksum(_pRxCurrBuff + sizeof(ETHER_HEADER) + offset, len);
 }
 
+/******************************************************************************
+ * ---MACCalcTxChecksum
+ * This function performs a checksum calculation of len bytes of the current
+ * TX frame, from offset (after the ETH header), including the fragments
+ * referenced by MACPutArrayRef(). MACPutHeader() must have been called.
+ ******************************************************************************/
+WORD MACCalcTxChecksum(WORD offset, WORD len) 
+{
+    DWORD_VAL sum;
+    WORD_VAL part;
+    WORD n;
+    BOOL bOdd;
+    int ix;
+
+    // size of the part of the frame held in the TX buffer
+    n = _TxCurrSize - sizeof(ETHER_HEADER) - offset;
+    for (ix = 1; ix <= _pTxCurrDcpt->nFragments; ix++) 
+    {
+        n -= _pTxCurrDcpt->fragments[ix].nBytes;
+    }
+    if (n > len) 
+    {
+        n = len;
+    }
+
+    sum.Val = (WORD)~CalcIPChecksum((BYTE*) _pTxCurrDcpt->dataBuff + sizeof(ETHER_HEADER) + offset, n);
+    bOdd = n & 1;
+    len -= n;
+
+    for (ix = 1; ix <= _pTxCurrDcpt->nFragments && len; ix++) 
+    {
+        n = _pTxCurrDcpt->fragments[ix].nBytes;
+        if (n > len) 
+        {
+            n = len;
+        }
+        part.Val = (WORD)~CalcIPChecksum((BYTE*) _pTxCurrDcpt->fragments[ix].pBuff, n);
+        if (bOdd) 
+        { // the fragment starts on an odd byte of the checksummed area
+            part.Val = swap_word(part.Val);
+        }
+        sum.Val += part.Val;
+        bOdd ^= n & 1;
+        len -= n;
+    }
+
+    sum.Val = (DWORD)sum.w[0] + (DWORD)sum.w[1];
+    sum.Val = (DWORD)sum.w[0] + (DWORD)sum.w[1];
+    return ~sum.w[0];
+}
+
 /******************************************************************************
  * ---MACDiscardRx
  * Marks the last received packet (obtained using
@@ -364,12 +455,41 @@ void MACDiscardRx(void)
     }
 }
 
+/******************************************************************************
+ * ---MACFlush
+ * Queues the current TX frame in the ETHC and returns without waiting: the
+ * buffer is released by _TxAckCallback() once transmitted. A frame with
+ * referenced fragments is given as a scatter-gather list (TX buffer first).
+ ******************************************************************************/
 void MACFlush(void) 
 {
+    eEthRes res;
+    int ix;
+
     if (_pTxCurrDcpt && _TxCurrSize) // there is a buffer to transmit
     { 
         _pTxCurrDcpt->txBusy = 1;
-        EthTxSendBuffer((void*) _pTxCurrDcpt->dataBuff, _TxCurrSize);
+        if (_pTxCurrDcpt->nFragments == 0) 
+        {
+            res = EthTxSendBuffer((void*) _pTxCurrDcpt->dataBuff, _TxCurrSize);
+        }
+        else 
+        {
+            _pTxCurrDcpt->fragments[0].pBuff = (void*) _pTxCurrDcpt->dataBuff;
+            _pTxCurrDcpt->fragments[0].nBytes = _TxCurrSize;
+            for (ix = 1; ix <= _pTxCurrDcpt->nFragments; ix++) 
+            {
+                _pTxCurrDcpt->fragments[0].nBytes -= _pTxCurrDcpt->fragments[ix].nBytes;
+                _pTxCurrDcpt->fragments[ix - 1].next = (sEthPktDcpt*) &_pTxCurrDcpt->fragments[ix];
+            }
+            _pTxCurrDcpt->fragments[_pTxCurrDcpt->nFragments].next = 0;
+            res = EthTxSendPacket((const sEthPktDcpt*) _pTxCurrDcpt->fragments);
+        }
+        if (res != ETH_RES_OK) 
+        { // no hardware descriptor available, the frame is dropped
+            _pTxCurrDcpt->txBusy = 0;
+            _stackMgrTxNotReady++;
+        }
         _pTxCurrDcpt = 0;
         _TxCurrSize = 0;
     }
@@ -391,6 +511,11 @@ void MACMemCopyAsync(PTR_BASE destAddr, PTR_BASE sourceAddr, WORD len)
         pSrc = (sourceAddr == -1) ? _CurrRdPtr : (unsigned char*) sourceAddr;
 
         memcpy(pDst, pSrc, len);
+
+        if (_pRxCurrBuff && (pSrc >= _pRxCurrBuff) && (pSrc < _pRxCurrBuff + EMAC_RX_BUFF_SIZE))
+        {
+            _stackMgrRxCopiedBytes += len;
+        }
     }
 }
 
@@ -404,6 +529,28 @@ void MACSetReadPtrInRx(WORD offset)
     _CurrRdPtr = _pRxCurrBuff + sizeof(ETHER_HEADER) + offset;
 }
 
+/******************************************************************************
+ * ---MACGetRxView
+ * Returns a pointer on the len bytes at the current read pointer and
+ * advances the read pointer, without copying anything. The view points
+ * in the RX descriptor buffer and is only valid until MACDiscardRx()
+ * (called by the handlers or by the next MACGetHeader()) acknowledges it.
+ * NULL is returned if the received frame is shorter than requested.
+ ******************************************************************************/
+BYTE* MACGetRxView(WORD len) 
+{
+    unsigned char* pView;
+
+    if ((_pRxCurrBuff == 0) || (_CurrRdPtr + len > _pRxCurrBuff + _RxCurrSize))
+    {
+        return NULL;
+    }
+
+    pView = _CurrRdPtr;
+    _CurrRdPtr += len;
+    return pView;
+}
+
 PTR_BASE MACGetTxBaseAddr(void) 
 {
     return _pTxCurrDcpt ? (PTR_BASE) _pTxCurrDcpt->dataBuff : 0;
@@ -884,12 +1031,17 @@ BYTE EthPhyDetectAndReset()
  * ---_TxAckCallback
  * TX acknowledge call back function.
  * Called by the Eth MAC when TX buffers are acknoledged (as a result of a call to EthTxAcknowledgeBuffer).
+ * It is called for every buffer of a frame: only the first one is a TX buffer, the others are referenced fragments.
  ******************************************************************************/
 static void _TxAckCallback(void* pPktBuff, int buffIx, void* fParam) 
 {
     volatile sEthTxDcpt* pDcpt;
-    pDcpt = (sEthTxDcpt*) ((char*) pPktBuff - offsetof(sEthTxDcpt, dataBuff));
-    pDcpt->txBusy = 0;
+
+    if (buffIx == 0) 
+    {
+        pDcpt = (sEthTxDcpt*) ((char*) pPktBuff - offsetof(sEthTxDcpt, dataBuff));
+        pDcpt->txBusy = 0;
+    }
 }
 
 static void* _MacAllocCallback(size_t nitems, size_t size, void* param) 
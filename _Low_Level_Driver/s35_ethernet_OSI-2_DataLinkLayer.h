@@ -28,7 +28,8 @@
 #define MAC_ARP                         (0x06u)
 #define MAC_UNKNOWN                     (0xFFu)
 
-#define EMAC_TX_DESCRIPTORS             2		// number of the TX descriptors to be created
+#define EMAC_TX_DESCRIPTORS             4		// number of the TX buffers (frames that can be queued back-to-back)
+#define EMAC_TX_FRAGMENTS               3		// max buffers of a TX frame: the local TX buffer + 2 fragments referenced by MACPutArrayRef()
 #define EMAC_RX_DESCRIPTORS             8		// number of the RX descriptors and RX buffers to be created
 #define	EMAC_RX_BUFF_SIZE               1536	// size of a RX buffer. should be multiple of 16
 // this is the size of all receive buffers processed by the ETHC
@@ -141,6 +142,8 @@ NODE_INFO;
 typedef struct 
 {
     int txBusy; // busy flag
+    int nFragments; // number of fragments referenced by MACPutArrayRef() (0: single buffer frame)
+    sEthPktDcpt fragments[EMAC_TX_FRAGMENTS]; // scatter-gather list given to the ETHC
     unsigned int dataBuff[(MAC_TX_BUFFER_SIZE + sizeof (ETHER_HEADER) + sizeof (int) - 1) / sizeof (int) ]; // actual data buffer
 } sEthTxDcpt; // TX buffer descriptor
 
@@ -265,15 +268,18 @@ BYTE MACGet(void);
 void MACPut(BYTE val);
 WORD MACGetArray(BYTE *address, WORD len);
 void MACPutArray(BYTE *buff, WORD len);
+BOOL MACPutArrayRef(BYTE *buff, WORD len);
 BOOL MACGetHeader(MAC_ADDR *remote, BYTE *type);
 void MACPutHeader(MAC_ADDR *remote, BYTE type, WORD dataLen);
 
 WORD MACCalcRxChecksum(WORD offset, WORD len);
+WORD MACCalcTxChecksum(WORD offset, WORD len);
 void MACDiscardRx(void);
 
 void MACFlush(void);
 void MACMemCopyAsync(PTR_BASE destAddr, PTR_BASE sourceAddr, WORD len);
 void MACSetReadPtrInRx(WORD offset);
+BYTE* MACGetRxView(WORD len);
 PTR_BASE MACGetTxBaseAddr(void);
 PTR_BASE MACSetWritePtr(PTR_BASE address);
 PTR_BASE MACSetReadPtr(PTR_BASE address);
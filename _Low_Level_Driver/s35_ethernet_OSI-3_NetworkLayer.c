@@ -1,7 +1,9 @@
 #include "../PLIB.h"
 
-static NODE_INFO    Cache;
-static BYTE         IPHeaderLen;
+static ARP_CACHE_ENTRY  ARPCache[ARP_CACHE_SIZE];
+static ARP_CACHE_STATS  ARPCacheStats;
+static ARP_TX_ENTRY     ARPTxQueue[ARP_TX_QUEUE_SIZE];
+static BYTE             IPHeaderLen;
 
 static ICMP_FLAGS   ICMPFlags = {0};
 static ICMP_STATE   ICMPState = 0;
@@ -9,6 +11,200 @@ static NODE_INFO    ICMPRemote = {0};
 static QWORD        ICMPTimer;
 static WORD         ICMPSequenceNumber;
 
+/*********************************************************************
+ * ---_ARPCacheHash
+ * Folds the 4 bytes of the IP address into an index of the ARP cache.
+ ********************************************************************/
+static BYTE _ARPCacheHash(IP_ADDR IPAddr)
+{
+    BYTE hash = IPAddr.v[0] ^ IPAddr.v[1] ^ IPAddr.v[2] ^ IPAddr.v[3];
+    
+    return (hash ^ (hash >> 4)) & (ARP_CACHE_SIZE - 1);
+}
+
+/*********************************************************************
+ * ---_ARPCacheLookup
+ * Returns the cache entry of IPAddr if it exists and has not aged out,
+ * NULL otherwise. An aged out entry is released.
+ ********************************************************************/
+static ARP_CACHE_ENTRY* _ARPCacheLookup(IP_ADDR IPAddr)
+{
+    BYTE i;
+    BYTE index = _ARPCacheHash(IPAddr);
+    ARP_CACHE_ENTRY *p;
+    
+    if(IPAddr.Val == 0)
+    {
+        return NULL;
+    }
+    
+    for(i = 0 ; i < ARP_CACHE_MAX_PROBES ; i++)
+    {
+        p = &ARPCache[(index + i) & (ARP_CACHE_SIZE - 1)];
+        if(p->node.IPAddr.Val == IPAddr.Val)
+        {
+            if(mTickCompare(p->tick) < ARP_CACHE_ENTRY_TIMEOUT)
+            {
+                return p;
+            }
+            p->node.IPAddr.Val = 0;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*********************************************************************
+ * ---_ARPCacheUpdate
+ * Refreshes the entry of IPAddr with MACAddr. If the entry does not exist
+ * and bCreate is TRUE, a free (or aged out) slot of the probe window is
+ * used, otherwise the oldest entry of the window is evicted.
+ ********************************************************************/
+static void _ARPCacheUpdate(IP_ADDR IPAddr, MAC_ADDR MACAddr, BOOL bCreate)
+{
+    BYTE i;
+    BYTE index = _ARPCacheHash(IPAddr);
+    QWORD tick = mGetTick();
+    ARP_CACHE_ENTRY *p, *pFree = NULL, *pOldest = NULL;
+    
+    if((IPAddr.Val == 0) || (IPAddr.Val == AppConfig.MyIPAddr.Val))
+    {
+        return;
+    }
+    
+    for(i = 0 ; i < ARP_CACHE_MAX_PROBES ; i++)
+    {
+        p = &ARPCache[(index + i) & (ARP_CACHE_SIZE - 1)];
+        if(p->node.IPAddr.Val == IPAddr.Val)
+        {
+            p->node.MACAddr = MACAddr;
+            p->tick = tick;
+            ARPCacheStats.updates++;
+            return;
+        }
+        if((pFree == NULL) && ((p->node.IPAddr.Val == 0) || ((tick - p->tick) >= ARP_CACHE_ENTRY_TIMEOUT)))
+        {
+            pFree = p;
+        }
+        if((pOldest == NULL) || (p->tick < pOldest->tick))
+        {
+            pOldest = p;
+        }
+    }
+    
+    if(!bCreate)
+    {
+        return;
+    }
+    
+    if(pFree == NULL)
+    {
+        pFree = pOldest;
+        ARPCacheStats.evictions++;
+    }
+    pFree->node.IPAddr = IPAddr;
+    pFree->node.MACAddr = MACAddr;
+    pFree->tick = tick;
+}
+
+/*********************************************************************
+ * ---_ARPPut
+ * Builds and transmits an ARP packet. A TX buffer must be available.
+ ********************************************************************/
+static void _ARPPut(WORD operation, NODE_INFO *target)
+{
+    ARP_PACKET packet;
+
+    packet.HardwareType = swap_word(HW_ETHERNET);
+    packet.Protocol = swap_word(ARP_IP);
+    packet.MACAddrLen = sizeof(MAC_ADDR);
+    packet.ProtocolLen = sizeof(IP_ADDR);
+    packet.Operation = swap_word(operation);
+    packet.TargetMACAddr = target->MACAddr;
+    packet.TargetIPAddr = target->IPAddr;
+    packet.SenderMACAddr = AppConfig.MyMACAddr;
+    packet.SenderIPAddr = AppConfig.MyIPAddr;
+
+    MACSetWritePtr(BASE_TX_ADDR);
+    MACPutHeader(&packet.TargetMACAddr, MAC_ARP, sizeof(ARP_PACKET));
+    MACPutArray((BYTE*) &packet, sizeof(ARP_PACKET));
+    MACFlush();
+}
+
+/*********************************************************************
+ * ---_ARPSend
+ * Transmits an ARP packet if a TX buffer is free, otherwise queues it
+ * for ARPTask() (once per operation and target). The packet is dropped
+ * if the queue is full: the remote node and ARPResolve() callers retry.
+ ********************************************************************/
+static void _ARPSend(WORD operation, NODE_INFO *target)
+{
+    BYTE i;
+    ARP_TX_ENTRY *p, *pFree = NULL;
+
+    ARPTask();  // Older packets go first
+    if(MACIsTxReady())
+    {
+        _ARPPut(operation, target);
+        return;
+    }
+
+    for(i = 0 ; i < ARP_TX_QUEUE_SIZE ; i++)
+    {
+        p = &ARPTxQueue[i];
+        if(p->operation == 0)
+        {
+            if(pFree == NULL)
+            {
+                pFree = p;
+            }
+        }
+        else if((p->operation == operation) && (p->target.IPAddr.Val == target->IPAddr.Val))
+        {
+            return;
+        }
+    }
+
+    if(pFree != NULL)
+    {
+        pFree->operation = operation;
+        pFree->target = *target;
+    }
+}
+
+/*********************************************************************
+ * ---ARPInit
+ * Clears the ARP cache, its statistics and the TX queue.
+ ********************************************************************/
+void ARPInit(void)
+{
+    memset((void*) ARPCache, 0x00, sizeof(ARPCache));
+    memset((void*) &ARPCacheStats, 0x00, sizeof(ARPCacheStats));
+    memset((void*) ARPTxQueue, 0x00, sizeof(ARPTxQueue));
+}
+
+/*********************************************************************
+ * ---ARPTask
+ * Transmits the queued ARP packets while TX buffers are available.
+ ********************************************************************/
+void ARPTask(void)
+{
+    BYTE i;
+
+    for(i = 0 ; i < ARP_TX_QUEUE_SIZE ; i++)
+    {
+        if(ARPTxQueue[i].operation != 0)
+        {
+            if(!MACIsTxReady())
+            {
+                return;
+            }
+            _ARPPut(ARPTxQueue[i].operation, &ARPTxQueue[i].target);
+            ARPTxQueue[i].operation = 0;
+        }
+    }
+}
+
 /*********************************************************************
  * ---ARPProcess
  * Retrieves an ARP packet from the MAC buffer and determines if it is a
@@ -19,67 +215,61 @@ static WORD         ICMPSequenceNumber;
  * again until a new ARP packet is waiting in the RX buffer.
  * FALSE - This function must be called again.  More time is needed to
  * send an ARP response.
+ * The incoming packet is read in place in the RX buffer, which is only
+ * released once the packet has been processed.
  ********************************************************************/
 void ARPProcess(void) 
 {
-    ARP_PACKET packet;
+    ARP_PACKET *packet;
+    NODE_INFO requester;
 
     // Obtain the incoming ARP packet (either an ARP request from a host OR a response from a host to our ARP request)
-    MACGetArray((BYTE*) &packet, sizeof(ARP_PACKET));
-    MACDiscardRx();
+    packet = (ARP_PACKET*) MACGetRxView(sizeof(ARP_PACKET));
+    
     // Validate the ARP packet
-    if((packet.HardwareType == swap_word(HW_ETHERNET)) && (packet.MACAddrLen == sizeof(MAC_ADDR)) && (packet.ProtocolLen == sizeof(IP_ADDR)))
+    if((packet != NULL) && (packet->HardwareType == swap_word(HW_ETHERNET)) && (packet->MACAddrLen == sizeof(MAC_ADDR)) && (packet->ProtocolLen == sizeof(IP_ADDR)))
     {
-        if (packet.Operation == swap_word(ARP_OPERATION_RESP))  // Handle incoming ARP responses (a host is sending a response to our ARP request)
+        if (packet->Operation == swap_word(ARP_OPERATION_RESP))  // Handle incoming ARP responses (a host is sending a response to our ARP request)
         {
-            Cache.MACAddr = packet.SenderMACAddr;
-            Cache.IPAddr = packet.SenderIPAddr;
+            _ARPCacheUpdate(packet->SenderIPAddr, packet->SenderMACAddr, TRUE);
         }
-        else if((packet.Operation == swap_word(ARP_OPERATION_REQ)) && (packet.TargetIPAddr.Val == AppConfig.MyIPAddr.Val))   // Handle incoming ARP requests for our MAC address (a host is sending an ARP request)
+        else if (packet->Operation == swap_word(ARP_OPERATION_REQ))
         {
-            packet.HardwareType = swap_word(HW_ETHERNET);
-            packet.Protocol = swap_word(ARP_IP);
-            packet.MACAddrLen = sizeof(MAC_ADDR);
-            packet.ProtocolLen = sizeof(IP_ADDR);
-            packet.Operation = swap_word(ARP_OPERATION_RESP);
-            packet.TargetMACAddr = packet.SenderMACAddr;
-            packet.TargetIPAddr = packet.SenderIPAddr;
-            packet.SenderMACAddr = AppConfig.MyMACAddr;
-            packet.SenderIPAddr = AppConfig.MyIPAddr;
-
-            while(!MACIsTxReady());
-            MACSetWritePtr(BASE_TX_ADDR);
-            MACPutHeader(&packet.TargetMACAddr, MAC_ARP, sizeof(ARP_PACKET));
-            MACPutArray((BYTE*) &packet, sizeof(ARP_PACKET));
-            MACFlush();
+            // Learn the sender of requests addressed to us and of gratuitous ARPs (sender IP == target IP). 
+            // Other requests only refresh an already known node (RFC 826 merge flag).
+            _ARPCacheUpdate(packet->SenderIPAddr, packet->SenderMACAddr, (packet->TargetIPAddr.Val == AppConfig.MyIPAddr.Val) || (packet->TargetIPAddr.Val == packet->SenderIPAddr.Val));
+        }
+        
+        if((packet->Operation == swap_word(ARP_OPERATION_REQ)) && (packet->TargetIPAddr.Val == AppConfig.MyIPAddr.Val))   // Handle incoming ARP requests for our MAC address (a host is sending an ARP request)
+        {
+            requester.MACAddr = packet->SenderMACAddr;
+            requester.IPAddr = packet->SenderIPAddr;
+            _ARPSend(ARP_OPERATION_RESP, &requester);
         }
     }
+    MACDiscardRx();
 }
 
 /*********************************************************************
  * ---ARPResolve
  * This function transmits and ARP request to determine the hardware
- * address of a given IP address.
+ * address of a given IP address. Nothing is sent while the cache 
+ * entry is younger than half of ARP_CACHE_ENTRY_TIMEOUT.
  ********************************************************************/
 void ARPResolve(IP_ADDR* IPAddr) 
 {
-    ARP_PACKET packet;
-
-    packet.HardwareType = swap_word(HW_ETHERNET);
-    packet.Protocol = swap_word(ARP_IP);
-    packet.MACAddrLen = sizeof(MAC_ADDR);
-    packet.ProtocolLen = sizeof(IP_ADDR);
-    packet.Operation = swap_word(ARP_OPERATION_REQ);
-    memset((void*) &packet.TargetMACAddr, 0xff, sizeof(MAC_ADDR));
-    packet.TargetIPAddr = ((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val) ? AppConfig.MyGateway : *IPAddr;
-    packet.SenderMACAddr = AppConfig.MyMACAddr;
-    packet.SenderIPAddr = AppConfig.MyIPAddr;
+    NODE_INFO target;
+    ARP_CACHE_ENTRY *p;
+    
+    p = _ARPCacheLookup(((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val) ? AppConfig.MyGateway : *IPAddr);
+    if((p != NULL) && (mTickCompare(p->tick) < (ARP_CACHE_ENTRY_TIMEOUT >> 1)))
+    {
+        return;
+    }
 
-    while(!MACIsTxReady());
-    MACSetWritePtr(BASE_TX_ADDR);
-    MACPutHeader(&packet.TargetMACAddr, MAC_ARP, sizeof(ARP_PACKET));
-    MACPutArray((BYTE*) &packet, sizeof(ARP_PACKET));
-    MACFlush();
+    memset((void*) &target.MACAddr, 0xff, sizeof(MAC_ADDR));
+    target.IPAddr = ((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val) ? AppConfig.MyGateway : *IPAddr;
+    _ARPSend(ARP_OPERATION_REQ, &target);
 }
 
 /*********************************************************************
@@ -89,33 +279,53 @@ void ARPResolve(IP_ADDR* IPAddr)
  ********************************************************************/
 BOOL ARPIsResolved(IP_ADDR* IPAddr, MAC_ADDR* MACAddr) 
 {
-    if((Cache.IPAddr.Val == IPAddr->Val) || ((Cache.IPAddr.Val == AppConfig.MyGateway.Val) && ((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val))) 
+    ARP_CACHE_ENTRY *p;
+    
+    // Remote nodes outside of our subnet are reached through the gateway
+    p = _ARPCacheLookup(((AppConfig.MyIPAddr.Val ^ IPAddr->Val) & AppConfig.MyMask.Val) ? AppConfig.MyGateway : *IPAddr);
+    if(p != NULL)
     {
-        *MACAddr = Cache.MACAddr;
-//        memset((void*) &Cache, 0xff, sizeof(NODE_INFO));
+        *MACAddr = p->node.MACAddr;
+        ARPCacheStats.hits++;
         return TRUE;
     }
+    ARPCacheStats.misses++;
     return FALSE;
 }
 
+/*********************************************************************
+ * ---ARPGetCacheStats
+ * Copies the ARP cache hit/miss/eviction/update counters.
+ ********************************************************************/
+void ARPGetCacheStats(ARP_CACHE_STATS *stats)
+{
+    memcpy((void*) stats, (void*) &ARPCacheStats, sizeof(ARP_CACHE_STATS));
+}
+
 /*********************************************************************
  * ---IPGetHeader
+ * *IPHeader is set to a view of the header in the RX buffer (valid
+ * until the packet is discarded).
  * TRUE, if valid packet was received
  * FALSE otherwise
  ********************************************************************/
-BOOL IPGetHeader(IP_ADDR *remote, IP_HEADER *IPHeader) 
+BOOL IPGetHeader(IP_ADDR *remote, IP_HEADER **IPHeader) 
 {
     WORD_VAL CalcChecksum;
 
-    MACGetArray((BYTE*) IPHeader, sizeof(IP_HEADER));
+    *IPHeader = (IP_HEADER*) MACGetRxView(sizeof(IP_HEADER));
+    if (*IPHeader == NULL)
+    {
+        return FALSE;
+    }
     
-    IPHeaderLen = (IPHeader->VersionIHL & 0x0f) << 2;
+    IPHeaderLen = ((*IPHeader)->VersionIHL & 0x0f) << 2;
     CalcChecksum.Val = MACCalcRxChecksum(0, IPHeaderLen); // Cheksum validation (0 == OK)
     MACSetReadPtrInRx(IPHeaderLen);     // Seek to the end of the IP header
 
-    if((!CalcChecksum.Val) && ((IPHeader->VersionIHL & 0xf0) == IP_IPv4) || !(IPHeader->FragmentInfo & 0xff1f))
+    if((!CalcChecksum.Val) && (((*IPHeader)->VersionIHL & 0xf0) == IP_IPv4) || !((*IPHeader)->FragmentInfo & 0xff1f))
     {
-        remote->Val = IPHeader->SourceAddress.Val;
+        remote->Val = (*IPHeader)->SourceAddress.Val;
     
         return TRUE;
     }
@@ -214,21 +424,16 @@ void ICMPProcess(NODE_INFO *remote, IP_ADDR localIP, WORD len)
             }
 
             // Calculate new Type, Code, and Checksum values
+            dwVal.w[1] = CalcIPChecksumUpdate(dwVal.w[1], dwVal.w[0], dwVal.w[0] & 0xff00);
             dwVal.v[0] = 0x00; // Type: 0 (ICMP echo/ping reply)
-            dwVal.v[2] += 8; // Subtract 0x0800 from the checksum
-            if (dwVal.v[2] < 8u) 
+
+            // Do not wait for the TX hardware: if all the TX buffers are in
+            // flight the request is dropped and the remote node pings again
+            if (!MACIsTxReady())
             {
-                dwVal.v[3]++;
-                if (dwVal.v[3] == 0u)
-                {
-                    dwVal.v[2]++;
-                }
+                return;
             }
 
-            // Wait for TX hardware to become available (finish transmitting
-            // any previous packet)
-            while (!MACIsTxReady());
-
             // Position the write pointer for the next IPPutHeader operation
             // NOTE: do not put this before the MACIsTxReady() call for WF compatbility
             MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
@@ -291,7 +496,10 @@ LONG ICMPGetReply(void)
             }
             break;
         case SM_ICMP_SEND_ECHO_REQUEST:
-            while(!MACIsTxReady());
+            if(!MACIsTxReady())     // Try again on the next call if all the TX buffers are in flight
+            {
+                break;
+            }
             ICMPTimer = mGetTick();     // Record the current time.  This will be used as a basis for finding the echo response time, which exludes the ARP and DNS steps
 
             ICMPPacket.TypeOfMessage = ICMP_ECHO_REQUEST;  
@@ -1,7 +1,7 @@
 #ifndef __NETWORK_LAYER_H
 #define __NETWORK_LAYER_H
 
-typedef struct 
+typedef struct __attribute__((aligned(2), packed)) 
 {
     BYTE VersionIHL;
     BYTE TypeOfService;
@@ -53,11 +53,35 @@ typedef struct __attribute__((aligned(2), packed))
     IP_ADDR TargetIPAddr; // The target node's IP address.
 }ARP_PACKET;
 
+typedef struct
+{
+    NODE_INFO node; // Resolved IP/MAC pair (node.IPAddr.Val == 0 when the slot is free)
+    QWORD tick; // Time of the last ARP response / request learned for this node
+}ARP_CACHE_ENTRY;
+
+typedef struct
+{
+    DWORD hits; // ARPIsResolved() answered from the cache
+    DWORD misses; // ARPIsResolved() did not find a valid entry
+    DWORD evictions; // A valid entry was overwritten because its probe window was full
+    DWORD updates; // An existing entry has been refreshed by an incoming ARP packet
+}ARP_CACHE_STATS;
+
+typedef struct
+{
+    WORD operation; // ARP_OPERATION_REQ or ARP_OPERATION_RESP (0 when the slot is free)
+    NODE_INFO target; // Node the ARP packet is sent to
+}ARP_TX_ENTRY;
+
 // ARP
 #define ARP_OPERATION_REQ           (0x0001u)		// Operation code indicating an ARP Request
 #define ARP_OPERATION_RESP          (0x0002u)		// Operation code indicating an ARP Response
 #define ARP_IP                      (0x0800u)       // ARP IP packet type as defined by IEEE 802.3
 #define HW_ETHERNET                 (0x0001u)       // ARP Hardware type as defined by IEEE 802.3
+#define ARP_CACHE_SIZE              (32u)           // Number of entries in the ARP cache (must be a power of 2)
+#define ARP_CACHE_MAX_PROBES        (4u)            // Number of consecutive slots probed from the hashed index
+#define ARP_CACHE_ENTRY_TIMEOUT     ((QWORD)TICK_10S * 30)  // An entry older than 5 minutes must be resolved again
+#define ARP_TX_QUEUE_SIZE           (4u)            // ARP packets waiting for a free TX buffer
 
 // IP 
 #define IP_IPv4                     (0x40)
@@ -73,13 +97,16 @@ typedef struct __attribute__((aligned(2), packed))
 
 // IP
 void IPPutHeader(NODE_INFO *remote, BYTE protocol, WORD len);
-BOOL IPGetHeader(IP_ADDR *remote, IP_HEADER *IPHeader);
+BOOL IPGetHeader(IP_ADDR *remote, IP_HEADER **IPHeader);
 void IPSetRxBuffer(WORD Offset);
 
 // ARP
+void ARPInit(void);
+void ARPTask(void);
 void ARPProcess(void);
 void ARPResolve(IP_ADDR* IPAddr);
 BOOL ARPIsResolved(IP_ADDR* IPAddr, MAC_ADDR* MACAddr);
+void ARPGetCacheStats(ARP_CACHE_STATS *stats);
 
 // ICMP
 void ICMPProcess(NODE_INFO *remote, IP_ADDR localIP, WORD len);
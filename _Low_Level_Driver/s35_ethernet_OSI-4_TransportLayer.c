@@ -16,6 +16,10 @@ static UDP_SOCKET	LastPutSocket = INVALID_UDP_SOCKET;	// Indicates the last sock
 static WORD         wPutOffset;		// Offset from beginning of payload where data is to be written.
 static WORD         wGetOffset;		// Offset from beginning of payload from where data is to be read.
 static UDP_SOCKET   SocketWithRxData = INVALID_UDP_SOCKET;
+static UDP_SOCKET   UDPHashTable[UDP_HASH_TABLE_SIZE];	// Heads of the socket lists sharing the same local port bucket
+
+#define UDPHashBucket(port)     (((port) ^ ((port) >> 8)) & (UDP_HASH_TABLE_SIZE - 1))
+
 /******************************************************************************
  * ---UDPSetTxBuffer
  * This function allows the write location within the TX buffer to be
@@ -44,7 +48,8 @@ void UDPSetRxBuffer(WORD wOffset)
 /******************************************************************************
  * ---FindMatchingSocket
  * This function attempts to match an incoming UDP segment to a currently
- * active socket for processing.
+ * active socket for processing. Only the sockets of the destination port 
+ * bucket are checked (kept in socket index order by UDPOpenEx/UDPClose).
  ******************************************************************************/
 static UDP_SOCKET FindMatchingSocket(UDP_HEADER *h, NODE_INFO *remoteNode)
 {
@@ -59,9 +64,9 @@ static UDP_SOCKET FindMatchingSocket(UDP_HEADER *h, NODE_INFO *remoteNode)
 
 	partialMatch = INVALID_UDP_SOCKET;
 
-	p = UDPSocketInfo;
-    for(s = 0; s < MAX_UDP_SOCKETS; s++)
+    for(s = UDPHashTable[UDPHashBucket(h->DestinationPort)]; s != INVALID_UDP_SOCKET; s = p->nextSocket)
 	{
+		p = &UDPSocketInfo[s];
 		// This packet is said to be matching with current socket:
 		// 1. If its destination port matches with our local port and
 		// 2. Packet source IP address matches with previously saved socket remote IP address and
@@ -78,7 +83,6 @@ static UDP_SOCKET FindMatchingSocket(UDP_HEADER *h, NODE_INFO *remoteNode)
 
 			partialMatch = s;
 		}
-		p++;
 	}
 
 	if(partialMatch != INVALID_UDP_SOCKET)
@@ -102,6 +106,7 @@ void UDPInit(void)
 {
     UDP_SOCKET s;
 
+    memset((void*)UDPHashTable, INVALID_UDP_SOCKET, sizeof(UDPHashTable));
     for ( s = 0; s < MAX_UDP_SOCKETS; s++ )
     {
 		UDPClose(s);
@@ -283,6 +288,7 @@ UDP_SOCKET UDPOpenEx(DWORD remoteHost, BYTE remoteHostType, UDP_PORT localPort,
 {
 	UDP_SOCKET s;
 	UDP_SOCKET_INFO *p;
+	UDP_SOCKET *pLink;
 
 	// Local temp port numbers.
 	static WORD NextPort __attribute__((persistent));
@@ -301,6 +307,16 @@ UDP_SOCKET UDPOpenEx(DWORD remoteHost, BYTE remoteHostType, UDP_PORT localPort,
                 }
                 p->localPort    = NextPort++;
 		   	}
+
+			// Link the socket in its local port bucket (socket index order)
+			pLink = &UDPHashTable[UDPHashBucket(p->localPort)];
+			while((*pLink != INVALID_UDP_SOCKET) && (*pLink < s))
+			{
+				pLink = &UDPSocketInfo[*pLink].nextSocket;
+			}
+			p->nextSocket = *pLink;
+			*pLink = s;
+
 			if((remoteHostType == UDP_OPEN_SERVER) || (remoteHost == 0))
 			{
                 //Set remote node as 0xFF ( broadcast address)
@@ -348,11 +364,11 @@ UDP_SOCKET UDPOpenEx(DWORD remoteHost, BYTE remoteHostType, UDP_PORT localPort,
  * ---UDPProcess
  * This function handles an incoming UDP segment to determine if it is
  * acceptable and should be handed to one of the stack applications for
- * processing.
+ * processing. The UDP header is used in place in the RX buffer.
  ******************************************************************************/
 BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR localIP, WORD len)
 {
-    UDP_HEADER		h;
+    UDP_HEADER		*h;
     UDP_SOCKET		s;
     PSEUDO_HEADER	pseudoHeader;
     DWORD_VAL		checksums;
@@ -360,14 +376,16 @@ BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR localIP, WORD len)
 	UDPRxCount = 0;
 
     // Retrieve UDP header.
-    MACGetArray((BYTE*)&h, sizeof(h));
-
-    h.SourcePort        = swap_word(h.SourcePort);
-    h.DestinationPort   = swap_word(h.DestinationPort);
-    h.Length            = swap_word(h.Length) - sizeof(UDP_HEADER);
+    h = (UDP_HEADER*)MACGetRxView(sizeof(UDP_HEADER));
+    if(h == NULL)
+    {
+        MACDiscardRx();
+        return FALSE;
+    }
 
-	// See if we need to validate the checksum field (0x0000 is disabled)
-	if(h.Checksum)
+	// See if we need to validate the checksum field (0x0000 is disabled).
+	// This is done before the header is byte swapped in the RX buffer.
+	if(h->Checksum)
 	{
 	    // Calculate IP pseudoheader checksum.
 	    pseudoHeader.SourceAddress		= remoteNode->IPAddr;
@@ -391,7 +409,11 @@ BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR localIP, WORD len)
 	    }
 	}
 
-    s = FindMatchingSocket(&h, remoteNode);
+    h->SourcePort       = swap_word(h->SourcePort);
+    h->DestinationPort  = swap_word(h->DestinationPort);
+    h->Length           = swap_word(h->Length) - sizeof(UDP_HEADER);
+
+    s = FindMatchingSocket(h, remoteNode);
     if(s == INVALID_UDP_SOCKET)
     {
         // If there is no matching socket, There is no one to handle
@@ -402,7 +424,7 @@ BOOL UDPProcess(NODE_INFO *remoteNode, IP_ADDR localIP, WORD len)
     else
     {
 		SocketWithRxData = s;
-        UDPRxCount = h.Length;
+        UDPRxCount = h->Length;
         Flags.bFirstRead = 1;
 		Flags.bWasDiscarded = 0;
     }
@@ -512,11 +534,28 @@ void UDPFlush(void)
  ******************************************************************************/
 void UDPClose(UDP_SOCKET s)
 {
+	UDP_SOCKET *pLink;
+
 	if(s >= MAX_UDP_SOCKETS)
     {
 		return;
     }
 
+	// Unlink the socket from its local port bucket
+	if(UDPSocketInfo[s].localPort != INVALID_UDP_PORT)
+	{
+		pLink = &UDPHashTable[UDPHashBucket(UDPSocketInfo[s].localPort)];
+		while(*pLink != INVALID_UDP_SOCKET)
+		{
+			if(*pLink == s)
+			{
+				*pLink = UDPSocketInfo[s].nextSocket;
+				break;
+			}
+			pLink = &UDPSocketInfo[*pLink].nextSocket;
+		}
+	}
+
 	UDPSocketInfo[s].localPort = INVALID_UDP_PORT;
 	UDPSocketInfo[s].remoteNode.IPAddr.Val = 0x00000000;
 	UDPSocketInfo[s].smState = UDP_CLOSED;
@@ -537,21 +576,22 @@ TCB                         MyTCB;
 TCB_STUB                    TCBStubs[MAX_TCP_SOCKETS];
 static TCP_SOCKET           hCurrentTCP = INVALID_SOCKET;
 static TCP_SYN_QUEUE        SYNQueue[TCP_SYN_QUEUE_MAX_ENTRIES];	// Array of saved incoming SYN requests that need to be serviced later
-static BYTE                 TCPBufferInPIC[TCP_PIC_RAM_SIZE];
+static TCB                  TCBStore[MAX_TCP_SOCKETS];	// TCB of every socket, swapped with MyTCB by SyncTCB()
+static BYTE                 TCPBufferInPIC[TCP_PIC_RAM_SIZE];	// Pool of the socket FIFOs
+static TCP_SOCKET           TCPHashTable[TCP_HASH_TABLE_SIZE];	// Heads of the socket lists sharing the same remoteHash bucket
+
+#define TCPHashBucket(hash)     (((hash) ^ ((hash) >> 8)) & (TCP_HASH_TABLE_SIZE - 1))
 static WORD                 NextPort __attribute__((persistent));	// Tracking variable for next local client port number
 
 /******************************************************************************
  * ---TCPInit
- * Initializes the TCP module.  This function sets up the TCP buffers
- * in memory and initializes each socket to the CLOSED state.  If
- * insufficient memory was allocated for the TCP sockets, the function
- * will hang here to be captured by the debugger.
+ * Initializes the TCP module.  This function initializes each socket to
+ * the CLOSED state.  The socket FIFOs are allocated from the TCPBufferInPIC
+ * pool when the socket is opened (see TCPAllocBuffers).
  ******************************************************************************/
 void TCPInit(void)
 {
 	BYTE vSocketsAllocated;
-	PTR_BASE ptrBaseAddress;
-	PTR_BASE ptrCurrentPICAddress = TCP_PIC_RAM_BASE_ADDRESS;
 
     if(NextPort == 0u)
     {
@@ -561,21 +601,22 @@ void TCPInit(void)
 	// Mark all SYN Queue entries as invalid by zeroing the memory
 	memset((void*)SYNQueue, 0x00, sizeof(SYNQueue));
 
-	// Allocate all socket FIFO addresses
+	// Empty the demultiplexing table (CloseSocket() links every socket back)
+	memset((void*)TCPHashTable, INVALID_SOCKET, sizeof(TCPHashTable));
+	for(vSocketsAllocated = 0; vSocketsAllocated < MAX_TCP_SOCKETS; vSocketsAllocated++)
+	{
+		TCBStubs[vSocketsAllocated].remoteHash.Val = 0;
+		TCBStubs[vSocketsAllocated].vHashNext = INVALID_SOCKET;
+	}
+
+	// Initialize all sockets without FIFO (allocated by TCPOpenEx)
 	for(vSocketsAllocated = 0; vSocketsAllocated < MAX_TCP_SOCKETS; vSocketsAllocated++)
 	{
-		// Generate all needed sockets of each type (TCP_PURPOSE_*)
 		hCurrentTCP = vSocketsAllocated;
 
-        ptrBaseAddress = ptrCurrentPICAddress;
-        ptrCurrentPICAddress += sizeof(TCB) + TCP_SOCKET_TX_BUFFER_SIZE+1 + TCP_SOCKET_RX_BUFFER_SIZE+1;
-		// Do a sanity check to ensure that we aren't going to use memory that hasn't been allocated to us.
-		// If your code locks up right here, it means you've incorrectly allocated your TCP socket buffers.
-		while(ptrCurrentPICAddress > TCP_PIC_RAM_BASE_ADDRESS + TCP_PIC_RAM_SIZE);
-			
-		TCBStubs[hCurrentTCP].bufferTxStart	= ptrBaseAddress + sizeof(TCB);
-		TCBStubs[hCurrentTCP].bufferRxStart	= TCBStubs[hCurrentTCP].bufferTxStart + TCP_SOCKET_TX_BUFFER_SIZE + 1;
-		TCBStubs[hCurrentTCP].bufferEnd	= TCBStubs[hCurrentTCP].bufferRxStart + TCP_SOCKET_RX_BUFFER_SIZE;
+		TCBStubs[hCurrentTCP].bufferTxStart	= 0;
+		TCBStubs[hCurrentTCP].bufferRxStart	= 0;
+		TCBStubs[hCurrentTCP].bufferEnd	= 0;
 		TCBStubs[hCurrentTCP].smState	= TCP_CLOSED;
 		TCBStubs[hCurrentTCP].Flags.bServer	= FALSE;
 
@@ -665,7 +706,7 @@ void TCPTick(void)
                     memcpy((void*)&MyTCB.remote.niRemoteMACIP, (void*)&SYNQueue[w].niSourceAddress, sizeof(NODE_INFO));
                     MyTCB.remotePort.Val = SYNQueue[w].wSourcePort;
                     MyTCB.RemoteSEQ = SYNQueue[w].dwSourceSEQ + 1;
-                    TCBStubs[hCurrentTCP].remoteHash.Val = (MyTCB.remote.niRemoteMACIP.IPAddr.w[1] + MyTCB.remote.niRemoteMACIP.IPAddr.w[0] + MyTCB.remotePort.Val) ^ MyTCB.localPort.Val;
+                    SetRemoteHash((MyTCB.remote.niRemoteMACIP.IPAddr.w[1] + MyTCB.remote.niRemoteMACIP.IPAddr.w[0] + MyTCB.remotePort.Val) ^ MyTCB.localPort.Val);
                     vFlags = SYN | ACK;
                     TCBStubs[hCurrentTCP].smState = TCP_SYN_RECEIVED;
 
@@ -937,10 +978,11 @@ void TCPTick(void)
  * This function handles incoming TCP segments.  When a segment arrives, it
  * is compared to open sockets using a hash of the remote port and IP.
  * On a match, the data is passed to HandleTCPSeg for further processing.
+ * The TCP header is byte swapped and used in place in the RX buffer.
  ******************************************************************************/
 BOOL TCPProcess(NODE_INFO* remote, IP_ADDR localIP, WORD len)
 {
-	TCP_HEADER      TCPHeader;
+	TCP_HEADER      *TCPHeader;
 	PSEUDO_HEADER   pseudoHeader;
 	WORD_VAL        checksum1;
 	WORD_VAL        checksum2;
@@ -971,19 +1013,24 @@ BOOL TCPProcess(NODE_INFO* remote, IP_ADDR localIP, WORD len)
 
 	// Retrieve TCP header.
 	IPSetRxBuffer(0);
-	MACGetArray((BYTE*)&TCPHeader, sizeof(TCPHeader));
-	SwapTCPHeader(&TCPHeader);
+	TCPHeader = (TCP_HEADER*)MACGetRxView(sizeof(TCP_HEADER));
+	if(TCPHeader == NULL)
+	{
+		MACDiscardRx();
+		return TRUE;
+	}
+	SwapTCPHeader(TCPHeader);
 
 
 	// Skip over options to retrieve data bytes
-	optionsSize = (BYTE)((TCPHeader.DataOffset.Val << 2)-
-		sizeof(TCPHeader));
-	len = len - optionsSize - sizeof(TCPHeader);
+	optionsSize = (BYTE)((TCPHeader->DataOffset.Val << 2)-
+		sizeof(TCP_HEADER));
+	len = len - optionsSize - sizeof(TCP_HEADER);
 
 	// Find matching socket.
-	if(FindMatchingSocket_TCP(&TCPHeader, remote))
+	if(FindMatchingSocket_TCP(TCPHeader, remote))
 	{
-		HandleTCPSeg(&TCPHeader, len);
+		HandleTCPSeg(TCPHeader, len);
 	}
 //	else
 //	{
@@ -1009,6 +1056,9 @@ BOOL TCPProcess(NODE_INFO* remote, IP_ADDR localIP, WORD len)
  * a given TCP header and NODE_INFO structure.  If a socket is found, its
  * index is saved in hCurrentTCP and the associated TCBStubs[hCurrentTCP] and MyTCB are
  * loaded. Otherwise, INVALID_SOCKET is placed in hCurrentTCP.
+ * Only the bucket of the segment hash (connected sockets) and the bucket of
+ * the destination port (listening sockets) are visited, and the TCB is loaded
+ * only once the ports and remote IP of the stub match.
  ******************************************************************************/
 static BOOL FindMatchingSocket_TCP(TCP_HEADER* h, NODE_INFO* remote)
 {
@@ -1023,34 +1073,30 @@ static BOOL FindMatchingSocket_TCP(TCP_HEADER* h, NODE_INFO* remote)
 	partialMatch = INVALID_SOCKET;
 	hash = (remote->IPAddr.w[1]+remote->IPAddr.w[0] + h->SourcePort) ^ h->DestPort;
 
-	// Loop through all sockets looking for a socket that is expecting this
-	// packet or can handle it.
-	for(hTCP = 0; hTCP < MAX_TCP_SOCKETS; hTCP++ )
+	// Look for a connected socket that is expecting this packet
+	for(hTCP = TCPHashTable[TCPHashBucket(hash)]; hTCP != INVALID_SOCKET; hTCP = TCBStubs[hTCP].vHashNext)
 	{
-		hCurrentTCP = hTCP;
-
-		if(TCBStubs[hCurrentTCP].smState == TCP_CLOSED)
+		if((TCBStubs[hTCP].smState == TCP_CLOSED) || (TCBStubs[hTCP].smState == TCP_LISTEN) || (TCBStubs[hTCP].remoteHash.Val != hash))
 		{
 			continue;
 		}
-		else if(TCBStubs[hCurrentTCP].smState == TCP_LISTEN)
-		{// For listening ports, check if this is the correct port
-			if(TCBStubs[hCurrentTCP].remoteHash.Val == h->DestPort)
-				partialMatch = hTCP;
 
-			continue;
-		}
-		else if(TCBStubs[hCurrentTCP].remoteHash.Val != hash)
-		{// Ignore if the hash doesn't match
-			continue;
+		if(	h->DestPort == TCBStubs[hTCP].mLocalPort.Val &&
+			h->SourcePort == TCBStubs[hTCP].mRemotePort.Val &&
+			remote->IPAddr.Val == TCBStubs[hTCP].mRemoteNode.IPAddr.Val)
+		{
+			hCurrentTCP = hTCP;
+			SyncTCB();
+			return TRUE;
 		}
+	}
 
-		SyncTCB();
-		if(	h->DestPort == MyTCB.localPort.Val &&
-			h->SourcePort == MyTCB.remotePort.Val &&
-			remote->IPAddr.Val == MyTCB.remote.niRemoteMACIP.IPAddr.Val)
+	// For listening ports, check if this is the correct port
+	for(hTCP = TCPHashTable[TCPHashBucket(h->DestPort)]; hTCP != INVALID_SOCKET; hTCP = TCBStubs[hTCP].vHashNext)
+	{
+		if((TCBStubs[hTCP].smState == TCP_LISTEN) && (TCBStubs[hTCP].remoteHash.Val == h->DestPort))
 		{
-			return TRUE;
+			partialMatch = hTCP;
 		}
 	}
 
@@ -1070,13 +1116,13 @@ static BOOL FindMatchingSocket_TCP(TCP_HEADER* h, NODE_INFO* remote)
 		// and add to the SYN queue.
 		if(partialMatch != INVALID_SOCKET)
 		{
-			TCBStubs[hCurrentTCP].remoteHash.Val = hash;
-
 			memcpy((void*)&MyTCB.remote, (void*)remote, sizeof(NODE_INFO));
 			MyTCB.remotePort.Val = h->SourcePort;
 			MyTCB.localPort.Val = h->DestPort;
 			MyTCB.txUnackedTail	= TCBStubs[hCurrentTCP].bufferTxStart;
 
+			SetRemoteHash(hash);
+
 			// All done, and we have a match
 			return TRUE;
 		}
@@ -1124,13 +1170,10 @@ static BOOL FindMatchingSocket_TCP(TCP_HEADER* h, NODE_INFO* remote)
 		// request at a later time if the client disconnects.
 		for(hTCP = 0; hTCP < MAX_TCP_SOCKETS; hTCP++)
 		{
-            hCurrentTCP = hTCP;
-			if(!TCBStubs[hCurrentTCP].Flags.bServer)
+			if(!TCBStubs[hTCP].Flags.bServer)
 				continue;
 
-			SyncTCB();
-            
-			if(MyTCB.localPort.Val != h->DestPort)
+			if(TCBStubs[hTCP].mLocalPort.Val != h->DestPort)
 				continue;
 
 			// Generate the SYN queue entry
@@ -1148,6 +1191,44 @@ static BOOL FindMatchingSocket_TCP(TCP_HEADER* h, NODE_INFO* remote)
 
 }
 
+/******************************************************************************
+ * ---SetRemoteHash
+ * Changes the remoteHash of the current socket and moves it to the matching
+ * bucket of TCPHashTable[]. The ports and remote node of MyTCB (which must be
+ * synchronized) are copied in the stub so that FindMatchingSocket_TCP can
+ * check a candidate without loading its TCB.
+ ******************************************************************************/
+static void SetRemoteHash(WORD hash)
+{
+	TCP_SOCKET *pLink;
+
+	// Unlink the socket from the bucket of its previous hash
+	pLink = &TCPHashTable[TCPHashBucket(TCBStubs[hCurrentTCP].remoteHash.Val)];
+	while(*pLink != INVALID_SOCKET)
+	{
+		if(*pLink == hCurrentTCP)
+		{
+			*pLink = TCBStubs[hCurrentTCP].vHashNext;
+			break;
+		}
+		pLink = &TCBStubs[*pLink].vHashNext;
+	}
+
+	TCBStubs[hCurrentTCP].remoteHash.Val = hash;
+	TCBStubs[hCurrentTCP].mLocalPort.Val = MyTCB.localPort.Val;
+	TCBStubs[hCurrentTCP].mRemotePort.Val = MyTCB.remotePort.Val;
+	memcpy((void*)&TCBStubs[hCurrentTCP].mRemoteNode, (void*)&MyTCB.remote.niRemoteMACIP, sizeof(NODE_INFO));
+
+	// Link it in socket index order so that lookups keep the priority of a linear scan
+	pLink = &TCPHashTable[TCPHashBucket(hash)];
+	while((*pLink != INVALID_SOCKET) && (*pLink < hCurrentTCP))
+	{
+		pLink = &TCBStubs[*pLink].vHashNext;
+	}
+	TCBStubs[hCurrentTCP].vHashNext = *pLink;
+	*pLink = hCurrentTCP;
+}
+
 static void SyncTCB(void)
 {
 	static TCP_SOCKET hLastTCB = INVALID_SOCKET;
@@ -1158,12 +1239,12 @@ static void SyncTCB(void)
 	if(hLastTCB != INVALID_SOCKET)
 	{
 		// Save the current TCB
-		TCPRAMCopy(TCBStubs[hLastTCB].bufferTxStart - sizeof(MyTCB), TCP_PIC_RAM, (PTR_BASE)&MyTCB, TCP_PIC_RAM, sizeof(MyTCB));
+		TCPRAMCopy((PTR_BASE)&TCBStore[hLastTCB], TCP_PIC_RAM, (PTR_BASE)&MyTCB, TCP_PIC_RAM, sizeof(MyTCB));
 	}
 
 	// Load up the new TCB
 	hLastTCB = hCurrentTCP;
-	TCPRAMCopy((PTR_BASE)&MyTCB, TCP_PIC_RAM, TCBStubs[hCurrentTCP].bufferTxStart - sizeof(MyTCB), TCP_PIC_RAM, sizeof(MyTCB));
+	TCPRAMCopy((PTR_BASE)&MyTCB, TCP_PIC_RAM, (PTR_BASE)&TCBStore[hCurrentTCP], TCP_PIC_RAM, sizeof(MyTCB));
 
 }
 
@@ -1590,7 +1671,14 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
 			// The window size advirtised in this packet is adjusted to account
 			// for any bytes that we have transmitted but haven't been ACKed yet
 			// by this segment.
-			wNewWindow = h->Window - ((WORD)(MyTCB.MySEQ - localAckNumber));
+			dwTemp = (DWORD)h->Window;
+			dwTemp -= (DWORD)(MyTCB.MySEQ - localAckNumber);
+			if((LONG)dwTemp < 0)
+				wNewWindow = 0;
+			else if(dwTemp > 0xFFFFu)
+				wNewWindow = 0xFFFF;
+			else
+				wNewWindow = (WORD)dwTemp;
 
 			// Update the local stored copy of the RemoteWindow.
 			// If previously we had a zero window, and now we don't, then
@@ -1942,10 +2030,26 @@ static void HandleTCPSeg(TCP_HEADER* h, WORD len)
  * sockets). Server sockets can be freed using TCPClose only (calls to
  * TCPDisconnect will return server sockets to the listening state,
  * allowing reuse).
+ * The socket gets the default TCP_SOCKET_TX_BUFFER_SIZE and
+ * TCP_SOCKET_RX_BUFFER_SIZE FIFOs, use TCPOpenEx for other sizes.
  ******************************************************************************/
 TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort)
+{
+	return TCPOpenEx(dwRemoteHost, vRemoteHostType, wPort, TCP_SOCKET_TX_BUFFER_SIZE, TCP_SOCKET_RX_BUFFER_SIZE);
+}
+
+/******************************************************************************
+ * ---TCPOpenEx
+ * Same as TCPOpen, the TX and RX FIFOs of the socket are allocated with
+ * the given sizes from the TCPBufferInPIC pool (e.g. large RX FIFO for
+ * bulk transfers). The FIFOs of a socket are kept while it is closed and
+ * reclaimed when the socket is opened again or when the pool is short of
+ * memory. INVALID_SOCKET is returned if no socket or memory is available.
+ ******************************************************************************/
+TCP_SOCKET TCPOpenEx(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, WORD wTxBufferSize, WORD wRxBufferSize)
 {
 	TCP_SOCKET hTCP;
+	TCP_SOCKET hOther;
 
 	// Find an available socket that matches the specified socket type
 	for(hTCP = 0; hTCP < MAX_TCP_SOCKETS; hTCP++)
@@ -1956,7 +2060,31 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort)
         {
 			continue;
         }
+
+		// Allocate the FIFOs, reclaiming the ones of the other closed sockets if needed
+		if(!TCPAllocBuffers(wTxBufferSize, wRxBufferSize))
+		{
+			for(hOther = 0; hOther < MAX_TCP_SOCKETS; hOther++)
+			{
+				if((hOther != hTCP) && (TCBStubs[hOther].smState == TCP_CLOSED))
+				{
+					TCBStubs[hOther].bufferTxStart = 0;
+					TCBStubs[hOther].bufferRxStart = 0;
+					TCBStubs[hOther].bufferEnd = 0;
+				}
+			}
+			if(!TCPAllocBuffers(wTxBufferSize, wRxBufferSize))
+			{
+				return INVALID_SOCKET;
+			}
+		}
+
 		SyncTCB();
+		TCBStubs[hCurrentTCP].txHead = TCBStubs[hCurrentTCP].bufferTxStart;
+		TCBStubs[hCurrentTCP].txTail = TCBStubs[hCurrentTCP].bufferTxStart;
+		TCBStubs[hCurrentTCP].rxHead = TCBStubs[hCurrentTCP].bufferRxStart;
+		TCBStubs[hCurrentTCP].rxTail = TCBStubs[hCurrentTCP].bufferRxStart;
+		MyTCB.txUnackedTail = TCBStubs[hCurrentTCP].bufferTxStart;
 		// Start out assuming worst case Maximum Segment Size (changes when MSS
 		// option is received from remote node)
 		MyTCB.wRemoteMSS = 536;
@@ -1965,7 +2093,7 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort)
 			MyTCB.localPort.Val = wPort;
 			TCBStubs[hCurrentTCP].Flags.bServer = TRUE;
 			TCBStubs[hCurrentTCP].smState = TCP_LISTEN;
-			TCBStubs[hCurrentTCP].remoteHash.Val = wPort;
+			SetRemoteHash(wPort);
 		}
 		else
 		{
@@ -1981,35 +2109,99 @@ TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort)
             // Flag to start the DNS, ARP, SYN processes
             TCBStubs[hCurrentTCP].eventTime = mGetTick();
             TCBStubs[hCurrentTCP].Flags.bTimerEnabled = 1;
-            TCBStubs[hCurrentTCP].remoteHash.Val = (((DWORD_VAL*)&dwRemoteHost)->w[1]+((DWORD_VAL*)&dwRemoteHost)->w[0] + wPort) ^ MyTCB.localPort.Val;
             MyTCB.remote.niRemoteMACIP.IPAddr.Val = dwRemoteHost;
+            SetRemoteHash((((DWORD_VAL*)&dwRemoteHost)->w[1]+((DWORD_VAL*)&dwRemoteHost)->w[0] + wPort) ^ MyTCB.localPort.Val);
             MyTCB.retryCount = 2;
             MyTCB.retryInterval = (TICK_1S/4)/256;
             TCBStubs[hCurrentTCP].smState = TCP_GATEWAY_SEND_ARP;
 		}
-        TCBStubs[hCurrentTCP].mLocalPort.Val = NextPort;
-        TCBStubs[hCurrentTCP].mRemotePort.Val = wPort;
-        memcpy((void*)&TCBStubs[hCurrentTCP].mRemoteNode, (void*)&MyTCB.remote, sizeof(NODE_INFO));
 		return hTCP;
 	}
 	return INVALID_SOCKET;
 }
 
+/******************************************************************************
+ * ---TCPAllocBuffers
+ * Allocates the TX and RX FIFOs of the current socket in the TCPBufferInPIC
+ * pool (first fit between the FIFOs of the other sockets). The previous
+ * FIFOs of the current socket are released. Returns FALSE if there is no
+ * hole large enough in the pool.
+ ******************************************************************************/
+static BOOL TCPAllocBuffers(WORD wTxBufferSize, WORD wRxBufferSize)
+{
+	TCP_SOCKET hOther;
+	PTR_BASE ptrStart = TCP_PIC_RAM_BASE_ADDRESS;
+	DWORD dwSize = (DWORD)wTxBufferSize + 1 + (DWORD)wRxBufferSize + 1;
+
+	if((wTxBufferSize == 0u) || (wRxBufferSize == 0u))
+		return FALSE;
+
+	// Move the start after every FIFO overlapping the candidate area
+	for(hOther = 0; hOther < MAX_TCP_SOCKETS; hOther++)
+	{
+		if((hOther == hCurrentTCP) || (TCBStubs[hOther].bufferTxStart == 0u))
+			continue;
+
+		if((TCBStubs[hOther].bufferTxStart < ptrStart + dwSize) && (TCBStubs[hOther].bufferEnd >= ptrStart))
+		{
+			ptrStart = TCBStubs[hOther].bufferEnd + 1;
+			hOther = (TCP_SOCKET)-1;	// Restart the scan with the new candidate
+		}
+	}
+
+	if(ptrStart + dwSize > TCP_PIC_RAM_BASE_ADDRESS + TCP_PIC_RAM_SIZE)
+		return FALSE;
+
+	TCBStubs[hCurrentTCP].bufferTxStart = ptrStart;
+	TCBStubs[hCurrentTCP].bufferRxStart = ptrStart + wTxBufferSize + 1;
+	TCBStubs[hCurrentTCP].bufferEnd = TCBStubs[hCurrentTCP].bufferRxStart + wRxBufferSize;
+	return TRUE;
+}
+
 /******************************************************************************
  * ---SendTCP
  * This function assembles and transmits a TCP segment, including any
  * pending data.  It also supports retransmissions, keep-alives, and other packet types.
+ * The payload is copied from the socket TX FIFO into the MAC TX buffer after the
+ * headers and options: the frame stays valid while it is queued in the ETHC even
+ * if the FIFO is refilled (TCPPut), released (CloseSocket) or reclaimed (TCPOpenEx).
  ******************************************************************************/
 static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 {
 	WORD_VAL        wVal;
 	TCP_HEADER      header;
-	TCP_OPTIONS     options;
+	BYTE            vOptions[TCP_OPTIONS_MAX_SIZE];
+	BYTE            vOptionsLen;
+	DWORD           dwSACKEdge;
 	PSEUDO_HEADER   pseudoHeader;
 	WORD 		len;
+	WORD            wMaxSegSize;
+	PTR_BASE        ptrPayload;
+	WORD            wPayloadLen;
+	WORD            wWrappedLen;
 
 	SyncTCB();
 
+	// Do not wait for a free TX buffer: let TCPTick() send the segment later.
+	// Data, ACKs and FINs go out with the next ASAP transmission, SYNs are 
+	// resent by the retransmission timer of the SYN_SENT/SYN_RECEIVED states.
+	if(!MACIsTxReady())
+	{
+		if(vTCPFlags & FIN)
+			TCBStubs[hCurrentTCP].Flags.bTXFIN = 1;
+
+		if(vTCPFlags & SYN)
+		{
+			TCBStubs[hCurrentTCP].eventTime = mGetTick();
+			TCBStubs[hCurrentTCP].Flags.bTimerEnabled = 1;
+		}
+		else if(!(vTCPFlags & RST))
+		{
+			TCBStubs[hCurrentTCP].Flags.bTXASAP = 1;
+		}
+		return;
+	}
+
 	// FINs must be handled specially
 	if(vTCPFlags & FIN)
 	{
@@ -2026,10 +2218,15 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 	TCBStubs[hCurrentTCP].Flags.bTXASAPWithoutTimerReset = 0;
 	TCBStubs[hCurrentTCP].Flags.bHalfFullFlush = 0;
 
-	//  Make sure that we can write to the MAC transmit area
-	while(!MACIsTxReady());
+	// The remote MSS includes the TCP options (RFC 6691): keep room for a SACK block
+	wMaxSegSize = MyTCB.wRemoteMSS;
+	if(MyTCB.flags.bSACKPermitted && (MyTCB.sHoleSize > 0))
+		wMaxSegSize -= TCP_OPTIONS_MAX_SIZE;
 
 	// Put all socket application data in the TX space
+	ptrPayload = MyTCB.txUnackedTail;
+	wPayloadLen = 0;
+	wWrappedLen = 0;
 	if(vTCPFlags & (SYN | RST))
 	{
 		// Don't put any data in SYN and RST messages
@@ -2050,14 +2247,14 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 			if(len > MyTCB.remoteWindow)
 				len = MyTCB.remoteWindow;
 
-			if(len > MyTCB.wRemoteMSS)
+			if(len > wMaxSegSize)
 			{
-				len = MyTCB.wRemoteMSS;
+				len = wMaxSegSize;
 				TCBStubs[hCurrentTCP].Flags.bTXASAPWithoutTimerReset = 1;
 			}
 
-			// Copy application data into the raw TX buffer
-			TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER), TCP_ETH_RAM, MyTCB.txUnackedTail, TCP_PIC_RAM, len);
+			// Application data copied after the headers of the frame
+			wPayloadLen = len;
 			MyTCB.txUnackedTail += len;
 		}
 		else
@@ -2068,24 +2265,19 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 			if(len > MyTCB.remoteWindow)
 				len = MyTCB.remoteWindow;
 
-			if(len > MyTCB.wRemoteMSS)
+			if(len > wMaxSegSize)
 			{
-				len = MyTCB.wRemoteMSS;
+				len = wMaxSegSize;
 				TCBStubs[hCurrentTCP].Flags.bTXASAPWithoutTimerReset = 1;
 			}
 
 			if(pseudoHeader.Length > len)
 				pseudoHeader.Length = len;
 
-			// Copy application data into the raw TX buffer
-			TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER), TCP_ETH_RAM, MyTCB.txUnackedTail, TCP_PIC_RAM, pseudoHeader.Length);
-			pseudoHeader.Length = len - pseudoHeader.Length;
-
-			// Copy any left over chunks of application data over
-			if(pseudoHeader.Length)
-			{
-				TCPRAMCopy(BASE_TX_ADDR+sizeof(ETHER_HEADER)+sizeof(IP_HEADER)+sizeof(TCP_HEADER)+(TCBStubs[hCurrentTCP].bufferRxStart-MyTCB.txUnackedTail), TCP_ETH_RAM, TCBStubs[hCurrentTCP].bufferTxStart, TCP_PIC_RAM, pseudoHeader.Length);
-			}
+			// Application data copied after the headers of the frame, then
+			// the chunk wrapped at the start of the FIFO
+			wPayloadLen = pseudoHeader.Length;
+			wWrappedLen = len - pseudoHeader.Length;
 
 			MyTCB.txUnackedTail += len;
 			if(MyTCB.txUnackedTail >= TCBStubs[hCurrentTCP].bufferRxStart)
@@ -2095,7 +2287,7 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 		// If we are to transmit a FIN, make sure we can put one in this packet
 		if(TCBStubs[hCurrentTCP].Flags.bTXFIN)
 		{
-			if((len != MyTCB.remoteWindow) && (len != MyTCB.wRemoteMSS))
+			if((len != MyTCB.remoteWindow) && (len != wMaxSegSize))
 				vTCPFlags |= FIN;
 		}
 	}
@@ -2208,23 +2400,47 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 
 	SwapTCPHeader(&header);
 
-
-	len += sizeof(header);
-	header.DataOffset.Val   = sizeof(header) >> 2;
-
-	// Insert the MSS (Maximum Segment Size) TCP option if this is SYN packet
+	vOptionsLen = 0;
 	if(vTCPFlags & SYN)
 	{
-		len += sizeof(options);
-		options.Kind = TCP_OPTIONS_MAX_SEG_SIZE;
-		options.Length = 0x04;
-
-		// Load MSS and swap to big endian
-		options.MaxSegSize.Val = (((TCP_MAX_SEG_SIZE_RX)&0x00FF)<<8) | (((TCP_MAX_SEG_SIZE_RX)&0xFF00)>>8);
-
-		header.DataOffset.Val   += sizeof(options) >> 2;
+		// Insert the MSS (Maximum Segment Size) TCP option, big endian
+		vOptions[vOptionsLen++] = TCP_OPTIONS_MAX_SEG_SIZE;
+		vOptions[vOptionsLen++] = 0x04;
+		vOptions[vOptionsLen++] = (BYTE)((TCP_MAX_SEG_SIZE_RX) >> 8);
+		vOptions[vOptionsLen++] = (BYTE)(TCP_MAX_SEG_SIZE_RX);
+
+		// Offer SACK on an active open, answer it on a passive open
+		if(!(vTCPFlags & ACK) || MyTCB.flags.bSACKPermitted)
+		{
+			vOptions[vOptionsLen++] = TCP_OPTIONS_NO_OP;
+			vOptions[vOptionsLen++] = TCP_OPTIONS_NO_OP;
+			vOptions[vOptionsLen++] = TCP_OPTIONS_SACK_PERMITTED;
+			vOptions[vOptionsLen++] = 0x02;
+		}
+	}
+	else if(MyTCB.flags.bSACKPermitted && (MyTCB.sHoleSize > 0) && (vTCPFlags & ACK))
+	{
+		// Report the out of order data kept after the hole, so that the
+		// remote node only retransmits the missing bytes
+		vOptions[vOptionsLen++] = TCP_OPTIONS_NO_OP;
+		vOptions[vOptionsLen++] = TCP_OPTIONS_NO_OP;
+		vOptions[vOptionsLen++] = TCP_OPTIONS_SACK;
+		vOptions[vOptionsLen++] = 0x0A;
+		dwSACKEdge = MyTCB.RemoteSEQ + (DWORD)MyTCB.sHoleSize;
+		vOptions[vOptionsLen++] = (BYTE)(dwSACKEdge >> 24);
+		vOptions[vOptionsLen++] = (BYTE)(dwSACKEdge >> 16);
+		vOptions[vOptionsLen++] = (BYTE)(dwSACKEdge >> 8);
+		vOptions[vOptionsLen++] = (BYTE)(dwSACKEdge);
+		dwSACKEdge += MyTCB.wFutureDataSize;
+		vOptions[vOptionsLen++] = (BYTE)(dwSACKEdge >> 24);
+		vOptions[vOptionsLen++] = (BYTE)(dwSACKEdge >> 16);
+		vOptions[vOptionsLen++] = (BYTE)(dwSACKEdge >> 8);
+		vOptions[vOptionsLen++] = (BYTE)(dwSACKEdge);
 	}
 
+	len += sizeof(header) + vOptionsLen;
+	header.DataOffset.Val   = (sizeof(header) + vOptionsLen) >> 2;
+
 	// Calculate IP pseudoheader checksum.
 	pseudoHeader.SourceAddress	= AppConfig.MyIPAddr;
 	pseudoHeader.DestAddress    = MyTCB.remote.niRemoteMACIP.IPAddr;
@@ -2238,12 +2454,15 @@ static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags)
 	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER));
 	IPPutHeader(&MyTCB.remote.niRemoteMACIP, IP_PROTOCOLE_TCP, len);
 	MACPutArray((BYTE*)&header, sizeof(header));
-	if(vTCPFlags & SYN)
-		MACPutArray((BYTE*)&options, sizeof(options));
+	if(vOptionsLen)
+		MACPutArray(vOptions, vOptionsLen);
+	if(wPayloadLen)
+		TCPRAMCopy((PTR_BASE)-1, TCP_ETH_RAM, ptrPayload, TCP_PIC_RAM, wPayloadLen);
+	if(wWrappedLen)
+		TCPRAMCopy((PTR_BASE)-1, TCP_ETH_RAM, TCBStubs[hCurrentTCP].bufferTxStart, TCP_PIC_RAM, wWrappedLen);
 
 	// Update the TCP checksum
-	MACSetReadPtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER));
-	wVal.Val = CalcIPBufferChecksum(len);
+	wVal.Val = MACCalcTxChecksum(sizeof(IP_HEADER), len);
 	MACSetWritePtr(BASE_TX_ADDR + sizeof(ETHER_HEADER) + sizeof(IP_HEADER) + 16);
 	MACPutArray((BYTE*)&wVal, sizeof(WORD));
 
@@ -2393,7 +2612,7 @@ static void CloseSocket(void)
 {
 	SyncTCB();
 
-	TCBStubs[hCurrentTCP].remoteHash.Val = MyTCB.localPort.Val;
+	SetRemoteHash(MyTCB.localPort.Val);
 	TCBStubs[hCurrentTCP].txHead = TCBStubs[hCurrentTCP].bufferTxStart;
 	TCBStubs[hCurrentTCP].txTail = TCBStubs[hCurrentTCP].bufferTxStart;
 	TCBStubs[hCurrentTCP].rxHead = TCBStubs[hCurrentTCP].bufferRxStart;
@@ -2414,6 +2633,7 @@ static void CloseSocket(void)
 	MyTCB.flags.bSYNSent = 0;
 	MyTCB.flags.bRXNoneACKed1 = 0;
 	MyTCB.flags.bRXNoneACKed2 = 0;
+	MyTCB.flags.bSACKPermitted = 0;
 	MyTCB.txUnackedTail = TCBStubs[hCurrentTCP].bufferTxStart;
 	((DWORD_VAL*)(&MyTCB.MySEQ))->w[0] = LFSRRand();
 	((DWORD_VAL*)(&MyTCB.MySEQ))->w[1] = LFSRRand();
@@ -2576,12 +2796,18 @@ WORD TCPPutArray(TCP_SOCKET hTCP, BYTE* data, WORD len)
 /******************************************************************************
  * ---GetMaxSegSizeOption
  * Parses the current TCP packet header and extracts the Maximum Segment Size option.
+ * The SACK Permitted option (only valid in a SYN) is also extracted in MyTCB.
+ * Other options (Window Scale...) are skipped: window scaling is not offered,
+ * so neither node scales its window (RFC 7323).
  ******************************************************************************/
 static WORD GetMaxSegSizeOption(void)
 {
 	BYTE vOptionsBytes;
 	BYTE vOption;
-	WORD wMSS;
+	BYTE vLength;
+	WORD wMSS = 536;
+
+	MyTCB.flags.bSACKPermitted = 0;
 
 	// Find out how many options bytes are in this packet.
 	IPSetRxBuffer(2+2+4+4);	// Seek to data offset field, skipping Source port (2), Destination port (2), Sequence number (4), and Acknowledgement number (4)
@@ -2596,57 +2822,49 @@ static WORD GetMaxSegSizeOption(void)
 	// Seek to beginning of options
 	MACGetArray(NULL, 7);
 
-	// Search for the Maximum Segment Size option
+	// Search for the Maximum Segment Size and SACK Permitted options
 	while(vOptionsBytes--)
 	{
 		vOption = MACGet();
 
-		if(vOption == 0u)	// End of Options list
+		if(vOption == TCP_OPTIONS_END_OF_LIST)
 			break;
 
-		if(vOption == 1u)	// NOP option
+		if(vOption == TCP_OPTIONS_NO_OP)
 			continue;
 
-		if(vOption == 2u)	// Maximum Segment Size option
-		{
-			if(vOptionsBytes < 3u)
-				break;
-
-			wMSS = 0;
+		// Every other option has a length (including kind and length bytes)
+		if(vOptionsBytes < 1u)
+			break;
+		vLength = MACGet();
+		vOptionsBytes--;
+		if((vLength < 2u) || (vOptionsBytes < vLength - 2u))
+			break;
+		vOptionsBytes -= vLength - 2u;
 
-			// Get option length
-			vOption = MACGet();
-			if(vOption == 4u)
-			{// Retrieve MSS and swap value to little endian
-				((BYTE*)&wMSS)[1] = MACGet();
-				((BYTE*)&wMSS)[0] = MACGet();
-			}
+		if((vOption == TCP_OPTIONS_MAX_SEG_SIZE) && (vLength == 4u))
+		{// Retrieve MSS and swap value to little endian
+			((BYTE*)&wMSS)[1] = MACGet();
+			((BYTE*)&wMSS)[0] = MACGet();
 
 			if(wMSS < 536u)
-				break;
-			if(wMSS > TCP_MAX_SEG_SIZE_TX)
-				return TCP_MAX_SEG_SIZE_TX;
-			else
-				return wMSS;
+				wMSS = 536;
+			else if(wMSS > TCP_MAX_SEG_SIZE_TX)
+				wMSS = TCP_MAX_SEG_SIZE_TX;
+		}
+		else if((vOption == TCP_OPTIONS_SACK_PERMITTED) && (vLength == 2u))
+		{
+			MyTCB.flags.bSACKPermitted = 1;
 		}
 		else
-		{ // Assume this is a multi byte option and throw it way
-			if(vOptionsBytes < 2u)
-				break;
-			vOption = MACGet();
-			if(vOptionsBytes < vOption)
-				break;
-			MACGetArray(NULL, vOption);
-			vOptionsBytes -= vOption;
+		{ // Unknown option, throw it way
+			MACGetArray(NULL, vLength - 2u);
 		}
-
 	}
 
-	// Did not find MSS option, return worst case default
-	return 536;
+	return wMSS;
 }
 
-
 /******************************************************************************
  * ---TCPIsPutReady
  * Call this function to determine how many bytes can be written to the
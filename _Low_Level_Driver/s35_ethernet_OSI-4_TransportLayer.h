@@ -18,6 +18,7 @@ typedef WORD UDP_PORT;
 #define SwapPseudoHeader(h)  (h.Length = swap_word(h.Length))
 
 #define MAX_UDP_SOCKETS             (8u)
+#define UDP_HASH_TABLE_SIZE         (8u)        // Number of local port buckets used to demultiplex incoming datagrams (must be a power of 2)
 #define INVALID_UDP_SOCKET          (0xffu)		// Indicates a UDP socket that is not valid
 #define INVALID_UDP_PORT            (0ul)		// Indicates a UDP port that is not valid
 
@@ -62,6 +63,7 @@ typedef struct
 		unsigned char bRemoteHostIsROM : 1;	// Remote host is stored in ROM
 	}flags;
 	QWORD eventTime;
+	UDP_SOCKET nextSocket;		// Next socket of the same local port bucket, or INVALID_UDP_SOCKET
 } UDP_SOCKET_INFO;
 
 /*********************************************************************
@@ -90,9 +92,10 @@ typedef BYTE TCP_SOCKET;
 #define UNKNOWN_SOCKET                          (0xFF)	// The socket is not known
 
 #define MAX_TCP_SOCKETS                         (3)
-#define TCP_SOCKET_TX_BUFFER_SIZE               (200)   // For each TCP Socket
-#define TCP_SOCKET_RX_BUFFER_SIZE               (500)  // For each TCP Socket
-#define TCP_PIC_RAM_SIZE                        (MAX_TCP_SOCKETS*(TCP_SOCKET_TX_BUFFER_SIZE + TCP_SOCKET_RX_BUFFER_SIZE + 150))
+#define TCP_SOCKET_TX_BUFFER_SIZE               (200)   // Default TX FIFO size of a socket opened with TCPOpen()
+#define TCP_SOCKET_RX_BUFFER_SIZE               (500)   // Default RX FIFO size of a socket opened with TCPOpen()
+#define TCP_PIC_RAM_SIZE                        (MAX_TCP_SOCKETS*(TCP_SOCKET_TX_BUFFER_SIZE + TCP_SOCKET_RX_BUFFER_SIZE + 2))   // Shared pool the socket FIFOs are allocated from by TCPOpen()/TCPOpenEx() (each FIFO takes 1 more byte)
+#define TCP_HASH_TABLE_SIZE                     (8u)    // Number of remoteHash buckets used to demultiplex incoming segments (must be a power of 2)
 
 #define TCP_ETH_RAM                             0u
 #define TCP_PIC_RAM                             1u
@@ -116,11 +119,14 @@ typedef BYTE TCP_SOCKET;
 
 #define TCPPutROMString(a,b)            TCPPutString(a,(BYTE*)b)
 #define TCP_MAX_SEG_SIZE_TX             (1460u)
-#define TCP_MAX_SEG_SIZE_RX             (536u)
+#define TCP_MAX_SEG_SIZE_RX             (1460u)
 
 #define TCP_OPTIONS_END_OF_LIST         (0x00u)		// End of List TCP Option Flag
 #define TCP_OPTIONS_NO_OP               (0x01u)		// No Op TCP Option
 #define TCP_OPTIONS_MAX_SEG_SIZE        (0x02u)		// Maximum segment size TCP flag
+#define TCP_OPTIONS_SACK_PERMITTED      (0x04u)		// SACK permitted TCP option (RFC 2018)
+#define TCP_OPTIONS_SACK                (0x05u)		// SACK TCP option (RFC 2018)
+#define TCP_OPTIONS_MAX_SIZE            (12u)		// MSS + SACK permitted, or a single SACK block
 
 typedef enum {
     TCP_GET_DNS_MODULE, // Special state for TCP client mode sockets
@@ -181,6 +187,7 @@ typedef struct
         unsigned char filler : 2; // Future expansion
     } Flags;
     WORD_VAL remoteHash; // Consists of remoteIP, remotePort, localPort for connected sockets.  It is a localPort number only for listening server sockets.
+    TCP_SOCKET vHashNext; // Next socket of the same remoteHash bucket, or INVALID_SOCKET
     BYTE vMemoryMedium;
 } TCB_STUB;
 
@@ -214,14 +221,15 @@ typedef struct {
         unsigned char bRemoteHostIsROM : 1; // Remote host is stored in ROM
         unsigned char bRXNoneACKed1 : 1; // A duplicate ACK was likely received
         unsigned char bRXNoneACKed2 : 1; // A second duplicate ACK was likely received
-        unsigned char filler : 3; // future use
+        unsigned char bSACKPermitted : 1; // The remote node accepts SACK blocks
+        unsigned char filler : 2; // future use
     } flags;
     WORD wRemoteMSS; // Maximum Segment Size option advirtised by the remote node during initial handshaking
     BYTE retryCount; // Counter for transmission retries
     BYTE vSocketPurpose;
 } TCB;
 
-typedef struct {
+typedef struct __attribute__((aligned(2), packed)) {
     WORD SourcePort; // Local port number
     WORD DestPort; // Remote port number
     DWORD SeqNumber; // Local sequence number
@@ -251,13 +259,6 @@ typedef struct {
     WORD UrgentPointer; // Urgent pointer
 } TCP_HEADER;
 
-typedef struct 
-{
-    BYTE Kind; // Type of option
-    BYTE Length; // Length
-    WORD_VAL MaxSegSize; // Maximum segment size
-} TCP_OPTIONS; // TCP Options data structure
-
 typedef struct  
 {
     IP_ADDR SourceAddress;
@@ -303,12 +304,15 @@ void TCPInit(void);
 void TCPTick(void);
 BOOL TCPProcess(NODE_INFO* remote, IP_ADDR localIP, WORD len);
 static BOOL FindMatchingSocket_TCP(TCP_HEADER* h, NODE_INFO* remote);
+static void SetRemoteHash(WORD hash);
 static void SyncTCB(void);
 static void TCPRAMCopy(PTR_BASE ptrDest, BYTE vDestType, PTR_BASE ptrSource, BYTE vSourceType, WORD wLength);
 static void SwapTCPHeader(TCP_HEADER* header);
 static void HandleTCPSeg(TCP_HEADER* h, WORD len);
 
 TCP_SOCKET TCPOpen(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort);
+TCP_SOCKET TCPOpenEx(DWORD dwRemoteHost, BYTE vRemoteHostType, WORD wPort, WORD wTxBufferSize, WORD wRxBufferSize);
+static BOOL TCPAllocBuffers(WORD wTxBufferSize, WORD wRxBufferSize);
 static void SendTCP(BYTE vTCPFlags, BYTE vSendFlags);
 void TCPFlush(TCP_SOCKET hTCP);
 void TCPDisconnect(TCP_SOCKET hTCP);
@@ -42,6 +42,8 @@ void ETH_StackInit(BYTE *str_mac, BYTE *str_ip, BOOL dhcpEnabled)
     
     if(!MACInit())
     {
+        ARPInit();
+        
         UDPInit();
 
         TCPInit();
@@ -53,7 +55,7 @@ void ETH_StackInit(BYTE *str_mac, BYTE *str_ip, BOOL dhcpEnabled)
 void ETH_StackTask(void)
 {
     NODE_INFO remoteNode;
-    IP_HEADER IPHeader;
+    IP_HEADER *IPHeader;
     BYTE frameType;
 
     if (AppConfig.bIsDHCPEnabled)
@@ -82,6 +84,8 @@ void ETH_StackTask(void)
         }
     }
 
+    ARPTask();
+
     TCPTick();
 
     UDPTask();
@@ -105,18 +109,18 @@ void ETH_StackTask(void)
             case MAC_IP:
                 if (IPGetHeader(&remoteNode.IPAddr, &IPHeader))
                 {
-                    if(IPHeader.Protocol == IP_PROTOCOLE_ICMP)
+                    if(IPHeader->Protocol == IP_PROTOCOLE_ICMP)
                     {
-                        ICMPProcess(&remoteNode, IPHeader.DestAddress, (WORD)(swap_word(IPHeader.TotalLength) - ((IPHeader.VersionIHL & 0x0f) << 2)));
+                        ICMPProcess(&remoteNode, IPHeader->DestAddress, (WORD)(swap_word(IPHeader->TotalLength) - ((IPHeader->VersionIHL & 0x0f) << 2)));
                     }
-                    else if(IPHeader.Protocol == IP_PROTOCOLE_TCP) 
+                    else if(IPHeader->Protocol == IP_PROTOCOLE_TCP) 
                     {
-                        TCPProcess(&remoteNode, IPHeader.DestAddress, (WORD)(swap_word(IPHeader.TotalLength) - ((IPHeader.VersionIHL & 0x0f) << 2)));
+                        TCPProcess(&remoteNode, IPHeader->DestAddress, (WORD)(swap_word(IPHeader->TotalLength) - ((IPHeader->VersionIHL & 0x0f) << 2)));
                     }
-                    else if(IPHeader.Protocol == IP_PROTOCOLE_UDP) 
+                    else if(IPHeader->Protocol == IP_PROTOCOLE_UDP) 
                     {
                         // Stop processing packets if we came upon a UDP frame with application data in it
-                        if(UDPProcess(&remoteNode, IPHeader.DestAddress, (WORD)(swap_word(IPHeader.TotalLength) - ((IPHeader.VersionIHL & 0x0f) << 2))))
+                        if(UDPProcess(&remoteNode, IPHeader->DestAddress, (WORD)(swap_word(IPHeader->TotalLength) - ((IPHeader->VersionIHL & 0x0f) << 2))))
                         {
                             return;
                         }
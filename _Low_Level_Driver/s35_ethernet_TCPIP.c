@@ -203,9 +203,13 @@ BOOL StringToMACAddress(BYTE* str, BYTE* MACAddress)
         checksum is the 16-bit one's complement of one's complement sum of all
         words in the data (with zero-padding if an odd number of bytes are
         summed).  This checksum is defined in RFC 793.
+        The data is summed 32 bits at a time (4 words per loop) and the carries
+        out of the 32-bit accumulator are counted separately, which is equivalent
+        to the 16-bit end-around carry (2^32 = 1 modulo 2^16-1).
 
   Precondition:
-        buffer is WORD aligned (even memory address) on 16- and 32-bit PICs.
+        None. An odd start address is summed byte swapped and the result
+        is swapped back (RFC 1071 byte order independence).
 
   Parameters:
         buffer - pointer to the data to be checksummed
@@ -213,29 +217,128 @@ BOOL StringToMACAddress(BYTE* str, BYTE* MACAddress)
 
   Returns:
         The calculated checksum.
-
-  Internal:
-        This function could be improved to do 32-bit sums on PIC32 platforms.
  ***************************************************************************/
 WORD CalcIPChecksum(BYTE* buffer, WORD count) 
 {
-    WORD i = count >> 1; // divide by 2;
-    WORD *val = (WORD*) buffer;
-    DWORD_VAL sum;
+    DWORD sum = 0;
+    DWORD carry = 0;
+    DWORD w0, w1, w2, w3;
+    DWORD *val;
+    BOOL bOddAddress = ((PTR_BASE) buffer & 0x1);
+    
+    if(!count)
+    {
+        return 0xffff;
+    }
     
-    sum.Val = 0;
-    while (i--)
+    // Align the pointer on a 32-bit boundary
+    if(bOddAddress)
+    {
+        sum = (DWORD) *buffer++ << 8;
+        count--;
+    }
+    if(((PTR_BASE) buffer & 0x2) && (count >= 2))
+    {
+        sum += (DWORD) *(WORD*) buffer;
+        buffer += 2;
+        count -= 2;
+    }
+    
+    val = (DWORD*) buffer;
+    while (count >= 16)
+    {
+        w0 = val[0];
+        w1 = val[1];
+        w2 = val[2];
+        w3 = val[3];
+        sum += w0;
+        carry += (sum < w0);
+        sum += w1;
+        carry += (sum < w1);
+        sum += w2;
+        carry += (sum < w2);
+        sum += w3;
+        carry += (sum < w3);
+        val += 4;
+        count -= 16;
+    }
+    while (count >= 4)
     {
-        sum.Val += (DWORD) *val++;
+        w0 = *val++;
+        sum += w0;
+        carry += (sum < w0);
+        count -= 4;
+    }
+    
+    // Add in the sum of the remaining word and byte, if present
+    buffer = (BYTE*) val;
+    w0 = 0;
+    if(count & 0x2)
+    {
+        w0 = (DWORD) *(WORD*) buffer;
+        buffer += 2;
     }
-    // Add in the sum of the remaining byte, if present
     if(count & 0x1)
     {
-        sum.Val += (DWORD)*(BYTE*) val;
+        w0 += (DWORD) *buffer;
     }
+    sum += w0;
+    carry += (sum < w0);
     
-    sum.Val = (DWORD) sum.w[0] + (DWORD) sum.w[1];  // Do an end-around carry (one's complement arrithmatic)
-    sum.w[0] += sum.w[1];       // Do another end-around carry in case if the prior add caused a carry out
+    sum = (sum & 0xffff) + (sum >> 16) + carry;     // Do an end-around carry (one's complement arrithmatic)
+    sum = (sum & 0xffff) + (sum >> 16);             // Do another end-around carry in case if the prior add caused a carry out
+    sum += (sum >> 16);
+    
+    if(bOddAddress)
+    {
+        sum = swap_word(sum);
+    }
+
+    return ~((WORD) sum);
+}
 
-    return ~sum.w[0];
+/*****************************************************************************
+  Function:
+        WORD CalcIPChecksumUpdate(WORD checksum, WORD oldValue, WORD newValue)
+
+  Summary:
+        Incrementally updates an IP checksum after a 16-bit field is modified.
+
+  Description:
+        Implements HC' = ~(~HC + ~m + m') from RFC 1624 so a single header
+        field (TTL/protocol word, port, identification...) can be rewritten
+        without summing the whole header or segment again. All parameters 
+        are in the same byte order as they are stored in the packet.
+
+  Parameters:
+        checksum - checksum currently stored in the packet
+        oldValue - previous value of the modified 16-bit field
+        newValue - new value of the modified 16-bit field
+
+  Returns:
+        The updated checksum.
+ ***************************************************************************/
+WORD CalcIPChecksumUpdate(WORD checksum, WORD oldValue, WORD newValue)
+{
+    DWORD sum;
+    
+    sum = (DWORD) ((WORD) ~checksum) + (DWORD) ((WORD) ~oldValue) + (DWORD) newValue;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum += (sum >> 16);
+    
+    return ~((WORD) sum);
+}
+
+/*****************************************************************************
+  Function:
+        WORD CalcIPChecksumUpdateDWORD(WORD checksum, DWORD oldValue, DWORD newValue)
+
+  Summary:
+        Incrementally updates an IP checksum after a 32-bit field is modified
+        (sequence/acknowledgement number, IP address).
+ ***************************************************************************/
+WORD CalcIPChecksumUpdateDWORD(WORD checksum, DWORD oldValue, DWORD newValue)
+{
+    checksum = CalcIPChecksumUpdate(checksum, (WORD) oldValue, (WORD) newValue);
+    return CalcIPChecksumUpdate(checksum, (WORD) (oldValue >> 16), (WORD) (newValue >> 16));
 }
@@ -70,5 +70,7 @@ DWORD   GenerateRandomDWORD(void);
 BOOL    StringToIPAddress(BYTE* str, IP_ADDR* IPAddress);
 BOOL    StringToMACAddress(BYTE* str, BYTE* MACAddress);
 WORD    CalcIPChecksum(BYTE* buffer, WORD len);
+WORD    CalcIPChecksumUpdate(WORD checksum, WORD oldValue, WORD newValue);
+WORD    CalcIPChecksumUpdateDWORD(WORD checksum, DWORD oldValue, DWORD newValue);
 
 #endif